@@ -0,0 +1,947 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+#include <iterator>
+#include <omp.h>
+#include <x86intrin.h>
+#include "../sha256_avx2/sha256_avx2.h"
+#include "../sha256_avx2/sha256_dispatch.h"
+#include "../ripemd160_avx2/ripemd160_avx2.h"
+#include "../ripemd160_avx2/ripemd160_dispatch.h"
+#include "../hash160_avx2/hash160_avx2.h"
+#include "../common/work_scheduler.h"
+
+// Benchmark suite of the kernels:
+//
+//   bench_avx2 [run] [options]     measure, print a table and optionally JSON
+//   bench_avx2 compare <baseline.json> <current.json> [--tolerance <percent>]
+//
+// Rows: the AVX2 transforms and 8-message entry points, the strided batch
+// and counter entry points on every kernel the CPU supports, and end-to-end
+// generation (work scheduler, key counter or random keys, hashing in batches
+// of 256 as the generators do, hash160 both in two passes and through the
+// fused kernel) on 1, 2, 4, ... up to --threads threads.
+//
+// Each row runs inside one OpenMP region, so thread startup is not timed. A
+// warmup of --warmup ms sizes the repetitions to about --time ms each; of the
+// --reps repetitions the fastest is reported, with how far the median is
+// above it. Cycles are rdtsc ticks (reference cycles at the nominal clock)
+// summed over the threads, Mhash/s is from the wall clock.
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options {
+    int threads = omp_get_max_threads();  // Largest thread count of the scaling rows
+    int reps = 7;
+    int warmupMs = 200;
+    int timeMs = 100;                     // Length of a repetition
+    std::string filter;                   // Only rows whose name contains it
+    std::string jsonPath;
+};
+
+struct Result {
+    std::string name;
+    std::string kernel;
+    int threads;
+    double cyclesPerHash;
+    double mhashPerSecond;
+    double spread;  // Median above the best repetition, percent
+};
+
+// Hash `hashes` messages on thread
+typedef std::function<void(int thread, uint64_t hashes)> Work;
+
+// Run by one thread before every pass of total hashes on threads threads
+typedef std::function<void(uint64_t total, int threads)> Setup;
+
+// Hashes per thread of a warmup pass, repetitions are multiples of it
+static const uint64_t kStep = 4096;
+
+static Result measure(const Options& options, int threads, const Work& work, const Setup& setup) {
+    std::vector<double> seconds(options.reps);
+    std::vector<uint64_t> cycles(options.reps);
+    uint64_t perThread = kStep;
+    int running = 1;
+    bool warm = false;
+    Clock::time_point start;
+    uint64_t tscStart = 0;
+
+    #pragma omp parallel num_threads(threads)
+    {
+        int thread = omp_get_thread_num();
+
+        // Warmup passes until warmupMs are over, their rate sizes the
+        // repetitions
+        Clock::time_point warmStart = Clock::now();
+        uint64_t passes = 0;
+        for (;;) {
+            #pragma omp barrier
+            #pragma omp master
+            {
+                running = omp_get_num_threads();
+                double elapsed = std::chrono::duration<double>(Clock::now() - warmStart).count();
+                if (elapsed * 1000 >= options.warmupMs) {
+                    warm = true;
+                    double steps = elapsed > 0 ? passes * (options.timeMs / 1000.0) / elapsed : 1;
+                    perThread = kStep * std::max<uint64_t>(1, (uint64_t)steps);
+                } else if (setup) {
+                    setup(kStep * running, running);
+                }
+            }
+            #pragma omp barrier
+            if (warm) {
+                break;
+            }
+            work(thread, kStep);
+            ++passes;
+        }
+
+        for (int r = 0; r < options.reps; ++r) {
+            #pragma omp barrier
+            #pragma omp master
+            {
+                if (setup) {
+                    setup(perThread * running, running);
+                }
+                start = Clock::now();
+                tscStart = __rdtsc();
+            }
+            #pragma omp barrier
+            work(thread, perThread);
+            #pragma omp barrier
+            #pragma omp master
+            {
+                cycles[r] = __rdtsc() - tscStart;
+                seconds[r] = std::chrono::duration<double>(Clock::now() - start).count();
+            }
+        }
+    }
+
+    size_t best = std::min_element(seconds.begin(), seconds.end()) - seconds.begin();
+    std::vector<double> sorted = seconds;
+    std::sort(sorted.begin(), sorted.end());
+    double total = (double)perThread * running;
+
+    Result result;
+    result.threads = running;
+    result.cyclesPerHash = (double)cycles[best] * running / total;
+    result.mhashPerSecond = total / seconds[best] / 1e6;
+    result.spread = (sorted[sorted.size() / 2] / seconds[best] - 1) * 100;
+    return result;
+}
+
+// Rows are measured and printed as they are added
+struct Suite {
+    Options options;
+    std::vector<Result> results;
+    std::map<std::string, double> singleThread;  // Mhash/s of the 1-thread row, for the scaling column
+
+    void add(const std::string& name, const std::string& kernel, int threads, const Work& work, const Setup& setup = Setup()) {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+            return;
+        }
+        Result result = measure(options, threads, work, setup);
+        result.name = name;
+        result.kernel = kernel;
+
+        std::string key = name + "/" + kernel;
+        if (result.threads == 1) {
+            singleThread[key] = result.mhashPerSecond;
+        }
+        std::cout << std::left << std::setw(30) << name << std::setw(14) << kernel
+                  << std::right << std::fixed << std::setw(8) << result.threads
+                  << std::setprecision(1) << std::setw(12) << result.cyclesPerHash
+                  << std::setprecision(2) << std::setw(12) << result.mhashPerSecond
+                  << std::setprecision(1) << std::setw(9) << result.spread << "%";
+        if (result.threads > 1 && singleThread.count(key)) {
+            std::cout << std::setprecision(2) << std::setw(10) << result.mhashPerSecond / (singleThread[key] * result.threads);
+        }
+        std::cout << std::endl;
+        results.push_back(result);
+    }
+};
+
+alignas(32) static uint8_t inputs[8][64];
+alignas(32) static unsigned char outputs[8][32];
+
+// Contiguous arrays for the strided batch APIs
+static const int kBatch = 4096;
+static uint8_t batchInputs[kBatch * 33];
+static uint8_t batchOutputs[kBatch * 32];
+
+// Only these functions are built for AVX2, they run after the CPU check
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#endif
+
+static __m256i transformState[8];
+
+// The AVX2 transforms and 8-message entry points, one thread
+static void benchAvx2(Suite& suite) {
+    static const uint8_t* blocks[8] = { inputs[0], inputs[1], inputs[2], inputs[3],
+                                        inputs[4], inputs[5], inputs[6], inputs[7] };
+
+    _sha256avx2::Initialize(transformState);
+    suite.add("_sha256avx2::Transform", "avx2", 1, [](int, uint64_t hashes) {
+        for (uint64_t i = 0; i < hashes / 8; ++i) {
+            _sha256avx2::Transform(transformState, blocks);
+        }
+    });
+
+    ripemd160avx2::Initialize(transformState);
+    suite.add("ripemd160avx2::Transform", "avx2", 1, [](int, uint64_t hashes) {
+        for (uint64_t i = 0; i < hashes / 8; ++i) {
+            ripemd160avx2::Transform(transformState, blocks);
+        }
+    });
+
+    suite.add("sha256avx2_8B", "avx2", 1, [](int, uint64_t hashes) {
+        for (uint64_t i = 0; i < hashes / 8; ++i) {
+            inputs[i & 7][0] = static_cast<uint8_t>(i);
+            sha256avx2_8B(inputs[0], inputs[1], inputs[2], inputs[3],
+                          inputs[4], inputs[5], inputs[6], inputs[7],
+                          outputs[0], outputs[1], outputs[2], outputs[3],
+                          outputs[4], outputs[5], outputs[6], outputs[7]);
+        }
+    });
+
+    suite.add("sha256avx2_8B<33>", "avx2", 1, [](int, uint64_t hashes) {
+        for (uint64_t i = 0; i < hashes / 8; ++i) {
+            inputs[i & 7][0] = static_cast<uint8_t>(i);
+            sha256avx2_8B<33>(inputs[0], inputs[1], inputs[2], inputs[3],
+                              inputs[4], inputs[5], inputs[6], inputs[7],
+                              outputs[0], outputs[1], outputs[2], outputs[3],
+                              outputs[4], outputs[5], outputs[6], outputs[7]);
+        }
+    });
+
+    suite.add("ripemd160avx2_32", "avx2", 1, [](int, uint64_t hashes) {
+        for (uint64_t i = 0; i < hashes / 8; ++i) {
+            inputs[i & 7][0] = static_cast<uint8_t>(i);
+            ripemd160avx2::ripemd160avx2_32(inputs[0], inputs[1], inputs[2], inputs[3],
+                                            inputs[4], inputs[5], inputs[6], inputs[7],
+                                            outputs[0], outputs[1], outputs[2], outputs[3],
+                                            outputs[4], outputs[5], outputs[6], outputs[7]);
+        }
+    });
+
+    suite.add("ripemd160avx2<32>", "avx2", 1, [](int, uint64_t hashes) {
+        for (uint64_t i = 0; i < hashes / 8; ++i) {
+            inputs[i & 7][0] = static_cast<uint8_t>(i);
+            ripemd160avx2::ripemd160avx2<32>(inputs[0], inputs[1], inputs[2], inputs[3],
+                                             inputs[4], inputs[5], inputs[6], inputs[7],
+                                             outputs[0], outputs[1], outputs[2], outputs[3],
+                                             outputs[4], outputs[5], outputs[6], outputs[7]);
+        }
+    });
+
+    suite.add("hash160avx2_8", "avx2", 1, [](int, uint64_t hashes) {
+        for (uint64_t i = 0; i < hashes / 8; ++i) {
+            inputs[i & 7][0] = static_cast<uint8_t>(i);
+            hash160avx2_8(inputs[0], inputs[1], inputs[2], inputs[3],
+                          inputs[4], inputs[5], inputs[6], inputs[7],
+                          outputs[0], outputs[1], outputs[2], outputs[3],
+                          outputs[4], outputs[5], outputs[6], outputs[7]);
+        }
+    });
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#elif defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+// Strided batch and counter entry points on every supported kernel, one thread
+static void benchKernels(Suite& suite) {
+    const char* kernelNames[] = { "avx512", "avx2x2", "avx2", "sse41", "scalar" };
+    std::string sha256Initial = sha256_kernel();
+    std::string ripemd160Initial = ripemd160_kernel();
+
+    for (const char* name : kernelNames) {
+        if (sha256_kernel_supported(name) && sha256_select_kernel(name)) {
+            suite.add("sha256_batch<33>", name, 1, [](int, uint64_t hashes) {
+                for (uint64_t i = 0; i < hashes; i += kBatch) {
+                    batchInputs[i & 1023] = static_cast<uint8_t>(i);
+                    sha256_batch<33>(batchInputs, 33, kBatch, batchOutputs);
+                }
+            });
+            suite.add("sha256_counter33", name, 1, [](int, uint64_t hashes) {
+                for (uint64_t i = 0; i < hashes; i += kBatch) {
+                    batchInputs[32] = static_cast<uint8_t>(i);
+                    sha256_counter33(batchInputs, kBatch, batchOutputs);
+                }
+            });
+        }
+        if (ripemd160_kernel_supported(name) && ripemd160_select_kernel(name)) {
+            suite.add("ripemd160_batch", name, 1, [](int, uint64_t hashes) {
+                for (uint64_t i = 0; i < hashes; i += kBatch) {
+                    batchInputs[i & 1023] = static_cast<uint8_t>(i);
+                    ripemd160_batch(batchInputs, 32, kBatch, batchOutputs);
+                }
+            });
+            suite.add("ripemd160_counter32", name, 1, [](int, uint64_t hashes) {
+                for (uint64_t i = 0; i < hashes; i += kBatch) {
+                    batchInputs[0] = static_cast<uint8_t>(i);
+                    ripemd160_counter32(batchInputs, kBatch, batchOutputs);
+                }
+            });
+        }
+    }
+
+    sha256_select_kernel(sha256Initial.c_str());
+    ripemd160_select_kernel(ripemd160Initial.c_str());
+}
+
+// Big-endian counter of the SHA-256 keys (last byte lowest)
+static void addBigEndian(uint8_t* bytes, size_t length, uint64_t increment) {
+    for (size_t i = length; i-- > 0;) {
+        uint64_t sum = bytes[i] + (increment & 0xFF);
+        bytes[i] = static_cast<uint8_t>(sum);
+        increment = (increment >> 8) + (sum >> 8);
+    }
+}
+
+// Little-endian counter of the RIPEMD-160 keys (byte 0 lowest)
+static void addLittleEndian(uint8_t* bytes, size_t length, uint64_t increment) {
+    for (size_t i = 0; i < length && increment != 0; ++i) {
+        uint64_t sum = bytes[i] + (increment & 0xFF);
+        bytes[i] = static_cast<uint8_t>(sum);
+        increment = (increment >> 8) + (sum >> 8);
+    }
+}
+
+// End-to-end generation as in the generators' main loop, on 1, 2, 4, ...
+// threads and options.threads
+static void benchGeneration(Suite& suite) {
+    const int maxThreads = suite.options.threads;
+    const uint64_t batchSize = 256;
+
+    std::vector<int> threadCounts;
+    for (int t = 1; t < maxThreads; t *= 2) {
+        threadCounts.push_back(t);
+    }
+    threadCounts.push_back(maxThreads);
+
+    // Digests of each thread's current batch
+    std::vector<std::vector<uint8_t>> digests(maxThreads, std::vector<uint8_t>(batchSize * 32));
+    std::vector<std::vector<uint8_t>> hash160s(maxThreads, std::vector<uint8_t>(batchSize * 20));
+    std::unique_ptr<WorkScheduler> scheduler;
+    Setup newScheduler = [&](uint64_t total, int threads) { scheduler.reset(new WorkScheduler(total, threads)); };
+
+    uint8_t initialKey[33] = { 0x02 };
+    initialKey[32] = 0x11;
+
+    // The generators' default path: the midstate counter kernels stand in for
+    // the avx2 kernel, every other kernel runs its dispatched counter kernel
+    bool sha256Midstate = strcmp(sha256_kernel(), "avx2") == 0;
+    bool ripemd160Midstate = strcmp(ripemd160_kernel(), "avx2") == 0;
+    std::string sha256Label = std::string(sha256_kernel()) + (sha256Midstate ? " mid" : "");
+    std::string ripemd160Label = std::string(ripemd160_kernel()) + (ripemd160Midstate ? " mid" : "");
+
+    for (int threads : threadCounts) {
+        suite.add("gen sha256 counter", sha256Label, threads, [&](int thread, uint64_t) {
+            uint64_t begin, end;
+            while (scheduler->next(thread, &begin, &end)) {
+                uint8_t key[33];
+                memcpy(key, initialKey, 33);
+                addBigEndian(key, 33, begin);
+                for (uint64_t i = begin; i < end; i += batchSize) {
+                    uint64_t count = std::min(batchSize, end - i);
+                    if (sha256Midstate) {
+                        sha256avx2_counter33_midstate(key, count, digests[thread].data());
+                    } else {
+                        sha256_counter33(key, count, digests[thread].data());
+                    }
+                    addBigEndian(key, 33, count);
+                }
+            }
+        }, newScheduler);
+    }
+
+    for (int threads : threadCounts) {
+        suite.add("gen sha256 random", sha256_kernel(), threads, [&](int thread, uint64_t) {
+            uint64_t begin, end;
+            while (scheduler->next(thread, &begin, &end)) {
+                for (uint64_t i = begin; i < end; i += batchSize) {
+                    sha256_random33(0x02, 12345, 0, i, std::min(batchSize, end - i), digests[thread].data());
+                }
+            }
+        }, newScheduler);
+    }
+
+    for (int threads : threadCounts) {
+        suite.add("gen ripemd160 counter", ripemd160Label, threads, [&](int thread, uint64_t) {
+            uint64_t begin, end;
+            while (scheduler->next(thread, &begin, &end)) {
+                uint8_t key[32];
+                memcpy(key, initialKey, 32);
+                addLittleEndian(key, 32, begin);
+                for (uint64_t i = begin; i < end; i += batchSize) {
+                    uint64_t count = std::min(batchSize, end - i);
+                    if (ripemd160Midstate) {
+                        ripemd160avx2::ripemd160avx2_counter32_midstate(key, count, digests[thread].data());
+                    } else {
+                        ripemd160_counter32(key, count, digests[thread].data());
+                    }
+                    addLittleEndian(key, 32, count);
+                }
+            }
+        }, newScheduler);
+    }
+
+    // Public key to hash160: SHA-256 of the counter keys, RIPEMD-160 of the digests
+    for (int threads : threadCounts) {
+        suite.add("gen hash160 counter", std::string(sha256_kernel()) + "+" + ripemd160_kernel(), threads, [&](int thread, uint64_t) {
+            uint64_t begin, end;
+            while (scheduler->next(thread, &begin, &end)) {
+                uint8_t key[33];
+                memcpy(key, initialKey, 33);
+                addBigEndian(key, 33, begin);
+                for (uint64_t i = begin; i < end; i += batchSize) {
+                    uint64_t count = std::min(batchSize, end - i);
+                    sha256_counter33(key, count, digests[thread].data());
+                    ripemd160_batch(digests[thread].data(), 32, count, hash160s[thread].data());
+                    addBigEndian(key, 33, count);
+                }
+            }
+        }, newScheduler);
+    }
+
+    if (!sha256_kernel_supported("avx2")) {
+        return;
+    }
+
+    // The hash160 generator's path: padded key blocks through the fused
+    // hash160avx2_8, the SHA-256 digests stay in registers. A short last
+    // batch hashes a few keys past its end into the spare buffer slots.
+    std::vector<std::vector<uint8_t>> blocks(maxThreads, std::vector<uint8_t>(batchSize * 64));
+    for (std::vector<uint8_t>& threadBlocks : blocks) {
+        for (uint64_t j = 0; j < batchSize; ++j) {
+            threadBlocks[j * 64 + 33] = 0x80;
+            threadBlocks[j * 64 + 62] = 0x01;  // 264 bits, big-endian
+            threadBlocks[j * 64 + 63] = 0x08;
+        }
+    }
+    for (int threads : threadCounts) {
+        suite.add("gen hash160 fused", "avx2", threads, [&](int thread, uint64_t) {
+            uint8_t* block = blocks[thread].data();
+            unsigned char* hash = hash160s[thread].data();
+            uint64_t begin, end;
+            while (scheduler->next(thread, &begin, &end)) {
+                uint8_t key[33];
+                memcpy(key, initialKey, 33);
+                addBigEndian(key, 33, begin);
+                for (uint64_t i = begin; i < end; i += batchSize) {
+                    uint64_t count = std::min(batchSize, end - i);
+                    uint64_t lanes = (count + 7) & ~(uint64_t)7;
+                    for (uint64_t j = 0; j < lanes; ++j) {
+                        memcpy(block + j * 64, key, 33);
+                        addBigEndian(key, 33, 1);
+                    }
+                    for (uint64_t j = 0; j < lanes; j += 8) {
+                        hash160avx2_8(block + j * 64, block + (j + 1) * 64, block + (j + 2) * 64, block + (j + 3) * 64,
+                                      block + (j + 4) * 64, block + (j + 5) * 64, block + (j + 6) * 64, block + (j + 7) * 64,
+                                      hash + j * 20, hash + (j + 1) * 20, hash + (j + 2) * 20, hash + (j + 3) * 20,
+                                      hash + (j + 4) * 20, hash + (j + 5) * 20, hash + (j + 6) * 20, hash + (j + 7) * 20);
+                    }
+                }
+            }
+        }, newScheduler);
+    }
+}
+
+static std::string cpuModel() {
+    std::ifstream in("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 10, "model name") == 0 && line.find(':') != std::string::npos) {
+            return line.substr(line.find(':') + 2);
+        }
+    }
+    return "unknown";
+}
+
+static std::string jsonQuote(const std::string& text) {
+    std::string quoted = "\"";
+    char escaped[8];
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if ((unsigned char)c < 0x20) {
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+static bool writeJson(const std::string& path, const Options& options, const std::vector<Result>& results) {
+    std::ofstream out(path);
+    out << "{\n"
+        << "  \"bench\": \"bench_avx2\",\n"
+        << "  \"version\": 1,\n"
+        << "  \"cpu\": " << jsonQuote(cpuModel()) << ",\n"
+        << "  \"sha256_kernel\": " << jsonQuote(sha256_kernel()) << ",\n"
+        << "  \"ripemd160_kernel\": " << jsonQuote(ripemd160_kernel()) << ",\n"
+        << "  \"reps\": " << options.reps << ",\n"
+        << "  \"results\": [\n";
+    char numbers[128];
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        snprintf(numbers, sizeof(numbers), "\"cycles_per_hash\": %.2f, \"mhash_per_second\": %.3f, \"spread_percent\": %.1f",
+                 r.cyclesPerHash, r.mhashPerSecond, r.spread);
+        out << "    { \"name\": " << jsonQuote(r.name) << ", \"kernel\": " << jsonQuote(r.kernel)
+            << ", \"threads\": " << r.threads << ", " << numbers << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+// Parsed JSON value, enough of the format to read baselines back whatever
+// their layout (a tool may have re-indented or minified them)
+struct JsonValue {
+    enum Type { kNull, kBool, kNumber, kString, kArray, kObject } type = kNull;
+    bool boolean = false;
+    double number = 0;
+    std::string text;
+    std::vector<JsonValue> items;                             // Array elements
+    std::vector<std::pair<std::string, JsonValue>> members;  // Object members in file order
+
+    // Member key of an object, nullptr when there is none
+    const JsonValue* member(const char* key) const {
+        for (const auto& m : members) {
+            if (m.first == key) {
+                return &m.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Recursive descent parser over a whole document; fails with the offset of
+// the first error
+class JsonReader {
+public:
+    explicit JsonReader(const std::string& text) : text(text), at(0) {}
+
+    bool parse(JsonValue* value, std::string* error) {
+        if (!parseValue(value, 0) || (skipSpace(), at != text.size())) {
+            *error = "invalid JSON at byte " + std::to_string(at);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    void skipSpace() {
+        while (at < text.size() && (text[at] == ' ' || text[at] == '\t' || text[at] == '\n' || text[at] == '\r')) {
+            ++at;
+        }
+    }
+
+    bool literal(const char* word) {
+        size_t n = strlen(word);
+        if (text.compare(at, n, word) != 0) {
+            return false;
+        }
+        at += n;
+        return true;
+    }
+
+    bool parseValue(JsonValue* value, int depth) {
+        skipSpace();
+        if (at >= text.size() || depth > 64) {
+            return false;
+        }
+        char c = text[at];
+        if (c == '{') {
+            value->type = JsonValue::kObject;
+            ++at;
+            skipSpace();
+            if (at < text.size() && text[at] == '}') {
+                ++at;
+                return true;
+            }
+            for (;;) {
+                std::string key;
+                JsonValue member;
+                skipSpace();
+                if (!parseString(&key) || (skipSpace(), at >= text.size() || text[at] != ':')) {
+                    return false;
+                }
+                ++at;
+                if (!parseValue(&member, depth + 1)) {
+                    return false;
+                }
+                value->members.emplace_back(key, member);
+                skipSpace();
+                if (at < text.size() && text[at] == ',') {
+                    ++at;
+                } else if (at < text.size() && text[at] == '}') {
+                    ++at;
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+        }
+        if (c == '[') {
+            value->type = JsonValue::kArray;
+            ++at;
+            skipSpace();
+            if (at < text.size() && text[at] == ']') {
+                ++at;
+                return true;
+            }
+            for (;;) {
+                value->items.emplace_back();
+                if (!parseValue(&value->items.back(), depth + 1)) {
+                    return false;
+                }
+                skipSpace();
+                if (at < text.size() && text[at] == ',') {
+                    ++at;
+                } else if (at < text.size() && text[at] == ']') {
+                    ++at;
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+        }
+        if (c == '"') {
+            value->type = JsonValue::kString;
+            return parseString(&value->text);
+        }
+        if (literal("true")) {
+            value->type = JsonValue::kBool;
+            value->boolean = true;
+            return true;
+        }
+        if (literal("false")) {
+            value->type = JsonValue::kBool;
+            return true;
+        }
+        if (literal("null")) {
+            value->type = JsonValue::kNull;
+            return true;
+        }
+        return parseNumber(value);
+    }
+
+    bool parseNumber(JsonValue* value) {
+        size_t start = at;
+        if (at < text.size() && text[at] == '-') {
+            ++at;
+        }
+        size_t digits = at;
+        while (at < text.size() && (isdigit((unsigned char)text[at]) || text[at] == '.' || text[at] == 'e' ||
+                                    text[at] == 'E' || text[at] == '+' || text[at] == '-')) {
+            ++at;
+        }
+        if (at == digits || !isdigit((unsigned char)text[digits])) {
+            return false;
+        }
+        std::string number = text.substr(start, at - start);
+        char* end;
+        value->type = JsonValue::kNumber;
+        value->number = strtod(number.c_str(), &end);
+        return *end == '\0';
+    }
+
+    bool parseString(std::string* out) {
+        if (at >= text.size() || text[at] != '"') {
+            return false;
+        }
+        for (++at; at < text.size(); ++at) {
+            char c = text[at];
+            if (c == '"') {
+                ++at;
+                return true;
+            }
+            if ((unsigned char)c < 0x20) {
+                return false;
+            }
+            if (c != '\\') {
+                *out += c;
+                continue;
+            }
+            if (++at >= text.size()) {
+                return false;
+            }
+            switch (text[at]) {
+            case '"': *out += '"'; break;
+            case '\\': *out += '\\'; break;
+            case '/': *out += '/'; break;
+            case 'b': *out += '\b'; break;
+            case 'f': *out += '\f'; break;
+            case 'n': *out += '\n'; break;
+            case 'r': *out += '\r'; break;
+            case 't': *out += '\t'; break;
+            case 'u': {
+                // Basic plane code point as UTF-8 (surrogate pairs are not
+                // combined, names are ASCII)
+                if (at + 4 >= text.size()) {
+                    return false;
+                }
+                unsigned code = 0;
+                for (int i = 1; i <= 4; ++i) {
+                    char h = text[at + i];
+                    if (!isxdigit((unsigned char)h)) {
+                        return false;
+                    }
+                    code = code * 16 + (isdigit((unsigned char)h) ? h - '0' : (tolower(h) - 'a' + 10));
+                }
+                at += 4;
+                if (code < 0x80) {
+                    *out += (char)code;
+                } else if (code < 0x800) {
+                    *out += (char)(0xC0 | (code >> 6));
+                    *out += (char)(0x80 | (code & 0x3F));
+                } else {
+                    *out += (char)(0xE0 | (code >> 12));
+                    *out += (char)(0x80 | ((code >> 6) & 0x3F));
+                    *out += (char)(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    const std::string& text;
+    size_t at;
+};
+
+// Rows of a file written by --json: the "results" array of objects with
+// name, kernel, threads and cycles_per_hash. False with a message when the
+// file cannot be read, is not JSON or a row lacks a field.
+static bool readJson(const std::string& path, std::string* cpu, std::vector<Result>* results, std::string* error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        *error = "Cannot read " + path;
+        return false;
+    }
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    JsonValue root;
+    std::string parseError;
+    if (!JsonReader(text).parse(&root, &parseError)) {
+        *error = path + ": " + parseError;
+        return false;
+    }
+    const JsonValue* rows = root.type == JsonValue::kObject ? root.member("results") : nullptr;
+    if (rows == nullptr || rows->type != JsonValue::kArray) {
+        *error = path + ": no \"results\" array";
+        return false;
+    }
+    const JsonValue* cpuValue = root.member("cpu");
+    *cpu = cpuValue != nullptr && cpuValue->type == JsonValue::kString ? cpuValue->text : "";
+
+    for (size_t i = 0; i < rows->items.size(); ++i) {
+        const JsonValue& row = rows->items[i];
+        const JsonValue* name = row.member("name");
+        const JsonValue* kernel = row.member("kernel");
+        const JsonValue* threads = row.member("threads");
+        const JsonValue* cycles = row.member("cycles_per_hash");
+        if (name == nullptr || name->type != JsonValue::kString || kernel == nullptr || kernel->type != JsonValue::kString ||
+            threads == nullptr || threads->type != JsonValue::kNumber || cycles == nullptr ||
+            cycles->type != JsonValue::kNumber || !(cycles->number > 0)) {
+            *error = path + ": result " + std::to_string(i) + " needs name, kernel, threads and a positive cycles_per_hash";
+            return false;
+        }
+        const JsonValue* mhash = row.member("mhash_per_second");
+        const JsonValue* spread = row.member("spread_percent");
+
+        Result r;
+        r.name = name->text;
+        r.kernel = kernel->text;
+        r.threads = (int)threads->number;
+        r.cyclesPerHash = cycles->number;
+        r.mhashPerSecond = mhash != nullptr && mhash->type == JsonValue::kNumber ? mhash->number : 0;
+        r.spread = spread != nullptr && spread->type == JsonValue::kNumber ? spread->number : 0;
+        results->push_back(r);
+    }
+    if (results->empty()) {
+        *error = path + ": no results";
+        return false;
+    }
+    return true;
+}
+
+// Rows of current more than tolerance percent slower (cycles per hash) than
+// the same row of baseline are regressions. Exit status 1 on a regression, 2
+// when a file cannot be used or a baseline row is missing from current (a
+// gate that compared nothing must not pass).
+static int compare(const std::string& baselinePath, const std::string& currentPath, double tolerance) {
+    std::string baselineCpu, currentCpu, error;
+    std::vector<Result> baseline, current;
+    if (!readJson(baselinePath, &baselineCpu, &baseline, &error) || !readJson(currentPath, &currentCpu, &current, &error)) {
+        std::cerr << "Error: " << error << ".\n";
+        return 2;
+    }
+    if (baselineCpu != currentCpu) {
+        std::cout << "Warning: baseline CPU \"" << baselineCpu << "\", current CPU \"" << currentCpu << "\"\n";
+    }
+
+    std::map<std::string, const Result*> now;
+    for (const Result& r : current) {
+        now[r.name + "/" + r.kernel + "/" + std::to_string(r.threads)] = &r;
+    }
+
+    std::cout << std::left << std::setw(30) << "benchmark" << std::setw(14) << "kernel"
+              << std::right << std::setw(8) << "threads" << std::setw(12) << "base cyc" << std::setw(12) << "cyc/hash"
+              << std::setw(10) << "change" << "\n";
+    int regressions = 0;
+    int missing = 0;
+    for (const Result& base : baseline) {
+        auto found = now.find(base.name + "/" + base.kernel + "/" + std::to_string(base.threads));
+        std::cout << std::left << std::setw(30) << base.name << std::setw(14) << base.kernel
+                  << std::right << std::setw(8) << base.threads << std::fixed << std::setprecision(1)
+                  << std::setw(12) << base.cyclesPerHash;
+        if (found == now.end()) {
+            std::cout << std::setw(12) << "-" << std::setw(10) << "-" << "  missing\n";
+            ++missing;
+            continue;
+        }
+        double change = (found->second->cyclesPerHash / base.cyclesPerHash - 1) * 100;
+        std::cout << std::setw(12) << found->second->cyclesPerHash << std::setw(9) << std::showpos << change
+                  << std::noshowpos << "%";
+        if (change > tolerance) {
+            std::cout << "  REGRESSION";
+            ++regressions;
+        } else if (change < -tolerance) {
+            std::cout << "  faster";
+        }
+        std::cout << "\n";
+    }
+
+    std::cout << "\n" << regressions << " regression(s) over " << tolerance << "%";
+    if (missing > 0) {
+        std::cout << ", " << missing << " baseline row(s) missing from the current run";
+    }
+    std::cout << "\n";
+    if (missing > 0) {
+        return 2;
+    }
+    return regressions > 0 ? 1 : 0;
+}
+
+static void displayHelp() {
+    std::cout << "Usage: bench_avx2 [run] [options]\n"
+              << "       bench_avx2 compare <baseline.json> <current.json> [--tolerance <percent>]\n"
+              << "Options:\n"
+              << "  --threads <n>     Largest thread count of the generation rows (default: all)\n"
+              << "  --reps <n>        Timed repetitions per row, the best is kept (default: 7)\n"
+              << "  --warmup <ms>     Warmup per row, also sizes the repetitions (default: 200)\n"
+              << "  --time <ms>       Length of a repetition (default: 100)\n"
+              << "  --quick           3 repetitions of 30 ms after 50 ms of warmup\n"
+              << "  --filter <text>   Only rows whose name contains text\n"
+              << "  --json <file>     Also write the results as JSON (a baseline for compare)\n"
+              << "  --tolerance <n>   Slowdown in percent compare accepts (default: 5); compare\n"
+              << "                    exits with 1 on a regression, 2 when a file is unusable,\n"
+              << "                    empty or lacks a baseline row\n";
+}
+
+// Positive integer option value, 0 when it is not one
+static int intValue(const char* text) {
+    char* end;
+    long value = strtol(text, &end, 10);
+    return *end == '\0' && value > 0 && value < (1 << 30) ? (int)value : 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && std::string(argv[1]) == "compare") {
+        char* end = nullptr;
+        double tolerance = argc == 6 ? strtod(argv[5], &end) : 5.0;
+        if ((argc != 4 && !(argc == 6 && std::string(argv[4]) == "--tolerance")) ||
+            (end != nullptr && (*end != '\0' || end == argv[5] || tolerance < 0))) {
+            displayHelp();
+            return 2;
+        }
+        return compare(argv[2], argv[3], tolerance);
+    }
+
+    Suite suite;
+    Options& options = suite.options;
+    for (int i = (argc >= 2 && std::string(argv[1]) == "run") ? 2 : 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--threads" && hasValue && intValue(argv[i + 1])) {
+            options.threads = intValue(argv[++i]);
+        } else if (arg == "--reps" && hasValue && intValue(argv[i + 1])) {
+            options.reps = intValue(argv[++i]);
+        } else if (arg == "--warmup" && hasValue && intValue(argv[i + 1])) {
+            options.warmupMs = intValue(argv[++i]);
+        } else if (arg == "--time" && hasValue && intValue(argv[i + 1])) {
+            options.timeMs = intValue(argv[++i]);
+        } else if (arg == "--quick") {
+            options.reps = 3;
+            options.warmupMs = 50;
+            options.timeMs = 30;
+        } else if (arg == "--filter" && hasValue) {
+            options.filter = argv[++i];
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else if (arg == "-h" || arg == "--help") {
+            displayHelp();
+            return 0;
+        } else {
+            std::cerr << "Error: Invalid option or value: " << arg << "\n";
+            displayHelp();
+            return 1;
+        }
+    }
+
+    // 33-byte keys padded to one SHA-256 block
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 33; ++j) {
+            inputs[i][j] = static_cast<uint8_t>(i * 33 + j);
+        }
+        inputs[i][33] = 0x80;
+        uint64_t bitLength = __builtin_bswap64(33 * 8);
+        memcpy(inputs[i] + 56, &bitLength, 8);
+    }
+    for (size_t i = 0; i < sizeof(batchInputs); ++i) {
+        batchInputs[i] = static_cast<uint8_t>(i * 7);
+    }
+
+    std::cout << "CPU: " << cpuModel() << ", " << options.reps << " repetitions of " << options.timeMs
+              << " ms after " << options.warmupMs << " ms of warmup\n";
+    std::cout << std::left << std::setw(30) << "benchmark" << std::setw(14) << "kernel"
+              << std::right << std::setw(8) << "threads" << std::setw(12) << "cyc/hash"
+              << std::setw(12) << "Mhash/s" << std::setw(10) << "spread" << std::setw(10) << "scaling" << "\n";
+
+    if (sha256_kernel_supported("avx2")) {
+        benchAvx2(suite);
+    }
+    benchKernels(suite);
+    benchGeneration(suite);
+
+    if (!options.jsonPath.empty() && !writeJson(options.jsonPath, options, suite.results)) {
+        std::cerr << "Error: Cannot write " << options.jsonPath << ".\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// Runtime checks for the instruction sets the hash kernels are built for.
+// Each check also requires the OS to save the matching register state.
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+
+static inline bool CpuidBit(int leaf, int reg, int bit) {
+    int info[4];
+    __cpuidex(info, leaf, 0);
+    return (info[reg] >> bit) & 1;
+}
+
+static inline bool CpuHasSse41() {
+    return CpuidBit(1, 2, 19);
+}
+
+static inline bool CpuHasAvx2() {
+    // OSXSAVE and AVX, then XMM and YMM state enabled in XCR0
+    if (!CpuidBit(1, 2, 27) || !CpuidBit(1, 2, 28) || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    return CpuidBit(7, 1, 5);
+}
+
+static inline bool CpuHasAvx512f() {
+    // Opmask and ZMM state enabled in XCR0 as well
+    if (!CpuHasAvx2() || (_xgetbv(0) & 0xE6) != 0xE6) {
+        return false;
+    }
+    return CpuidBit(7, 1, 16);
+}
+#else
+static inline bool CpuHasSse41() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.1");
+}
+
+static inline bool CpuHasAvx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static inline bool CpuHasAvx512f() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+#endif // CPU_FEATURES_H
@@ -0,0 +1,76 @@
+#ifndef DIGEST_MASK_H
+#define DIGEST_MASK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Bit mask and value over a digest for the masked (prefix) search of the
+// generators: a digest d matches when (d & mask) == value.
+struct DigestMask {
+    size_t len;          // Digest length in bytes (20 or 32)
+    uint8_t mask[32];
+    uint8_t value[32];   // Already masked
+};
+
+static inline int HexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parse a hex prefix and an optional hex mask, both covering the digest from
+// its first byte (missing trailing digits are zero). Without a mask every
+// digit of the prefix is compared, so "abc" matches digests starting with
+// hex "abc". Returns false when a string is not hex, longer than the digest,
+// or the prefix has bits outside the mask.
+static inline bool ParseDigestMask(DigestMask* m, size_t len, const std::string& prefixHex, const std::string& maskHex) {
+    if (prefixHex.size() > len * 2 || maskHex.size() > len * 2) {
+        return false;
+    }
+
+    m->len = len;
+    for (size_t i = 0; i < 32; ++i) {
+        m->mask[i] = 0;
+        m->value[i] = 0;
+    }
+
+    for (size_t i = 0; i < prefixHex.size(); ++i) {
+        int v = HexNibble(prefixHex[i]);
+        if (v < 0) {
+            return false;
+        }
+        int shift = (i & 1) ? 0 : 4;
+        m->value[i / 2] |= (uint8_t)(v << shift);
+        if (maskHex.empty()) {
+            m->mask[i / 2] |= (uint8_t)(0xF << shift);
+        }
+    }
+
+    for (size_t i = 0; i < maskHex.size(); ++i) {
+        int v = HexNibble(maskHex[i]);
+        if (v < 0) {
+            return false;
+        }
+        m->mask[i / 2] |= (uint8_t)(v << ((i & 1) ? 0 : 4));
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        if (m->value[i] & ~m->mask[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline bool DigestMatches(const DigestMask* m, const uint8_t* digest) {
+    for (size_t i = 0; i < m->len; ++i) {
+        if ((digest[i] & m->mask[i]) != m->value[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif // DIGEST_MASK_H
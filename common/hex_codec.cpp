@@ -0,0 +1,138 @@
+#include "hex_codec.h"
+#include "cpu_features.h"
+#include <immintrin.h>
+
+static const char kDigits[] = "0123456789abcdef";
+
+// Value of each character, 0xFF when it is not a hex digit
+struct HexTable {
+    uint8_t value[256];
+
+    HexTable() {
+        for (int c = 0; c < 256; ++c) {
+            value[c] = 0xFF;
+        }
+        for (int v = 0; v < 16; ++v) {
+            value[(uint8_t)kDigits[v]] = (uint8_t)v;
+            value[(uint8_t)(kDigits[v] & ~0x20)] = (uint8_t)v;  // Upper case letters
+        }
+    }
+};
+
+static const HexTable kTable;
+
+static bool useAvx2 = CpuHasAvx2();
+
+static void HexEncodeScalar(const uint8_t* bytes, size_t n, char* hex) {
+    for (size_t i = 0; i < n; ++i) {
+        hex[2 * i] = kDigits[bytes[i] >> 4];
+        hex[2 * i + 1] = kDigits[bytes[i] & 0xF];
+    }
+}
+
+static bool HexDecodeScalar(const char* hex, size_t n, uint8_t* bytes) {
+    uint8_t invalid = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t hi = kTable.value[(uint8_t)hex[2 * i]];
+        uint8_t lo = kTable.value[(uint8_t)hex[2 * i + 1]];
+        invalid |= (hi | lo) & 0xF0;
+        bytes[i] = (uint8_t)((hi << 4) | (lo & 0xF));
+    }
+    return invalid == 0;
+}
+
+// Only these functions are built for AVX2, they run after the CPU check
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#endif
+
+// 16 bytes to 32 digits per step: the nibbles are interleaved high first and
+// looked up in the digit table
+static void HexEncodeAvx2(const uint8_t* bytes, size_t n, char* hex) {
+    const __m256i digits = _mm256_setr_epi8(
+        '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+        '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m128i low4 = _mm_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i in = _mm_loadu_si128((const __m128i*)(bytes + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(in, 4), low4);
+        __m128i lo = _mm_and_si128(in, low4);
+        __m256i nibbles = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(hi, lo)),
+                                                  _mm_unpackhi_epi8(hi, lo), 1);
+        _mm256_storeu_si256((__m256i*)(hex + 2 * i), _mm256_shuffle_epi8(digits, nibbles));
+    }
+    HexEncodeScalar(bytes + i, n - i, hex + 2 * i);
+}
+
+// 32 digits to 16 bytes per step. Class bits by high nibble (1: 0x3_, 2:
+// 0x4_ or 0x6_) and by low nibble (1: 0-9, 2: 1-6) must share a bit; the
+// value is the low nibble plus 9 for letters. maddubs joins the digit pairs
+// (high * 16 + low), packus and a qword permute gather the 16 bytes.
+static bool HexDecodeAvx2(const char* hex, size_t n, uint8_t* bytes) {
+    const __m256i classHigh = _mm256_setr_epi8(
+        0, 0, 0, 1, 2, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 1, 2, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i classLow = _mm256_setr_epi8(
+        1, 3, 3, 3, 3, 3, 3, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+        1, 3, 3, 3, 3, 3, 3, 1, 1, 1, 0, 0, 0, 0, 0, 0);
+    const __m256i offset = _mm256_setr_epi8(
+        0, 0, 0, 0, 9, 0, 9, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 9, 0, 9, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i low4 = _mm256_set1_epi8(0x0F);
+    const __m256i weights = _mm256_set1_epi16(0x0110);  // 16 for the first digit, 1 for the second
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)(hex + 2 * i));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(c, 4), low4);
+        __m256i lo = _mm256_and_si256(c, low4);
+
+        __m256i cls = _mm256_and_si256(_mm256_shuffle_epi8(classHigh, hi), _mm256_shuffle_epi8(classLow, lo));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(cls, _mm256_setzero_si256())) != 0) {
+            return false;
+        }
+
+        __m256i nibbles = _mm256_add_epi8(lo, _mm256_shuffle_epi8(offset, hi));
+        __m256i pairs = _mm256_maddubs_epi16(nibbles, weights);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(pairs, pairs), 0x08);
+        _mm_storeu_si128((__m128i*)(bytes + i), _mm256_castsi256_si128(packed));
+    }
+    return HexDecodeScalar(hex + 2 * i, n - i, bytes + i);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#elif defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+void HexEncode(const uint8_t* bytes, size_t n, char* hex) {
+    if (useAvx2) {
+        HexEncodeAvx2(bytes, n, hex);
+    } else {
+        HexEncodeScalar(bytes, n, hex);
+    }
+}
+
+std::string HexString(const uint8_t* bytes, size_t n) {
+    std::string hex(2 * n, '0');
+    HexEncode(bytes, n, &hex[0]);
+    return hex;
+}
+
+bool HexDecode(const char* hex, size_t n, uint8_t* bytes) {
+    return useAvx2 ? HexDecodeAvx2(hex, n, bytes) : HexDecodeScalar(hex, n, bytes);
+}
+
+bool HexDecode(const std::string& hex, size_t n, uint8_t* bytes) {
+    return hex.size() == 2 * n && HexDecode(hex.data(), n, bytes);
+}
+
+void HexSelectScalar(bool scalar) {
+    useAvx2 = !scalar && CpuHasAvx2();
+}
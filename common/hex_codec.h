@@ -0,0 +1,31 @@
+#ifndef HEX_CODEC_H
+#define HEX_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Hex text for keys and digests where they cross the text boundary (-i,
+// --targets, hit and match output, --stream --hex, the tests). With AVX2
+// both directions are table lookups with _mm256_shuffle_epi8: encoding looks
+// up each nibble in "0123456789abcdef", decoding classifies every character
+// by its high and low nibble (digit, letter or invalid) and adds a per-class
+// offset to the low nibble, 16 bytes per step. Other CPUs and the tails use
+// the scalar tables.
+
+// Write 2 * n lowercase hex digits (no terminator)
+void HexEncode(const uint8_t* bytes, size_t n, char* hex);
+
+std::string HexString(const uint8_t* bytes, size_t n);
+
+// Decode 2 * n hex digits of either case into n bytes. Returns false when a
+// character is not a hex digit (bytes is then undefined).
+bool HexDecode(const char* hex, size_t n, uint8_t* bytes);
+
+// Decode a whole string of exactly 2 * n digits
+bool HexDecode(const std::string& hex, size_t n, uint8_t* bytes);
+
+// Use the scalar code even when AVX2 is available (for testing)
+void HexSelectScalar(bool scalar);
+
+#endif // HEX_CODEC_H
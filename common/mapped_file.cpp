@@ -0,0 +1,102 @@
+#include "mapped_file.h"
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : base(nullptr), length(0), fd(-1) {
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifndef _WIN32
+static bool Fail(const std::string& path, const char* what, std::string* error) {
+    *error = "Cannot " + std::string(what) + " " + path + ": " + strerror(errno);
+    return false;
+}
+
+bool MappedFile::openRead(const std::string& path, std::string* error) {
+    close();
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return Fail(path, "open", error);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return Fail(path, "stat", error);
+    }
+    length = (uint64_t)st.st_size;
+    if (length == 0) {
+        return true;
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    void* p = mmap(nullptr, length, PROT_READ, flags, fd, 0);
+    if (p == MAP_FAILED) {
+        length = 0;
+        return Fail(path, "map", error);
+    }
+    base = (uint8_t*)p;
+    madvise(p, length, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool MappedFile::create(const std::string& path, uint64_t size, std::string* error) {
+    close();
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return Fail(path, "create", error);
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        return Fail(path, "resize", error);
+    }
+    length = size;
+    if (length == 0) {
+        return true;
+    }
+
+    void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        length = 0;
+        return Fail(path, "map", error);
+    }
+    base = (uint8_t*)p;
+    madvise(p, length, MADV_SEQUENTIAL);
+    return true;
+}
+
+void MappedFile::close() {
+    if (base != nullptr) {
+        munmap(base, length);
+        base = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    length = 0;
+}
+#else
+bool MappedFile::openRead(const std::string& path, std::string* error) {
+    *error = "Cannot map " + path + ": file mode needs a POSIX system";
+    return false;
+}
+
+bool MappedFile::create(const std::string& path, uint64_t, std::string* error) {
+    *error = "Cannot map " + path + ": file mode needs a POSIX system";
+    return false;
+}
+
+void MappedFile::close() {
+}
+#endif
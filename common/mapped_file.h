@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A whole file mapped into memory for the --file mode of the generators: the
+// kernels read records straight from the input mapping and write digests
+// straight into the output mapping, no read or write calls and no copies.
+// POSIX only; elsewhere open and create fail with a message.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Map path read-only for one sequential pass (pages are read ahead and
+    // prefaulted). An empty file maps to no data.
+    bool openRead(const std::string& path, std::string* error);
+
+    // Create or truncate path to size bytes and map it writable
+    bool create(const std::string& path, uint64_t size, std::string* error);
+
+    // Unmap and close; written pages reach the file through the page cache
+    void close();
+
+    const uint8_t* data() const { return base; }
+    uint8_t* data() { return base; }
+    uint64_t size() const { return length; }
+
+private:
+    uint8_t* base;
+    uint64_t length;
+    int fd;
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,195 @@
+#include "perf_counters.h"
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} kEventConfig[PerfCounters::kEvents] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+};
+#endif
+
+PerfCounters::PerfCounters() {
+    for (int e = 0; e < kEvents; ++e) {
+        fds[e] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (int e = 0; e < kEvents; ++e) {
+        if (fds[e] >= 0) {
+            close(fds[e]);
+        }
+    }
+#endif
+}
+
+bool PerfCounters::open(std::string* error) {
+#ifdef __linux__
+    for (int e = 0; e < kEvents; ++e) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = kEventConfig[e].type;
+        attr.config = kEventConfig[e].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // This thread on any CPU
+        fds[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[e] < 0 && e == kCycles) {
+            int cause = errno;
+            *error = std::string("perf_event_open: ") + strerror(cause);
+            if (cause == EACCES || cause == EPERM) {
+                *error += " (see /proc/sys/kernel/perf_event_paranoid)";
+            } else if (cause == ENOENT || cause == EOPNOTSUPP) {
+                *error += " (no hardware counters, e.g. in a virtual machine)";
+            }
+            return false;
+        }
+    }
+    return true;
+#else
+    *error = "hardware counters need Linux perf events";
+    return false;
+#endif
+}
+
+void PerfCounters::start() {
+#ifdef __linux__
+    for (int e = 0; e < kEvents; ++e) {
+        if (fds[e] >= 0) {
+            ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void PerfCounters::stop() {
+#ifdef __linux__
+    for (int e = 0; e < kEvents; ++e) {
+        if (fds[e] >= 0) {
+            ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#endif
+}
+
+bool PerfCounters::read(Event event, uint64_t* value) const {
+#ifdef __linux__
+    // Count, time enabled, time running (less than enabled when multiplexed)
+    uint64_t data[3];
+    if (fds[event] < 0 || ::read(fds[event], data, sizeof(data)) != (ssize_t)sizeof(data) || data[2] == 0) {
+        return false;
+    }
+    *value = data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+    return true;
+#else
+    (void)event;
+    (void)value;
+    return false;
+#endif
+}
+
+void PerfSample::take(const PerfCounters& counters, uint64_t hashed) {
+    for (int e = 0; e < PerfCounters::kEvents; ++e) {
+        valid[e] = counters.read((PerfCounters::Event)e, &count[e]);
+    }
+    hashes = hashed;
+}
+
+void PrintProfile(std::ostream& out, const std::vector<PerfSample>& samples, uint64_t batchSize) {
+    // Sums over the threads that counted; an event counts only when every
+    // one of them has it
+    uint64_t total[PerfCounters::kEvents] = {};
+    bool valid[PerfCounters::kEvents];
+    uint64_t hashes = 0;
+    int counted = 0;
+    std::string error;
+    for (int e = 0; e < PerfCounters::kEvents; ++e) {
+        valid[e] = true;
+    }
+    for (const PerfSample& sample : samples) {
+        if (!sample.valid[PerfCounters::kCycles]) {
+            if (error.empty()) {
+                error = sample.error;
+            }
+            continue;
+        }
+        ++counted;
+        hashes += sample.hashes;
+        for (int e = 0; e < PerfCounters::kEvents; ++e) {
+            total[e] += sample.count[e];
+            valid[e] = valid[e] && sample.valid[e];
+        }
+    }
+
+    if (counted == 0) {
+        out << "Profile                            : unavailable" << (error.empty() ? "" : ", " + error) << "\n";
+        return;
+    }
+
+    double batches = (double)hashes / batchSize;
+    double cycles = (double)total[PerfCounters::kCycles];
+    out << std::fixed << std::setprecision(2);
+    out << "Profile (hashing loop)             : " << counted << " of " << samples.size() << " threads counted\n";
+    out << "Cycles per hash                    : " << (hashes > 0 ? cycles / hashes : 0) << "\n";
+    if (valid[PerfCounters::kInstructions]) {
+        out << "Instructions per cycle             : " << total[PerfCounters::kInstructions] / cycles << "\n";
+    }
+    if (valid[PerfCounters::kTaskClock] && total[PerfCounters::kTaskClock] > 0) {
+        out << "Clock                        (GHz) : " << cycles / total[PerfCounters::kTaskClock];
+        if (valid[PerfCounters::kRefCycles] && total[PerfCounters::kRefCycles] > 0) {
+            out << " (" << std::setprecision(0) << 100 * cycles / total[PerfCounters::kRefCycles] << "% of nominal)"
+                << std::setprecision(2);
+        }
+        out << "\n";
+    }
+    if (batches > 0) {
+        if (valid[PerfCounters::kL1dMisses]) {
+            out << "L1D misses per batch               : " << total[PerfCounters::kL1dMisses] / batches << "\n";
+        }
+        if (valid[PerfCounters::kLlcMisses]) {
+            out << "LLC misses per batch               : " << total[PerfCounters::kLlcMisses] / batches << "\n";
+        }
+        if (valid[PerfCounters::kBranchMisses]) {
+            out << "Branch misses per batch            : " << total[PerfCounters::kBranchMisses] / batches << "\n";
+        }
+    }
+
+    // A slow or throttled thread stands out here
+    for (size_t t = 0; t < samples.size(); ++t) {
+        const PerfSample& sample = samples[t];
+        if (!sample.valid[PerfCounters::kCycles] || sample.hashes == 0) {
+            continue;
+        }
+        double threadCycles = (double)sample.count[PerfCounters::kCycles];
+        std::string label = "Thread " + std::to_string(t);
+        out << label << std::string(label.size() < 35 ? 35 - label.size() : 1, ' ') << ": "
+            << threadCycles / sample.hashes << " cycles per hash";
+        if (sample.valid[PerfCounters::kInstructions]) {
+            out << ", IPC " << sample.count[PerfCounters::kInstructions] / threadCycles;
+        }
+        if (sample.valid[PerfCounters::kTaskClock] && sample.count[PerfCounters::kTaskClock] > 0) {
+            out << ", " << threadCycles / sample.count[PerfCounters::kTaskClock] << " GHz";
+        }
+        out << "\n";
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Hardware counters of the calling thread (--profile), opened with
+// perf_event_open for user-space events only and enabled around the hot loop,
+// so no external tool has to be attached. Every event has its own descriptor:
+// an event the CPU or hypervisor does not offer only leaves its line out of
+// the report, and events the kernel multiplexes are scaled by the time they
+// actually counted. Other platforms than Linux have no counters.
+class PerfCounters {
+public:
+    enum Event {
+        kCycles,        // Core cycles
+        kRefCycles,     // Cycles at the nominal clock (frequency throttling)
+        kInstructions,
+        kL1dMisses,     // L1 data cache read misses
+        kLlcMisses,     // Last level cache misses
+        kBranchMisses,
+        kTaskClock,     // Nanoseconds on the CPU
+        kEvents
+    };
+
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Open the events for the calling thread, not counting yet. False with a
+    // message when there is not even a cycle counter.
+    bool open(std::string* error);
+
+    // Count from here (the counts add up over start/stop pairs)
+    void start();
+    void stop();
+
+    // Count of event, false when it is not available
+    bool read(Event event, uint64_t* value) const;
+
+private:
+    int fds[kEvents];
+};
+
+// Counts of one thread's hot loop and the hashes it did in it
+struct PerfSample {
+    uint64_t count[PerfCounters::kEvents] = {};
+    bool valid[PerfCounters::kEvents] = {};
+    uint64_t hashes = 0;
+    std::string error;  // Why the counters could not be opened
+
+    void take(const PerfCounters& counters, uint64_t hashed);
+};
+
+// --profile report over the threads' samples: cycles per hash, instructions
+// per cycle, clock and its share of nominal, misses per batch of batchSize
+// keys, then one line per thread
+void PrintProfile(std::ostream& out, const std::vector<PerfSample>& samples, uint64_t batchSize);
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,175 @@
+#include "result_writer.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+
+static int OsOpen(const char* path) {
+    return _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+}
+
+static long long OsWrite(int fd, const uint8_t* data, size_t size) {
+    return _write(fd, data, (unsigned)std::min<size_t>(size, 1u << 30));
+}
+
+static void OsClose(int fd) {
+    _close(fd);
+}
+#else
+#include <unistd.h>
+
+static int OsOpen(const char* path) {
+    return ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+static long long OsWrite(int fd, const uint8_t* data, size_t size) {
+    return ::write(fd, data, std::min<size_t>(size, 1u << 30));
+}
+
+static void OsClose(int fd) {
+    ::close(fd);
+}
+#endif
+
+ResultWriter::ResultWriter(int threads, size_t keyLen, size_t digestLen, size_t blockBytes, int blocksPerThread)
+    : threads(threads), keyLen(keyLen), digestLen(digestLen), recordLen(8 + keyLen + digestLen),
+      blocksPerThread(blocksPerThread), rings(new Ring[threads]), fd(-1), closing(false), failed(false), written(0) {
+    this->blockBytes = (blockBytes > recordLen ? blockBytes / recordLen : 1) * recordLen;
+}
+
+ResultWriter::~ResultWriter() {
+    if (writer.joinable()) {
+        std::string error;
+        close(&error);
+    }
+}
+
+bool ResultWriter::open(const std::string& path, const ResultHeader& header, std::string* error) {
+    fd = OsOpen(path.c_str());
+    if (fd < 0 || !writeAll((const uint8_t*)&header, sizeof(header))) {
+        *error = "Cannot write " + path + ": " + strerror(errno);
+        return false;
+    }
+    writer = std::thread(&ResultWriter::drain, this);
+    return true;
+}
+
+uint8_t* ResultWriter::append(int thread) {
+    Ring& ring = rings[thread];
+    if (ring.blocks == nullptr) {
+        // First record: the blocks are allocated (and touched) by the thread
+        // that fills them
+        ring.arena.reset(new ThreadArena(blockBytes * blocksPerThread));
+        ring.blocks = ring.arena->allocArray<uint8_t>(blockBytes * blocksPerThread);
+        ring.used.reset(new size_t[blocksPerThread]);
+    }
+    if (ring.fill + recordLen > blockBytes) {
+        push(ring);
+    }
+
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint8_t* slot = ring.blocks + (tail % blocksPerThread) * blockBytes + ring.fill;
+    ring.fill += recordLen;
+    return slot;
+}
+
+void ResultWriter::append(int thread, uint64_t index, const uint8_t* key, const uint8_t* digest) {
+    uint8_t* slot = append(thread);
+    for (int i = 0; i < 8; ++i) {
+        slot[i] = (uint8_t)(index >> (8 * i));
+    }
+    memcpy(slot + 8, key, keyLen);
+    memcpy(slot + 8 + keyLen, digest, digestLen);
+}
+
+// Publish the block being filled and wait until the next one is written out
+// (only when the writer is a whole ring behind)
+void ResultWriter::push(Ring& ring) {
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    ring.used[tail % blocksPerThread] = ring.fill;
+    ring.tail.store(tail + 1, std::memory_order_release);
+    ring.fill = 0;
+    wake.notify_one();
+
+    while (tail + 1 - ring.head.load(std::memory_order_acquire) >= (uint64_t)blocksPerThread) {
+        std::this_thread::yield();
+    }
+}
+
+void ResultWriter::flush(int thread) {
+    Ring& ring = rings[thread];
+    if (ring.fill > 0) {
+        push(ring);
+    }
+}
+
+void ResultWriter::drain() {
+    for (;;) {
+        // Once closing is seen every block has been pushed, one more pass
+        // writes them all
+        bool last = closing.load(std::memory_order_acquire);
+        bool any = false;
+
+        for (int t = 0; t < threads; ++t) {
+            Ring& ring = rings[t];
+            uint64_t head = ring.head.load(std::memory_order_relaxed);
+            uint64_t tail = ring.tail.load(std::memory_order_acquire);
+            for (; head < tail; ++head) {
+                size_t used = ring.used[head % blocksPerThread];
+                if (!failed && !writeAll(ring.blocks + (head % blocksPerThread) * blockBytes, used)) {
+                    failed = true;
+                    failure = std::string("Cannot write the results: ") + strerror(errno);
+                }
+                if (!failed) {
+                    written += used / recordLen;
+                }
+                ring.head.store(head + 1, std::memory_order_release);
+                any = true;
+            }
+        }
+
+        if (last) {
+            return;
+        }
+        if (!any) {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait_for(guard, std::chrono::milliseconds(1));
+        }
+    }
+}
+
+bool ResultWriter::writeAll(const uint8_t* data, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        long long put = OsWrite(fd, data + done, size - done);
+        if (put < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += (size_t)put;
+    }
+    return true;
+}
+
+bool ResultWriter::close(std::string* error) {
+    closing.store(true, std::memory_order_release);
+    wake.notify_one();
+    if (writer.joinable()) {
+        writer.join();
+    }
+    if (fd >= 0) {
+        OsClose(fd);
+        fd = -1;
+    }
+    if (failed) {
+        *error = failure;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,101 @@
+#ifndef RESULT_WRITER_H
+#define RESULT_WRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "thread_arena.h"
+
+// Binary result file of the generators (--save, --save-hits): a 128-byte
+// header, then fixed-width records of an 8-byte little-endian key index, the
+// key and the digest. Records are in the order the threads hand them in, the
+// index gives their place in the run.
+struct ResultHeader {
+    char magic[8];        // "HASHRES1"
+    uint8_t algorithm;    // kSha256 or kRipemd160
+    uint8_t keyLen;
+    uint8_t digestLen;
+    uint8_t flags;        // kHitsOnly, kRandomKeys
+    uint32_t threads;     // Thread layout of the run: threads taking chunks
+    uint32_t chunkAlign;  // of the key range aligned to chunkAlign keys
+    uint32_t reserved0;
+    uint64_t count;       // Keys in the run
+    uint64_t seed;        // Seed of random keys
+    uint8_t startKey[64]; // First key of a counter run, byte 0 the prefix of random keys
+    uint8_t reserved[24];
+
+    enum { kSha256 = 1, kRipemd160 = 2 };
+    enum { kHitsOnly = 1, kRandomKeys = 2 };
+};
+
+static_assert(sizeof(ResultHeader) == 128, "ResultHeader must stay 128 bytes");
+
+// Writer of a result file. Each thread appends records to blocks of its own
+// single-producer ring (no locks, the thread's blocks come from its own
+// huge-page arena); a writer thread drains full blocks with one large write
+// each. A thread only waits when its whole ring is still queued for writing.
+class ResultWriter {
+public:
+    // Records of 8 + keyLen + digestLen bytes, blocks of about blockBytes
+    ResultWriter(int threads, size_t keyLen, size_t digestLen, size_t blockBytes = 1 << 20, int blocksPerThread = 8);
+    ~ResultWriter();
+
+    ResultWriter(const ResultWriter&) = delete;
+    ResultWriter& operator=(const ResultWriter&) = delete;
+
+    // Create path, write the header and start the writer thread
+    bool open(const std::string& path, const ResultHeader& header, std::string* error);
+
+    // Room for the next record of thread, to be filled before the next call
+    uint8_t* append(int thread);
+
+    // Record with the index written, key and digest copied in
+    void append(int thread, uint64_t index, const uint8_t* key, const uint8_t* digest);
+
+    // Hand the partly filled block of thread to the writer (end of its work)
+    void flush(int thread);
+
+    // Write what is left and close the file; false with a message when a
+    // write failed. Every thread must have flushed.
+    bool close(std::string* error);
+
+    uint64_t records() const { return written; }
+
+private:
+    struct alignas(64) Ring {
+        std::unique_ptr<ThreadArena> arena;  // Created by the owning thread
+        uint8_t* blocks = nullptr;
+        std::unique_ptr<size_t[]> used;      // Bytes in each block
+        size_t fill = 0;                     // Bytes in the block being filled
+        std::atomic<uint64_t> head{0};       // Next block to write (writer)
+        std::atomic<uint64_t> tail{0};       // Next block to fill (owner)
+    };
+
+    void push(Ring& ring);
+    void drain();
+    bool writeAll(const uint8_t* data, size_t size);
+
+    int threads;
+    size_t keyLen;
+    size_t digestLen;
+    size_t recordLen;
+    size_t blockBytes;  // Whole records per block
+    int blocksPerThread;
+    std::unique_ptr<Ring[]> rings;
+
+    int fd;
+    std::thread writer;
+    std::mutex lock;  // Only for waking the writer
+    std::condition_variable wake;
+    std::atomic<bool> closing;
+    bool failed;
+    std::string failure;
+    uint64_t written;
+};
+
+#endif // RESULT_WRITER_H
@@ -0,0 +1,207 @@
+#include "stream_pipeline.h"
+#include "thread_arena.h"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#define read _read
+#define write _write
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+enum SlabState { kFree, kFilled, kHashed };
+
+struct Slab {
+    uint8_t* in;
+    uint8_t* out;
+    size_t count;  // Records in the slab
+    SlabState state;
+};
+
+// Read until size bytes are in or the input ends; bytes read, -1 on error
+long long ReadFull(int fd, uint8_t* buf, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        long long got = read(fd, buf + done, (unsigned)std::min<size_t>(size - done, 1u << 30));
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (got == 0) {
+            break;
+        }
+        done += (size_t)got;
+    }
+    return (long long)done;
+}
+
+bool WriteFull(int fd, const uint8_t* buf, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        long long put = write(fd, buf + done, (unsigned)std::min<size_t>(size - done, 1u << 30));
+        if (put < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += (size_t)put;
+    }
+    return true;
+}
+
+}  // namespace
+
+StreamPipeline::StreamPipeline(size_t recordLen, size_t digestLen, size_t slabRecords)
+    : recordLen(recordLen), digestLen(digestLen), slabRecords(slabRecords) {
+}
+
+bool StreamPipeline::run(int inFd, int outFd, int workers, const ThreadAffinity& affinity, const HashFunc& hash,
+                         uint64_t* records, std::string* error) {
+    const size_t slabCount = 2 * (size_t)workers + 2;
+    const size_t inBytes = slabRecords * recordLen;
+    const size_t outBytes = slabRecords * digestLen;
+
+    ThreadArena arena(slabCount * (inBytes + outBytes + 128));
+    std::vector<Slab> slabs(slabCount);
+    for (Slab& slab : slabs) {
+        slab.in = arena.allocArray<uint8_t>(inBytes);
+        slab.out = arena.allocArray<uint8_t>(outBytes);
+        slab.count = 0;
+        slab.state = kFree;
+    }
+
+    // Slab seq lives in slabs[seq % slabCount]: the reader fills them and the
+    // writer frees them in sequence order, so a free slab is always the next
+    // one to read
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<uint64_t> ready;  // Filled slabs waiting for a worker
+    uint64_t slabsRead = 0;
+    bool inputDone = false;
+    bool failed = false;
+    std::string failure;
+
+    auto fail = [&](const std::string& message) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!failed) {
+            failed = true;
+            failure = message;
+        }
+        changed.notify_all();
+    };
+
+    std::thread reader([&]() {
+        for (uint64_t seq = 0;; ++seq) {
+            Slab& slab = slabs[seq % slabCount];
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&]() { return slab.state == kFree || failed; });
+                if (failed) {
+                    return;
+                }
+            }
+
+            long long got = ReadFull(inFd, slab.in, inBytes);
+            if (got < 0) {
+                fail(std::string("Cannot read the input: ") + strerror(errno));
+                return;
+            }
+            if (got % (long long)recordLen != 0) {
+                fail("The input ends inside a " + std::to_string(recordLen) + "-byte record");
+                return;
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (got > 0) {
+                slab.count = (size_t)got / recordLen;
+                slab.state = kFilled;
+                ready.push_back(seq);
+                slabsRead = seq + 1;
+            }
+            if ((size_t)got < inBytes) {
+                inputDone = true;
+            }
+            changed.notify_all();
+            if (inputDone) {
+                return;
+            }
+        }
+    });
+
+    std::vector<std::thread> hashers;
+    for (int w = 0; w < workers; ++w) {
+        hashers.emplace_back([&, w]() {
+            affinity.pin(w);
+            for (;;) {
+                uint64_t seq;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&]() { return !ready.empty() || inputDone || failed; });
+                    if (failed || ready.empty()) {
+                        return;
+                    }
+                    seq = ready.front();
+                    ready.pop_front();
+                }
+
+                Slab& slab = slabs[seq % slabCount];
+                if (!hash(slab.in, slab.count, slab.out)) {
+                    fail("Record " + std::to_string(seq * slabRecords) + " to " +
+                         std::to_string(seq * slabRecords + slab.count - 1) + " of the input has an invalid record");
+                    return;
+                }
+
+                std::lock_guard<std::mutex> guard(lock);
+                slab.state = kHashed;
+                changed.notify_all();
+            }
+        });
+    }
+
+    // Writer: slabs in input order
+    *records = 0;
+    for (uint64_t seq = 0;; ++seq) {
+        Slab& slab = slabs[seq % slabCount];
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return slab.state == kHashed || (inputDone && seq >= slabsRead) || failed; });
+            if (failed || slab.state != kHashed) {
+                break;
+            }
+        }
+
+        if (!WriteFull(outFd, slab.out, slab.count * digestLen)) {
+            fail(std::string("Cannot write the output: ") + strerror(errno));
+            break;
+        }
+        *records += slab.count;
+
+        std::lock_guard<std::mutex> guard(lock);
+        slab.state = kFree;
+        changed.notify_all();
+    }
+
+    reader.join();
+    for (std::thread& hasher : hashers) {
+        hasher.join();
+    }
+
+    if (failed) {
+        *error = failure;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef STREAM_PIPELINE_H
+#define STREAM_PIPELINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "thread_affinity.h"
+
+// Hashing of a record stream (--stream: stdin to stdout) in three overlapping
+// stages. A reader thread fills slabs of a ring with blocking reads, worker
+// threads hash whole slabs, and the writer (the calling thread) writes the
+// digests of the slabs in input order and hands them back to the reader. With
+// two slabs per worker plus one being read and one being written, neither the
+// I/O nor the kernels wait on each other while the other side keeps up. The
+// slabs are carved from one huge-page arena.
+class StreamPipeline {
+public:
+    // Hash n records at in (recordLen bytes apart) and write n digests of
+    // digestLen bytes contiguously to out; false when a record is not valid
+    typedef std::function<bool(const uint8_t* in, size_t n, uint8_t* out)> HashFunc;
+
+    StreamPipeline(size_t recordLen, size_t digestLen, size_t slabRecords = 65536);
+
+    // Hash every record of inFd to outFd with workers threads (pinned by
+    // affinity) until the input ends. Returns false with a message on a read
+    // or write error, an invalid record or when the input ends inside a record.
+    bool run(int inFd, int outFd, int workers, const ThreadAffinity& affinity, const HashFunc& hash,
+             uint64_t* records, std::string* error);
+
+private:
+    size_t recordLen;
+    size_t digestLen;
+    size_t slabRecords;
+};
+
+#endif // STREAM_PIPELINE_H
@@ -0,0 +1,178 @@
+#include "target_set.h"
+#include "cpu_features.h"
+#include "hex_codec.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <immintrin.h>
+
+// Salts of the split block Bloom filter, one per word of a block
+static const uint32_t kSalt[8] = {
+    0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d,
+    0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31
+};
+
+static inline uint32_t LoadWord(const uint8_t* p) {
+    uint32_t w;
+    memcpy(&w, p, 4);
+    return w;
+}
+
+static unsigned MayContain8Scalar(const uint32_t* filter, uint32_t blockMask,
+                                  const uint8_t* digests, size_t stride, size_t n) {
+    unsigned mask = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* digest = digests + i * stride;
+        const uint32_t* block = filter + (size_t)(LoadWord(digest) & blockMask) * 8;
+        uint32_t h = LoadWord(digest + 4);
+
+        bool hit = true;
+        for (int j = 0; j < 8; ++j) {
+            uint32_t bit = 1u << ((h * kSalt[j]) >> 27);
+            hit = hit && (block[j] & bit) != 0;
+        }
+        if (hit) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+// Only this function is built for AVX2, it runs after the CPU check in build()
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#endif
+
+// One digest at a time: the block is a single 256-bit load, the 8 bits of the
+// digest are built in one vector (one bit per word) and tested with vptest
+static unsigned MayContain8Avx2(const uint32_t* filter, uint32_t blockMask,
+                                const uint8_t* digests, size_t stride, size_t n) {
+    const __m256i salt = _mm256_loadu_si256((const __m256i*)kSalt);
+    const __m256i one = _mm256_set1_epi32(1);
+    unsigned mask = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* digest = digests + i * stride;
+        __m256i block = _mm256_loadu_si256((const __m256i*)(filter + (size_t)(LoadWord(digest) & blockMask) * 8));
+        __m256i h = _mm256_set1_epi32((int)LoadWord(digest + 4));
+        __m256i bits = _mm256_sllv_epi32(one, _mm256_srli_epi32(_mm256_mullo_epi32(h, salt), 27));
+
+        // testc: every bit of the digest is set in the block
+        mask |= (unsigned)_mm256_testc_si256(block, bits) << i;
+    }
+    return mask;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#elif defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+TargetSet::TargetSet(size_t digestLen, size_t bitsPerKey)
+    : digestLen(digestLen), bitsPerKey(bitsPerKey), filterData(nullptr), filterWords(0), exact(this),
+      blockMask(0), useAvx2(false) {
+}
+
+TargetSet::TargetSet(const TargetSet& shared, void* filterMemory)
+    : digestLen(shared.digestLen), bitsPerKey(shared.bitsPerKey), filterData((const uint32_t*)filterMemory),
+      filterWords(shared.filterWords), exact(shared.exact), blockMask(shared.blockMask), useAvx2(shared.useAvx2) {
+    memcpy(filterMemory, shared.filterData, filterBytes());
+}
+
+void TargetSet::add(const uint8_t* digest) {
+    std::array<uint8_t, 32> target = {};
+    memcpy(target.data(), digest, digestLen);
+    targets.push_back(target);
+}
+
+bool TargetSet::loadHexFile(const char* path, size_t* badLine) {
+    std::ifstream in(path);
+    if (!in) {
+        *badLine = 0;
+        return false;
+    }
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(in, line)) {
+        ++lineNumber;
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        uint8_t digest[32];
+        if (!HexDecode(line, digestLen, digest)) {
+            *badLine = lineNumber;
+            return false;
+        }
+        add(digest);
+    }
+    return true;
+}
+
+void TargetSet::build() {
+    size_t len = digestLen;
+    std::sort(targets.begin(), targets.end(), [len](const std::array<uint8_t, 32>& a, const std::array<uint8_t, 32>& b) {
+        return memcmp(a.data(), b.data(), len) < 0;
+    });
+
+    // Power-of-two number of 256-bit blocks
+    size_t blocks = 1;
+    while (blocks * 256 < targets.size() * bitsPerKey) {
+        blocks *= 2;
+    }
+    blockMask = (uint32_t)(blocks - 1);
+    filter.assign(blocks * 8, 0);
+    filterData = filter.data();
+    filterWords = filter.size();
+
+    for (const auto& target : targets) {
+        uint32_t* block = filter.data() + (size_t)(LoadWord(target.data()) & blockMask) * 8;
+        uint32_t h = LoadWord(target.data() + 4);
+        for (int j = 0; j < 8; ++j) {
+            block[j] |= 1u << ((h * kSalt[j]) >> 27);
+        }
+    }
+
+    useAvx2 = CpuHasAvx2();
+}
+
+bool TargetSet::contains(const uint8_t* digest) const {
+    size_t len = digestLen;
+    std::array<uint8_t, 32> key = {};
+    memcpy(key.data(), digest, len);
+    const auto& sorted = exact->targets;
+    return std::binary_search(sorted.begin(), sorted.end(), key, [len](const std::array<uint8_t, 32>& a, const std::array<uint8_t, 32>& b) {
+        return memcmp(a.data(), b.data(), len) < 0;
+    });
+}
+
+unsigned TargetSet::mayContain8(const uint8_t* digests, size_t stride, size_t n) const {
+    if (useAvx2) {
+        return MayContain8Avx2(filterData, blockMask, digests, stride, n);
+    }
+    return MayContain8Scalar(filterData, blockMask, digests, stride, n);
+}
+
+size_t TargetSet::probe(const uint8_t* digests, size_t stride, size_t n, uint32_t* hits) const {
+    size_t count = 0;
+    for (size_t base = 0; base < n; base += 8) {
+        size_t lanes = std::min<size_t>(8, n - base);
+        unsigned mask = mayContain8(digests + base * stride, stride, lanes);
+
+        // Rare: exact check of the candidates
+        for (size_t i = 0; mask != 0; ++i, mask >>= 1) {
+            if ((mask & 1) && contains(digests + (base + i) * stride)) {
+                hits[count++] = (uint32_t)(base + i);
+            }
+        }
+    }
+    return count;
+}
@@ -0,0 +1,75 @@
+#ifndef TARGET_SET_H
+#define TARGET_SET_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Set of target digests (hash160s, SHA-256 hashes, ...) for the generator
+// loops. A blocked Bloom filter sized to stay cache-resident rejects almost
+// every generated digest with one 32-byte block probe, the few candidates are
+// checked exactly against a sorted copy of the targets.
+//
+// Digests are uniformly distributed, so their first two little-endian words
+// are used directly: word 0 picks the filter block, word 1 the bit of each of
+// the block's 8 words (split block Bloom filter).
+class TargetSet {
+public:
+    // digestLen is 20 or 32, bitsPerKey sets the filter size (rounded up to
+    // a power of two of 256-bit blocks)
+    explicit TargetSet(size_t digestLen, size_t bitsPerKey = 16);
+
+    // Copy of a built set whose filter lives in filterMemory (filterBytes()
+    // of shared, e.g. from a thread's node-local arena). Exact checks use the
+    // targets of shared, which must outlive the copy.
+    TargetSet(const TargetSet& shared, void* filterMemory);
+
+    TargetSet(const TargetSet&) = delete;
+    TargetSet& operator=(const TargetSet&) = delete;
+
+    // Add one target, call build() once all are added
+    void add(const uint8_t* digest);
+
+    // Read one hex digest per line (blank lines are skipped). Returns false
+    // with the 1-based line number when the file cannot be read or a line is
+    // not a digest of digestLen bytes.
+    bool loadHexFile(const char* path, size_t* badLine);
+
+    // Sort the targets and fill the filter
+    void build();
+
+    size_t size() const { return exact->targets.size(); }
+
+    // Size of the filter, for placing a copy
+    size_t filterBytes() const { return filterWords * 4; }
+
+    // Exact membership
+    bool contains(const uint8_t* digest) const;
+
+    // Filter probe of n <= 8 digests stored stride bytes apart: bit i is set
+    // when digest i may be a target. With AVX2 each digest's 32-byte block is
+    // one vector load, its 8 bits are built in a register and checked with
+    // one vptest.
+    unsigned mayContain8(const uint8_t* digests, size_t stride, size_t n) const;
+
+    // Probe n digests stored stride bytes apart and write the indices of the
+    // exact matches to hits (room for n). Returns the number of matches.
+    size_t probe(const uint8_t* digests, size_t stride, size_t n, uint32_t* hits) const;
+
+    // Use the scalar filter probe even when AVX2 is available (for testing)
+    void selectScalarProbe() { useAvx2 = false; }
+
+private:
+    size_t digestLen;
+    size_t bitsPerKey;
+    std::vector<std::array<uint8_t, 32>> targets;  // Sorted by build()
+    std::vector<uint32_t> filter;                  // 8 words per block
+    const uint32_t* filterData;                    // filter or a copy of it
+    size_t filterWords;
+    const TargetSet* exact;                        // Holds the sorted targets
+    uint32_t blockMask;
+    bool useAvx2;
+};
+
+#endif // TARGET_SET_H
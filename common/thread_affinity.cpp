@@ -0,0 +1,173 @@
+#include "thread_affinity.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// CPU list in the sysfs format ("0-3,8,10-11"); false on anything else
+static bool ParseCpuList(const std::string& text, std::vector<int>* cpus) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t comma = text.find(',', pos);
+        std::string item = text.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = comma == std::string::npos ? text.size() : comma + 1;
+
+        size_t dash = item.find('-');
+        std::string first = item.substr(0, dash);
+        std::string last = dash == std::string::npos ? first : item.substr(dash + 1);
+        if (first.empty() || last.empty() || first.size() > 6 || last.size() > 6 ||
+            first.find_first_not_of("0123456789") != std::string::npos ||
+            last.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        int a = std::stoi(first);
+        int b = std::stoi(last);
+        if (b < a) {
+            return false;
+        }
+        for (int cpu = a; cpu <= b; ++cpu) {
+            cpus->push_back(cpu);
+        }
+    }
+    return !cpus->empty();
+}
+
+static bool ReadCpuList(const std::string& path, std::vector<int>* cpus) {
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line)) {
+        return false;
+    }
+    while (!line.empty() && (line.back() == '\n' || line.back() == ' ')) {
+        line.pop_back();
+    }
+    return ParseCpuList(line, cpus);
+}
+
+ThreadAffinity::ThreadAffinity() : nodeCount(1) {
+    // CPUs the process may run on
+    std::vector<int> allowed;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                allowed.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (allowed.empty()) {
+        for (int cpu = 0; cpu < (int)std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+            allowed.push_back(cpu);
+        }
+    }
+
+    cpuNode.assign(allowed.back() + 1, -1);
+    for (int cpu : allowed) {
+        cpuNode[cpu] = 0;
+    }
+
+    // Nodes from sysfs, a machine without them is one node
+    std::vector<int> nodeIds;
+    if (ReadCpuList("/sys/devices/system/node/online", &nodeIds)) {
+        for (int node : nodeIds) {
+            std::vector<int> cpus;
+            if (!ReadCpuList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", &cpus)) {
+                continue;
+            }
+            for (int cpu : cpus) {
+                if (cpu < (int)cpuNode.size() && cpuNode[cpu] >= 0) {
+                    cpuNode[cpu] = node;
+                }
+            }
+        }
+    }
+
+    std::vector<int> used;
+    for (int node : cpuNode) {
+        if (node >= 0 && std::find(used.begin(), used.end(), node) == used.end()) {
+            used.push_back(node);
+        }
+    }
+    nodeCount = std::max<int>(1, (int)used.size());
+}
+
+bool ThreadAffinity::parse(const std::string& spec, std::string* error) {
+    // Allowed CPUs by node, in node and CPU order
+    std::map<int, std::vector<int>> byNode;
+    for (int cpu = 0; cpu < (int)cpuNode.size(); ++cpu) {
+        if (cpuNode[cpu] >= 0) {
+            byNode[cpuNode[cpu]].push_back(cpu);
+        }
+    }
+
+    order.clear();
+    if (spec == "compact") {
+        for (const auto& node : byNode) {
+            order.insert(order.end(), node.second.begin(), node.second.end());
+        }
+    } else if (spec == "scatter") {
+        size_t widest = 0;
+        for (const auto& node : byNode) {
+            widest = std::max(widest, node.second.size());
+        }
+        for (size_t k = 0; k < widest; ++k) {
+            for (const auto& node : byNode) {
+                if (k < node.second.size()) {
+                    order.push_back(node.second[k]);
+                }
+            }
+        }
+    } else {
+        std::vector<int> cpus;
+        if (!ParseCpuList(spec, &cpus)) {
+            *error = "--affinity must be compact, scatter or a CPU list such as 0-7,16-23";
+            return false;
+        }
+        for (int cpu : cpus) {
+            if (cpu >= (int)cpuNode.size() || cpuNode[cpu] < 0) {
+                *error = "CPU " + std::to_string(cpu) + " is not available to this process";
+                return false;
+            }
+        }
+        order = cpus;
+    }
+
+    mode = spec;
+    return true;
+}
+
+int ThreadAffinity::cpuOf(int thread) const {
+    return order.empty() ? -1 : order[thread % order.size()];
+}
+
+int ThreadAffinity::nodeOf(int cpu) const {
+    return cpu >= 0 && cpu < (int)cpuNode.size() && cpuNode[cpu] >= 0 ? cpuNode[cpu] : 0;
+}
+
+bool ThreadAffinity::pin(int thread) const {
+    int cpu = cpuOf(thread);
+    if (cpu < 0) {
+        return false;
+    }
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+std::string ThreadAffinity::describe() const {
+    std::string text = enabled() ? mode : "none";
+    return text + " (" + std::to_string(nodeCount) + (nodeCount == 1 ? " node)" : " nodes)");
+}
@@ -0,0 +1,47 @@
+#ifndef THREAD_AFFINITY_H
+#define THREAD_AFFINITY_H
+
+#include <string>
+#include <vector>
+
+// Placement of the generator threads on CPUs (--affinity). The NUMA nodes and
+// their CPUs are read from sysfs and limited to the CPUs the process may run
+// on. Thread t runs on CPU order[t % order.size()]:
+//   compact  fills the CPUs of one node before the next
+//   scatter  takes one CPU of each node in turn
+//   a list   such as "0-7,16-23" gives the CPUs in thread order
+// Pinning is done from inside each thread, before it allocates its buffers,
+// so first-touch places them on the thread's node.
+class ThreadAffinity {
+public:
+    ThreadAffinity();
+
+    // Returns false with a message when the spec is unknown or names a CPU
+    // the process cannot run on
+    bool parse(const std::string& spec, std::string* error);
+
+    bool enabled() const { return !order.empty(); }
+
+    // CPU of thread, -1 when not pinned
+    int cpuOf(int thread) const;
+
+    // NUMA node of cpu, 0 when unknown
+    int nodeOf(int cpu) const;
+
+    int nodes() const { return nodeCount; }
+
+    // Pin the calling thread to the CPU of thread. False when not enabled or
+    // the OS refuses.
+    bool pin(int thread) const;
+
+    // Mode and topology for the run header, e.g. "scatter (2 nodes)"
+    std::string describe() const;
+
+private:
+    std::string mode;
+    std::vector<int> order;    // CPUs in thread order
+    std::vector<int> cpuNode;  // Node of each CPU, -1 when not allowed
+    int nodeCount;
+};
+
+#endif // THREAD_AFFINITY_H
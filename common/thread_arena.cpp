@@ -0,0 +1,69 @@
+#include "thread_arena.h"
+#include <cstring>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#elif defined(_MSC_VER)
+#include <malloc.h>
+#else
+#include <cstdlib>
+#endif
+
+ThreadArena::ThreadArena(size_t bytes) : base(nullptr), used(0), kind(kSmall) {
+    capacity = (bytes + kHugePage - 1) / kHugePage * kHugePage;
+    if (capacity == 0) {
+        capacity = kHugePage;
+    }
+
+#if defined(__linux__)
+    void* p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        kind = kReserved;
+    } else {
+        // No reserved pages: a 2 MB aligned mapping the kernel can back with
+        // transparent huge pages (over-map by a page and trim)
+        uint8_t* raw = (uint8_t*)mmap(nullptr, capacity + kHugePage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == (uint8_t*)MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        uint8_t* aligned = (uint8_t*)(((uintptr_t)raw + kHugePage - 1) & ~(uintptr_t)(kHugePage - 1));
+        if (aligned > raw) {
+            munmap(raw, aligned - raw);
+        }
+        munmap(aligned + capacity, raw + kHugePage - aligned);
+        p = aligned;
+        kind = madvise(p, capacity, MADV_HUGEPAGE) == 0 ? kTransparent : kSmall;
+    }
+    base = (uint8_t*)p;
+#elif defined(_MSC_VER)
+    base = (uint8_t*)_aligned_malloc(capacity, kHugePage);
+#else
+    base = (uint8_t*)aligned_alloc(kHugePage, capacity);
+#endif
+    if (base == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    // First touch from the owning thread places the pages on its node
+    memset(base, 0, capacity);
+}
+
+ThreadArena::~ThreadArena() {
+#if defined(__linux__)
+    munmap(base, capacity);
+#elif defined(_MSC_VER)
+    _aligned_free(base);
+#else
+    free(base);
+#endif
+}
+
+void* ThreadArena::alloc(size_t bytes, size_t align) {
+    size_t offset = (used + align - 1) & ~(align - 1);
+    if (offset > capacity || bytes > capacity - offset) {
+        return nullptr;
+    }
+    used = offset + bytes;
+    return base + offset;
+}
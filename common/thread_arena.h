@@ -0,0 +1,45 @@
+#ifndef THREAD_ARENA_H
+#define THREAD_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Memory of one generator thread: key, digest and filter buffers carved from
+// a single mapping in whole 2 MB huge pages, so a batch touches one TLB entry.
+// Reserved huge pages (MAP_HUGETLB) are used when the system has them, else
+// transparent huge pages are requested with madvise. The constructor touches
+// every page, so an arena created by a pinned thread is backed by memory of
+// that thread's NUMA node.
+class ThreadArena {
+public:
+    enum Pages { kReserved, kTransparent, kSmall };
+
+    static const size_t kHugePage = 2 << 20;
+
+    // Room for bytes, rounded up to whole huge pages
+    explicit ThreadArena(size_t bytes);
+    ~ThreadArena();
+
+    ThreadArena(const ThreadArena&) = delete;
+    ThreadArena& operator=(const ThreadArena&) = delete;
+
+    // Zeroed, align-aligned bytes (align a power of two up to 4096), nullptr
+    // when the arena is full
+    void* alloc(size_t bytes, size_t align = 64);
+
+    template <class T>
+    T* allocArray(size_t count) {
+        return static_cast<T*>(alloc(count * sizeof(T), alignof(T) < 64 ? 64 : alignof(T)));
+    }
+
+    Pages pages() const { return kind; }
+    size_t size() const { return capacity; }
+
+private:
+    uint8_t* base;
+    size_t capacity;
+    size_t used;
+    Pages kind;
+};
+
+#endif // THREAD_ARENA_H
@@ -0,0 +1,47 @@
+#ifndef VEC_COUNTER_H
+#define VEC_COUNTER_H
+
+#include <cstdint>
+#include "vec_traits.h"
+
+// Lane-parallel key counter for the generators. Lane i holds base + i as N
+// little-endian 32-bit digits (c[0] least significant), kept in registers so
+// the kernels build message words from it without touching memory. Like the
+// rounds headers, include it after the target pragma of the translation unit.
+template <class V, int N>
+struct VecCounter {
+    typedef typename V::vec vec;
+
+    vec c[N];
+
+    // Lane i starts at digits + i
+    VEC_INLINE void Init(const uint32_t* digits) {
+        static const uint32_t laneIndex[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+        for (int j = 0; j < N; ++j) {
+            c[j] = V::Set1(digits[j]);
+        }
+        Add(V::LoadU(laneIndex));
+    }
+
+    // Add k[i] to lane i. A carry leaves the low digit when the sum wraps
+    // (sum < k unsigned) and moves up while the next digit wraps to zero; the
+    // carry lanes are all ones, so subtracting them adds one.
+    VEC_INLINE void Add(vec k) {
+        vec sum = V::Add(c[0], k);
+        vec carry = V::AndNot(V::CmpEq(sum, k), V::CmpEq(V::MinU(sum, k), sum));
+        c[0] = sum;
+
+        for (int j = 1; j < N && V::Any(carry); ++j) {
+            c[j] = V::Sub(c[j], carry);
+            carry = V::And(carry, V::CmpEq(c[j], V::Zero()));
+        }
+    }
+
+    // Move every lane on by the vector width
+    VEC_INLINE void Next() {
+        Add(V::Set1(V::lanes));
+    }
+};
+
+#endif // VEC_COUNTER_H
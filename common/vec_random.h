@@ -0,0 +1,133 @@
+#ifndef VEC_RANDOM_H
+#define VEC_RANDOM_H
+
+#include <cstddef>
+#include <cstdint>
+#include "vec_traits.h"
+
+// Random keys for the -r mode of the generators, drawn by xoshiro128** so the
+// kernels produce whole 32-bit message words per step without a 64-bit
+// multiply. Keys are numbered per (seed, stream) and come in blocks of
+// kRandomBlock: key r of a block is drawn by lane r % kRandomLanes of the
+// block's generators at step r / kRandomLanes, every step taking
+// kRandomWords outputs. Each lane is seeded from (seed, stream, block, lane),
+// so the keys do not depend on the kernel width and any key can be
+// regenerated from (seed, stream, counter) by RandomKeyWords.
+static const int kRandomLanes = 16;
+static const uint64_t kRandomBlock = 256;
+static const int kRandomWords = 8;
+
+// SplitMix64 finalizer, a bijection of x
+static inline uint64_t RandomMix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// xoshiro128** state of one lane of a block
+static inline void RandomSeedLane(uint64_t seed, uint64_t stream, uint64_t block, int lane, uint32_t s[4]) {
+    const uint64_t gamma = 0x9E3779B97F4A7C15ull;
+    uint64_t x = RandomMix64(seed + gamma);
+    x = RandomMix64(x + stream + gamma);
+    x = RandomMix64(x + block + gamma);
+    x = RandomMix64(x + (uint64_t)lane + gamma);
+
+    uint64_t a = RandomMix64(x + gamma);
+    uint64_t b = RandomMix64(x + 2 * gamma);
+    if ((a | b) == 0) {
+        a = 1;  // The all-zero state is a fixed point
+    }
+    s[0] = (uint32_t)a;
+    s[1] = (uint32_t)(a >> 32);
+    s[2] = (uint32_t)b;
+    s[3] = (uint32_t)(b >> 32);
+}
+
+static inline uint32_t RandomNext(uint32_t s[4]) {
+    uint32_t x = s[1] * 5;
+    uint32_t result = ((x << 7) | (x >> 25)) * 9;
+    uint32_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 11) | (s[3] >> 21);
+    return result;
+}
+
+// The kRandomWords outputs of key number counter of a stream
+static inline void RandomKeyWords(uint64_t seed, uint64_t stream, uint64_t counter, uint32_t* words) {
+    uint64_t r = counter % kRandomBlock;
+    uint32_t s[4];
+    RandomSeedLane(seed, stream, counter / kRandomBlock, (int)(r % kRandomLanes), s);
+
+    for (uint64_t step = 0; step < r / kRandomLanes * kRandomWords; ++step) {
+        RandomNext(s);
+    }
+    for (int k = 0; k < kRandomWords; ++k) {
+        words[k] = RandomNext(s);
+    }
+}
+
+// The kRandomWords outputs of keys 0 .. n - 1 of a block, in key order
+static inline void RandomBlockWords(uint64_t seed, uint64_t stream, uint64_t block, size_t n,
+                                    uint32_t (*words)[kRandomWords]) {
+    uint32_t s[kRandomLanes][4];
+    for (int lane = 0; lane < kRandomLanes; ++lane) {
+        RandomSeedLane(seed, stream, block, lane, s[lane]);
+    }
+    for (size_t r = 0; r < n; ++r) {
+        for (int k = 0; k < kRandomWords; ++k) {
+            words[r][k] = RandomNext(s[r % kRandomLanes]);
+        }
+    }
+}
+
+// The generators of one block, V::lanes per vector: set j holds lanes
+// j * V::lanes .. (j + 1) * V::lanes - 1. Like the rounds headers, include it
+// after the target pragma of the translation unit.
+template <class V>
+struct VecRandom {
+    typedef typename V::vec vec;
+    static const int sets = kRandomLanes / V::lanes;
+
+    vec s[sets][4];
+
+    VEC_INLINE void Seed(uint64_t seed, uint64_t stream, uint64_t block) {
+        uint32_t words[4][kRandomLanes];
+        for (int lane = 0; lane < kRandomLanes; ++lane) {
+            uint32_t state[4];
+            RandomSeedLane(seed, stream, block, lane, state);
+            for (int k = 0; k < 4; ++k) {
+                words[k][lane] = state[k];
+            }
+        }
+        for (int j = 0; j < sets; ++j) {
+            for (int k = 0; k < 4; ++k) {
+                s[j][k] = V::LoadU(words[k] + j * V::lanes);
+            }
+        }
+    }
+
+    // RandomNext on every lane of set j; the multiplies by 5 and 9 are
+    // shift and add
+    VEC_INLINE vec Next(int j) {
+        vec* t = s[j];
+        vec x = V::Add(V::template Shl<2>(t[1]), t[1]);
+        x = V::template Rotl<7>(x);
+        vec result = V::Add(V::template Shl<3>(x), x);
+        vec shifted = V::template Shl<9>(t[1]);
+
+        t[2] = V::Xor(t[2], t[0]);
+        t[3] = V::Xor(t[3], t[1]);
+        t[1] = V::Xor(t[1], t[2]);
+        t[0] = V::Xor(t[0], t[3]);
+        t[2] = V::Xor(t[2], shifted);
+        t[3] = V::template Rotl<11>(t[3]);
+        return result;
+    }
+};
+
+#endif // VEC_RANDOM_H
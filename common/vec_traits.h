@@ -0,0 +1,423 @@
+#ifndef VEC_TRAITS_H
+#define VEC_TRAITS_H
+
+#include <immintrin.h>
+#include <cstring>
+#include <cstdint>
+
+// Vector traits for the width-generic hash kernels. Each type packs one 32-bit
+// word of `lanes` independent messages into `vec` and provides the handful of
+// operations the round functions need, plus transposed load/store of message
+// and state words (lane i <-> message i).
+//
+// The SIMD types are compiled for their own instruction set with target
+// pragmas, so a single binary can contain all of them. Kernels that use a type
+// must live in a translation unit compiled for the same target (see the
+// *_sse41.cpp, *_avx2.cpp and *_avx512.cpp files) and must only be called after
+// the dispatcher has checked the CPU. Keep standard library templates out of
+// those translation units: the linker may otherwise keep an AVX2 copy of an
+// inline function that is also used by the portable code.
+
+#ifdef _MSC_VER
+#define VEC_INLINE __forceinline
+#else
+#define VEC_INLINE inline __attribute__((always_inline))
+#endif
+
+// One message per "vector", used for the leftovers and for CPUs without SSE4.1
+struct VecScalar {
+    typedef uint32_t vec;
+    static const int lanes = 1;
+
+    static VEC_INLINE vec Set1(uint32_t x) { return x; }
+    static VEC_INLINE vec Zero() { return 0; }
+    static VEC_INLINE vec LoadU(const uint32_t* p) { return p[0]; }
+
+    static VEC_INLINE vec Add(vec x, vec y) { return x + y; }
+    static VEC_INLINE vec Xor(vec x, vec y) { return x ^ y; }
+    static VEC_INLINE vec And(vec x, vec y) { return x & y; }
+    static VEC_INLINE vec Or(vec x, vec y) { return x | y; }
+    static VEC_INLINE vec AndNot(vec x, vec y) { return ~x & y; }
+    static VEC_INLINE vec Not(vec x) { return ~x; }
+
+    // Lane masks (all ones when true) and unsigned minimum, for the counters
+    static VEC_INLINE vec Sub(vec x, vec y) { return x - y; }
+    static VEC_INLINE vec CmpEq(vec x, vec y) { return x == y ? ~0u : 0u; }
+    static VEC_INLINE vec MinU(vec x, vec y) { return x < y ? x : y; }
+    static VEC_INLINE bool Any(vec x) { return x != 0; }
+
+    template <int n> static VEC_INLINE vec Shl(vec x) { return x << n; }
+    template <int n> static VEC_INLINE vec Shr(vec x) { return x >> n; }
+    template <int n> static VEC_INLINE vec Rotr(vec x) { return (x >> n) | (x << (32 - n)); }
+    template <int n> static VEC_INLINE vec Rotl(vec x) { return (x << n) | (x >> (32 - n)); }
+
+    static VEC_INLINE vec Bswap(vec x) {
+#ifdef _MSC_VER
+        return _byteswap_ulong(x);
+#else
+        return __builtin_bswap32(x);
+#endif
+    }
+
+    // w[0..7] = little-endian words at data[0] + offset
+    static VEC_INLINE void LoadWords(vec* w, const uint8_t* const* data, int offset) {
+        memcpy(w, data[0] + offset, 32);
+    }
+
+    // Write words w[0..count-1] (little-endian) to out[0]
+    static VEC_INLINE void StoreWords(const vec* w, int count, unsigned char* const* out) {
+        memcpy(out[0], w, count * 4);
+    }
+};
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse4.1"))), apply_to = function)
+#endif
+
+// 4 messages per vector (SSE4.1)
+struct VecSse41 {
+    typedef __m128i vec;
+    static const int lanes = 4;
+
+    static VEC_INLINE vec Set1(uint32_t x) { return _mm_set1_epi32((int)x); }
+    static VEC_INLINE vec Zero() { return _mm_setzero_si128(); }
+    static VEC_INLINE vec LoadU(const uint32_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+
+    static VEC_INLINE vec Add(vec x, vec y) { return _mm_add_epi32(x, y); }
+    static VEC_INLINE vec Xor(vec x, vec y) { return _mm_xor_si128(x, y); }
+    static VEC_INLINE vec And(vec x, vec y) { return _mm_and_si128(x, y); }
+    static VEC_INLINE vec Or(vec x, vec y) { return _mm_or_si128(x, y); }
+    static VEC_INLINE vec AndNot(vec x, vec y) { return _mm_andnot_si128(x, y); }
+    static VEC_INLINE vec Not(vec x) { return _mm_xor_si128(x, _mm_set1_epi32(-1)); }
+
+    static VEC_INLINE vec Sub(vec x, vec y) { return _mm_sub_epi32(x, y); }
+    static VEC_INLINE vec CmpEq(vec x, vec y) { return _mm_cmpeq_epi32(x, y); }
+    static VEC_INLINE vec MinU(vec x, vec y) { return _mm_min_epu32(x, y); }
+    static VEC_INLINE bool Any(vec x) { return !_mm_testz_si128(x, x); }
+
+    template <int n> static VEC_INLINE vec Shl(vec x) { return _mm_slli_epi32(x, n); }
+    template <int n> static VEC_INLINE vec Shr(vec x) { return _mm_srli_epi32(x, n); }
+    template <int n> static VEC_INLINE vec Rotr(vec x) { return _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n)); }
+    template <int n> static VEC_INLINE vec Rotl(vec x) { return _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n)); }
+
+    static VEC_INLINE vec Bswap(vec x) {
+        const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        return _mm_shuffle_epi8(x, mask);
+    }
+
+    // Transpose a 4x4 matrix of 32-bit words: r[j] = word j of rows 0..3
+    static VEC_INLINE void Transpose4x4(vec* r) {
+        __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);
+        __m128i t1 = _mm_unpackhi_epi32(r[0], r[1]);
+        __m128i t2 = _mm_unpacklo_epi32(r[2], r[3]);
+        __m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);
+        r[0] = _mm_unpacklo_epi64(t0, t2);
+        r[1] = _mm_unpackhi_epi64(t0, t2);
+        r[2] = _mm_unpacklo_epi64(t1, t3);
+        r[3] = _mm_unpackhi_epi64(t1, t3);
+    }
+
+    static VEC_INLINE void LoadWords(vec* w, const uint8_t* const* data, int offset) {
+        for (int h = 0; h < 2; ++h) {
+            for (int i = 0; i < 4; ++i) {
+                w[h * 4 + i] = _mm_loadu_si128((const __m128i*)(data[i] + offset + h * 16));
+            }
+            Transpose4x4(w + h * 4);
+        }
+    }
+
+    static VEC_INLINE void StoreWords(const vec* w, int count, unsigned char* const* out) {
+        int j = 0;
+        for (; j + 4 <= count; j += 4) {
+            vec r[4] = { w[j], w[j + 1], w[j + 2], w[j + 3] };
+            Transpose4x4(r);
+            for (int i = 0; i < 4; ++i) {
+                _mm_storeu_si128((__m128i*)(out[i] + j * 4), r[i]);
+            }
+        }
+        for (; j < count; ++j) {
+            uint32_t words[4];
+            _mm_storeu_si128((__m128i*)words, w[j]);
+            for (int i = 0; i < 4; ++i) {
+                memcpy(out[i] + j * 4, &words[i], 4);
+            }
+        }
+    }
+};
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#elif defined(__clang__)
+#pragma clang attribute pop
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#endif
+
+// 8 messages per vector (AVX2)
+struct VecAvx2 {
+    typedef __m256i vec;
+    static const int lanes = 8;
+
+    static VEC_INLINE vec Set1(uint32_t x) { return _mm256_set1_epi32((int)x); }
+    static VEC_INLINE vec Zero() { return _mm256_setzero_si256(); }
+    static VEC_INLINE vec LoadU(const uint32_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+
+    static VEC_INLINE vec Add(vec x, vec y) { return _mm256_add_epi32(x, y); }
+    static VEC_INLINE vec Xor(vec x, vec y) { return _mm256_xor_si256(x, y); }
+    static VEC_INLINE vec And(vec x, vec y) { return _mm256_and_si256(x, y); }
+    static VEC_INLINE vec Or(vec x, vec y) { return _mm256_or_si256(x, y); }
+    static VEC_INLINE vec AndNot(vec x, vec y) { return _mm256_andnot_si256(x, y); }
+    static VEC_INLINE vec Not(vec x) { return _mm256_xor_si256(x, _mm256_set1_epi32(-1)); }
+
+    static VEC_INLINE vec Sub(vec x, vec y) { return _mm256_sub_epi32(x, y); }
+    static VEC_INLINE vec CmpEq(vec x, vec y) { return _mm256_cmpeq_epi32(x, y); }
+    static VEC_INLINE vec MinU(vec x, vec y) { return _mm256_min_epu32(x, y); }
+    static VEC_INLINE bool Any(vec x) { return !_mm256_testz_si256(x, x); }
+
+    template <int n> static VEC_INLINE vec Shl(vec x) { return _mm256_slli_epi32(x, n); }
+    template <int n> static VEC_INLINE vec Shr(vec x) { return _mm256_srli_epi32(x, n); }
+    template <int n> static VEC_INLINE vec Rotr(vec x) { return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n)); }
+    template <int n> static VEC_INLINE vec Rotl(vec x) { return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n)); }
+
+    static VEC_INLINE vec Bswap(vec x) {
+        const __m256i mask = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        return _mm256_shuffle_epi8(x, mask);
+    }
+
+    // Transpose an 8x8 matrix of 32-bit words held in 8 registers: on return
+    // r[j] holds word j of every input row, lane i coming from row i
+    static VEC_INLINE void Transpose8x8(vec* r) {
+        __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+        __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+        __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+        __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+        __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+        __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+        __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+        __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+        __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+        __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+        __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+        __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+        __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+        __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+        __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+        __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+        r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+        r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+        r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+        r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+        r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+        r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+        r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+        r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+    }
+
+    static VEC_INLINE void LoadWords(vec* w, const uint8_t* const* data, int offset) {
+        for (int i = 0; i < 8; ++i) {
+            w[i] = _mm256_loadu_si256((const __m256i*)(data[i] + offset));
+        }
+        Transpose8x8(w);
+    }
+
+    // Groups of 4 words use a 4x8 transpose (lanes i and i + 4 per register),
+    // the remaining words are copied one by one
+    static VEC_INLINE void StoreWords(const vec* w, int count, unsigned char* const* out) {
+        int j = 0;
+        for (; j + 4 <= count; j += 4) {
+            __m256i t0 = _mm256_unpacklo_epi32(w[j], w[j + 1]);
+            __m256i t1 = _mm256_unpackhi_epi32(w[j], w[j + 1]);
+            __m256i t2 = _mm256_unpacklo_epi32(w[j + 2], w[j + 3]);
+            __m256i t3 = _mm256_unpackhi_epi32(w[j + 2], w[j + 3]);
+
+            __m256i r[4];
+            r[0] = _mm256_unpacklo_epi64(t0, t2);
+            r[1] = _mm256_unpackhi_epi64(t0, t2);
+            r[2] = _mm256_unpacklo_epi64(t1, t3);
+            r[3] = _mm256_unpackhi_epi64(t1, t3);
+
+            for (int i = 0; i < 4; ++i) {
+                _mm_storeu_si128((__m128i*)(out[i] + j * 4), _mm256_castsi256_si128(r[i]));
+                _mm_storeu_si128((__m128i*)(out[i + 4] + j * 4), _mm256_extracti128_si256(r[i], 1));
+            }
+        }
+        for (; j < count; ++j) {
+            uint32_t words[8];
+            _mm256_storeu_si256((__m256i*)words, w[j]);
+            for (int i = 0; i < 8; ++i) {
+                memcpy(out[i] + j * 4, &words[i], 4);
+            }
+        }
+    }
+};
+
+// Two independent 8-lane AVX2 streams (16 messages) stepped through the same
+// rounds. Every operation is issued for both halves back to back, so while
+// one stream waits on its T1 -> e, a chain the other keeps the ports busy.
+// Lanes 0..7 are in lo, lanes 8..15 in hi.
+struct VecAvx2x2 {
+    struct vec {
+        __m256i lo, hi;
+    };
+    static const int lanes = 16;
+
+    static VEC_INLINE vec Make(__m256i lo, __m256i hi) {
+        vec r;
+        r.lo = lo;
+        r.hi = hi;
+        return r;
+    }
+
+    static VEC_INLINE vec Set1(uint32_t x) { return Make(_mm256_set1_epi32((int)x), _mm256_set1_epi32((int)x)); }
+    static VEC_INLINE vec Zero() { return Make(_mm256_setzero_si256(), _mm256_setzero_si256()); }
+    static VEC_INLINE vec LoadU(const uint32_t* p) { return Make(VecAvx2::LoadU(p), VecAvx2::LoadU(p + 8)); }
+
+    static VEC_INLINE vec Add(vec x, vec y) { return Make(_mm256_add_epi32(x.lo, y.lo), _mm256_add_epi32(x.hi, y.hi)); }
+    static VEC_INLINE vec Xor(vec x, vec y) { return Make(_mm256_xor_si256(x.lo, y.lo), _mm256_xor_si256(x.hi, y.hi)); }
+    static VEC_INLINE vec And(vec x, vec y) { return Make(_mm256_and_si256(x.lo, y.lo), _mm256_and_si256(x.hi, y.hi)); }
+    static VEC_INLINE vec Or(vec x, vec y) { return Make(_mm256_or_si256(x.lo, y.lo), _mm256_or_si256(x.hi, y.hi)); }
+    static VEC_INLINE vec AndNot(vec x, vec y) { return Make(_mm256_andnot_si256(x.lo, y.lo), _mm256_andnot_si256(x.hi, y.hi)); }
+    static VEC_INLINE vec Not(vec x) { return Make(VecAvx2::Not(x.lo), VecAvx2::Not(x.hi)); }
+
+    static VEC_INLINE vec Sub(vec x, vec y) { return Make(_mm256_sub_epi32(x.lo, y.lo), _mm256_sub_epi32(x.hi, y.hi)); }
+    static VEC_INLINE vec CmpEq(vec x, vec y) { return Make(_mm256_cmpeq_epi32(x.lo, y.lo), _mm256_cmpeq_epi32(x.hi, y.hi)); }
+    static VEC_INLINE vec MinU(vec x, vec y) { return Make(_mm256_min_epu32(x.lo, y.lo), _mm256_min_epu32(x.hi, y.hi)); }
+    static VEC_INLINE bool Any(vec x) { return VecAvx2::Any(_mm256_or_si256(x.lo, x.hi)); }
+
+    template <int n> static VEC_INLINE vec Shl(vec x) { return Make(_mm256_slli_epi32(x.lo, n), _mm256_slli_epi32(x.hi, n)); }
+    template <int n> static VEC_INLINE vec Shr(vec x) { return Make(_mm256_srli_epi32(x.lo, n), _mm256_srli_epi32(x.hi, n)); }
+    template <int n> static VEC_INLINE vec Rotr(vec x) { return Make(VecAvx2::Rotr<n>(x.lo), VecAvx2::Rotr<n>(x.hi)); }
+    template <int n> static VEC_INLINE vec Rotl(vec x) { return Make(VecAvx2::Rotl<n>(x.lo), VecAvx2::Rotl<n>(x.hi)); }
+
+    static VEC_INLINE vec Bswap(vec x) { return Make(VecAvx2::Bswap(x.lo), VecAvx2::Bswap(x.hi)); }
+
+    static VEC_INLINE void LoadWords(vec* w, const uint8_t* const* data, int offset) {
+        __m256i lo[8], hi[8];
+        VecAvx2::LoadWords(lo, data, offset);
+        VecAvx2::LoadWords(hi, data + 8, offset);
+        for (int j = 0; j < 8; ++j) {
+            w[j] = Make(lo[j], hi[j]);
+        }
+    }
+
+    // At most 8 words, as for the state of either hash
+    static VEC_INLINE void StoreWords(const vec* w, int count, unsigned char* const* out) {
+        __m256i lo[8], hi[8];
+        for (int j = 0; j < count; ++j) {
+            lo[j] = w[j].lo;
+            hi[j] = w[j].hi;
+        }
+        VecAvx2::StoreWords(lo, count, out);
+        VecAvx2::StoreWords(hi, count, out + 8);
+    }
+};
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#elif defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#ifndef NO_AVX512
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+#endif
+
+// 16 messages per vector (AVX-512F). Build with -DNO_AVX512 when the compiler
+// does not know AVX-512.
+struct VecAvx512 {
+    typedef __m512i vec;
+    static const int lanes = 16;
+
+    static VEC_INLINE vec Set1(uint32_t x) { return _mm512_set1_epi32((int)x); }
+    static VEC_INLINE vec Zero() { return _mm512_setzero_si512(); }
+    static VEC_INLINE vec LoadU(const uint32_t* p) { return _mm512_loadu_si512((const void*)p); }
+
+    static VEC_INLINE vec Add(vec x, vec y) { return _mm512_add_epi32(x, y); }
+    static VEC_INLINE vec Xor(vec x, vec y) { return _mm512_xor_si512(x, y); }
+    static VEC_INLINE vec And(vec x, vec y) { return _mm512_and_si512(x, y); }
+    static VEC_INLINE vec Or(vec x, vec y) { return _mm512_or_si512(x, y); }
+    static VEC_INLINE vec AndNot(vec x, vec y) { return _mm512_andnot_si512(x, y); }
+    static VEC_INLINE vec Not(vec x) { return _mm512_ternarylogic_epi32(x, x, x, 0x55); }
+
+    // Compares give a mask register, expanded back to all-ones lanes
+    static VEC_INLINE vec Sub(vec x, vec y) { return _mm512_sub_epi32(x, y); }
+    static VEC_INLINE vec CmpEq(vec x, vec y) { return _mm512_maskz_set1_epi32(_mm512_cmpeq_epi32_mask(x, y), -1); }
+    static VEC_INLINE vec MinU(vec x, vec y) { return _mm512_min_epu32(x, y); }
+    static VEC_INLINE bool Any(vec x) { return _mm512_test_epi32_mask(x, x) != 0; }
+
+    template <int n> static VEC_INLINE vec Shl(vec x) { return _mm512_slli_epi32(x, n); }
+    template <int n> static VEC_INLINE vec Shr(vec x) { return _mm512_srli_epi32(x, n); }
+    template <int n> static VEC_INLINE vec Rotr(vec x) { return _mm512_ror_epi32(x, n); }
+    template <int n> static VEC_INLINE vec Rotl(vec x) { return _mm512_rol_epi32(x, n); }
+
+    // Byte shuffles need AVX512BW, rotates and masks only need AVX-512F
+    static VEC_INLINE vec Bswap(vec x) {
+        return _mm512_or_si512(_mm512_and_si512(_mm512_ror_epi32(x, 8), _mm512_set1_epi32((int)0xFF00FF00)),
+                               _mm512_and_si512(_mm512_rol_epi32(x, 8), _mm512_set1_epi32(0x00FF00FF)));
+    }
+
+    // Two 8x8 transposes, lanes 0..7 in the low half and 8..15 in the high half
+    static VEC_INLINE void LoadWords(vec* w, const uint8_t* const* data, int offset) {
+        __m256i lo[8], hi[8];
+        VecAvx2::LoadWords(lo, data, offset);
+        VecAvx2::LoadWords(hi, data + 8, offset);
+        for (int j = 0; j < 8; ++j) {
+            w[j] = _mm512_inserti64x4(_mm512_zextsi256_si512(lo[j]), hi[j], 1);
+        }
+    }
+
+    // Groups of 4 words use a 4x16 transpose (lanes i, i + 4, i + 8 and i + 12
+    // per register), the remaining words are copied one by one
+    static VEC_INLINE void StoreWords(const vec* w, int count, unsigned char* const* out) {
+        int j = 0;
+        for (; j + 4 <= count; j += 4) {
+            __m512i t0 = _mm512_unpacklo_epi32(w[j], w[j + 1]);
+            __m512i t1 = _mm512_unpackhi_epi32(w[j], w[j + 1]);
+            __m512i t2 = _mm512_unpacklo_epi32(w[j + 2], w[j + 3]);
+            __m512i t3 = _mm512_unpackhi_epi32(w[j + 2], w[j + 3]);
+
+            __m512i r[4];
+            r[0] = _mm512_unpacklo_epi64(t0, t2);
+            r[1] = _mm512_unpackhi_epi64(t0, t2);
+            r[2] = _mm512_unpacklo_epi64(t1, t3);
+            r[3] = _mm512_unpackhi_epi64(t1, t3);
+
+            for (int i = 0; i < 4; ++i) {
+                _mm_storeu_si128((__m128i*)(out[i] + j * 4), _mm512_castsi512_si128(r[i]));
+                _mm_storeu_si128((__m128i*)(out[i + 4] + j * 4), _mm512_extracti32x4_epi32(r[i], 1));
+                _mm_storeu_si128((__m128i*)(out[i + 8] + j * 4), _mm512_extracti32x4_epi32(r[i], 2));
+                _mm_storeu_si128((__m128i*)(out[i + 12] + j * 4), _mm512_extracti32x4_epi32(r[i], 3));
+            }
+        }
+        for (; j < count; ++j) {
+            uint32_t words[16];
+            _mm512_storeu_si512((void*)words, w[j]);
+            for (int i = 0; i < 16; ++i) {
+                memcpy(out[i] + j * 4, &words[i], 4);
+            }
+        }
+    }
+};
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#elif defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif // NO_AVX512
+
+#endif // VEC_TRAITS_H
@@ -0,0 +1,103 @@
+#include "work_scheduler.h"
+#include <algorithm>
+
+WorkScheduler::WorkScheduler(uint64_t total, int threads, uint64_t align, uint64_t minChunk, uint64_t maxChunk)
+    : total(total), threads(threads), align(align), cursor(0), workers(new Worker[threads]) {
+    this->minChunk = alignUp(std::max<uint64_t>(minChunk, 1));
+    this->maxChunk = std::max(this->minChunk, alignUp(maxChunk));
+}
+
+uint64_t WorkScheduler::alignUp(uint64_t x) const {
+    return (x + align - 1) / align * align;
+}
+
+// Move the next guided grab of the cursor into the own range. Called with
+// the own lock held, so a thief either sees the grab or finds the cursor
+// still short of total.
+bool WorkScheduler::grab(Worker& self) {
+    uint64_t begin = cursor.load(std::memory_order_relaxed);
+    uint64_t end;
+    do {
+        if (begin >= total) {
+            return false;
+        }
+        uint64_t size = alignUp(std::max((total - begin) / (4 * (uint64_t)threads), minChunk));
+        end = std::min(total, begin + size);
+    } while (!cursor.compare_exchange_weak(begin, end, std::memory_order_relaxed));
+
+    self.begin = begin;
+    self.end = end;
+    return true;
+}
+
+// Take the back half of the largest range of the other threads. Only one
+// lock is held at a time: the stolen part is cut off under the victim's lock
+// and becomes the own range afterwards.
+bool WorkScheduler::steal(int thread, Worker& self) {
+    for (;;) {
+        int victim = -1;
+        uint64_t largest = 0;
+        for (int k = 1; k < threads; ++k) {
+            int i = (thread + k) % threads;
+            std::lock_guard<std::mutex> guard(workers[i].lock);
+            if (workers[i].end - workers[i].begin > largest) {
+                largest = workers[i].end - workers[i].begin;
+                victim = i;
+            }
+        }
+        if (victim < 0) {
+            return false;
+        }
+
+        uint64_t begin, end;
+        {
+            Worker& other = workers[victim];
+            std::lock_guard<std::mutex> guard(other.lock);
+            uint64_t left = other.end - other.begin;
+            if (left == 0) {
+                continue;  // Emptied since the scan, look again
+            }
+
+            // Leave the victim at least a chunk, a small range goes whole
+            begin = left <= minChunk ? other.begin : other.begin + std::max(minChunk, alignUp(left / 2));
+            end = other.end;
+            other.end = begin;
+        }
+
+        std::lock_guard<std::mutex> guard(self.lock);
+        self.begin = begin;
+        self.end = end;
+        self.steals++;
+        return true;
+    }
+}
+
+bool WorkScheduler::next(int thread, uint64_t* begin, uint64_t* end) {
+    Worker& self = workers[thread];
+
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> guard(self.lock);
+            if (self.begin < self.end || grab(self)) {
+                uint64_t left = self.end - self.begin;
+                uint64_t size = std::min(left, std::min(maxChunk, std::max(minChunk, alignUp(left / 4))));
+                *begin = self.begin;
+                *end = self.begin + size;
+                self.begin = *end;
+                return true;
+            }
+        }
+
+        if (!steal(thread, self)) {
+            return false;
+        }
+    }
+}
+
+uint64_t WorkScheduler::steals() const {
+    uint64_t count = 0;
+    for (int i = 0; i < threads; ++i) {
+        count += workers[i].steals;
+    }
+    return count;
+}
@@ -0,0 +1,54 @@
+#ifndef WORK_SCHEDULER_H
+#define WORK_SCHEDULER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Work-stealing split of the key range [0, total) for the generator threads.
+//
+// A global cursor hands out grabs of remaining / (4 * threads) keys (guided,
+// so grabs shrink as the range runs out). Each grab becomes the thread's own
+// range, a deque of chunks: the owner takes chunks from the front, sized
+// between minChunk and maxChunk after what it has left, and idle threads
+// steal the back half of the fullest range once the cursor is exhausted. A
+// slow or descheduled thread therefore only holds back its current chunk,
+// and any total works with any number of threads.
+//
+// Chunk and grab boundaries are multiples of align (the last chunk ends at
+// total), so kernels that work on fixed blocks of keys see whole blocks.
+class WorkScheduler {
+public:
+    WorkScheduler(uint64_t total, int threads, uint64_t align = 256,
+                  uint64_t minChunk = 1024, uint64_t maxChunk = 65536);
+
+    // Next chunk [*begin, *end) for thread; false once no work is left that
+    // could be handed out
+    bool next(int thread, uint64_t* begin, uint64_t* end);
+
+    // Chunks taken from other threads, read once the workers are done
+    uint64_t steals() const;
+
+private:
+    struct alignas(64) Worker {
+        std::mutex lock;
+        uint64_t begin = 0;  // Own range, chunks are taken from the front
+        uint64_t end = 0;    // and stolen from the back
+        uint64_t steals = 0;
+    };
+
+    bool grab(Worker& self);
+    bool steal(int thread, Worker& self);
+    uint64_t alignUp(uint64_t x) const;
+
+    uint64_t total;
+    int threads;
+    uint64_t align;
+    uint64_t minChunk;
+    uint64_t maxChunk;
+    std::atomic<uint64_t> cursor;
+    std::unique_ptr<Worker[]> workers;
+};
+
+#endif // WORK_SCHEDULER_H
@@ -0,0 +1,54 @@
+#include "hash160_avx2.h"
+#include "../sha256_avx2/sha256_avx2.h"
+#include "../ripemd160_avx2/ripemd160_avx2.h"
+#include <immintrin.h>
+#include <stdint.h>
+
+// This file is built for AVX2 whatever the command line says, callers check
+// the CPU first
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC target("avx2")
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#endif
+
+void hash160avx2_8(
+    const uint8_t* data0, const uint8_t* data1, const uint8_t* data2, const uint8_t* data3,
+    const uint8_t* data4, const uint8_t* data5, const uint8_t* data6, const uint8_t* data7,
+    unsigned char* hash0, unsigned char* hash1, unsigned char* hash2, unsigned char* hash3,
+    unsigned char* hash4, unsigned char* hash5, unsigned char* hash6, unsigned char* hash7) {
+
+    __m256i state[8];
+    __m256i w[8];
+    __m256i s[5];
+
+    // SHA-256 of the input blocks
+    _sha256avx2::Initialize(state);
+
+    const uint8_t* data[8] = { data0, data1, data2, data3, data4, data5, data6, data7 };
+
+    _sha256avx2::Transform(state, data);
+
+    // SHA-256 digest words are big-endian, RIPEMD-160 reads little-endian words:
+    // byte swap in-register and use the state directly as message words 0..7
+    const __m256i bswap = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    for (int i = 0; i < 8; ++i) {
+        w[i] = _mm256_shuffle_epi8(state[i], bswap);
+    }
+
+    // RIPEMD-160 of the SHA-256 digests, words 8..15 are the constant padding
+    ripemd160avx2::Initialize(s);
+    ripemd160avx2::Transform32(s, w);
+
+    unsigned char* hashArray[8] = { hash0, hash1, hash2, hash3, hash4, hash5, hash6, hash7 };
+
+    // Transpose the state and copy one digest per lane to the output buffers
+    ripemd160avx2::StoreDigests(s, hashArray);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
@@ -0,0 +1,16 @@
+#ifndef HASH160_AVX2_H
+#define HASH160_AVX2_H
+
+#include <cstdint>
+
+// Hash160 = RIPEMD-160(SHA-256(data)) for 8 messages of one pre-padded
+// SHA-256 block each. The SHA-256 digest never leaves the registers: it is
+// fed directly as RIPEMD-160 message words 0..7. Outputs are 20 bytes each.
+void hash160avx2_8(
+    const uint8_t* data0, const uint8_t* data1, const uint8_t* data2, const uint8_t* data3,
+    const uint8_t* data4, const uint8_t* data5, const uint8_t* data6, const uint8_t* data7,
+    unsigned char* hash0, unsigned char* hash1, unsigned char* hash2, unsigned char* hash3,
+    unsigned char* hash4, unsigned char* hash5, unsigned char* hash6, unsigned char* hash7
+);
+
+#endif // HASH160_AVX2_H
@@ -3,339 +3,616 @@
 #include <cstring>
 #include <cstdint>
 
+// This file is built for AVX2 whatever the command line says, callers check
+// the CPU first (see ripemd160_dispatch.cpp)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC target("avx2")
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#endif
+
+#include "ripemd160_rounds.h"
+
 namespace ripemd160avx2 {
 
-#ifdef WIN64
-static const __declspec(align(32)) uint32_t _init[] = {
-#else
-static const uint32_t _init[] __attribute__((aligned(32))) = {
-#endif
-    // 8 copies of A
-    0x67452301ul, 0x67452301ul, 0x67452301ul, 0x67452301ul,
-    0x67452301ul, 0x67452301ul, 0x67452301ul, 0x67452301ul,
-
-    // 8 copies of B
-    0xEFCDAB89ul, 0xEFCDAB89ul, 0xEFCDAB89ul, 0xEFCDAB89ul,
-    0xEFCDAB89ul, 0xEFCDAB89ul, 0xEFCDAB89ul, 0xEFCDAB89ul,
-
-    // 8 copies of C
-    0x98BADCFEul, 0x98BADCFEul, 0x98BADCFEul, 0x98BADCFEul,
-    0x98BADCFEul, 0x98BADCFEul, 0x98BADCFEul, 0x98BADCFEul,
-
-    // 8 copies of D
-    0x10325476ul, 0x10325476ul, 0x10325476ul, 0x10325476ul,
-    0x10325476ul, 0x10325476ul, 0x10325476ul, 0x10325476ul,
-
-    // 8 copies of E
-    0xC3D2E1F0ul, 0xC3D2E1F0ul, 0xC3D2E1F0ul, 0xC3D2E1F0ul,
-    0xC3D2E1F0ul, 0xC3D2E1F0ul, 0xC3D2E1F0ul, 0xC3D2E1F0ul
-};
-
-// AVX2 operations
-#define _mm256_not_si256(x) _mm256_xor_si256((x), _mm256_set1_epi32(-1))
-#define ROL(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n))
-
-// RIPEMD-160 functions
-#define f1(x, y, z) _mm256_xor_si256(x, _mm256_xor_si256(y, z))
-#define f2(x, y, z) _mm256_or_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z))
-#define f3(x, y, z) _mm256_xor_si256(_mm256_or_si256(x, _mm256_not_si256(y)), z)
-#define f4(x, y, z) _mm256_or_si256(_mm256_and_si256(x, z), _mm256_andnot_si256(z, y))
-#define f5(x, y, z) _mm256_xor_si256(x, _mm256_or_si256(y, _mm256_not_si256(z)))
-
-// Addition helpers
-#define add3(x0, x1, x2) _mm256_add_epi32(_mm256_add_epi32(x0, x1), x2)
-#define add4(x0, x1, x2, x3) _mm256_add_epi32(_mm256_add_epi32(x0, x1), _mm256_add_epi32(x2, x3))
-
-// Round function
-#define Round(a, b, c, d, e, f, x, k, r)   \
-    u = add4(a, f, x, _mm256_set1_epi32(k)); \
-    a = _mm256_add_epi32(ROL(u, r), e);     \
-    c = ROL(c, 10);
-
-// Macro definitions for each operation in the rounds
-#define R11(a, b, c, d, e, x, r) Round(a, b, c, d, e, f1(b, c, d), x, 0, r)
-#define R21(a, b, c, d, e, x, r) Round(a, b, c, d, e, f2(b, c, d), x, 0x5A827999ul, r)
-#define R31(a, b, c, d, e, x, r) Round(a, b, c, d, e, f3(b, c, d), x, 0x6ED9EBA1ul, r)
-#define R41(a, b, c, d, e, x, r) Round(a, b, c, d, e, f4(b, c, d), x, 0x8F1BBCDCul, r)
-#define R51(a, b, c, d, e, x, r) Round(a, b, c, d, e, f5(b, c, d), x, 0xA953FD4Eul, r)
-#define R12(a, b, c, d, e, x, r) Round(a, b, c, d, e, f5(b, c, d), x, 0x50A28BE6ul, r)
-#define R22(a, b, c, d, e, x, r) Round(a, b, c, d, e, f4(b, c, d), x, 0x5C4DD124ul, r)
-#define R32(a, b, c, d, e, x, r) Round(a, b, c, d, e, f3(b, c, d), x, 0x6D703EF3ul, r)
-#define R42(a, b, c, d, e, x, r) Round(a, b, c, d, e, f2(b, c, d), x, 0x7A6D76E9ul, r)
-#define R52(a, b, c, d, e, x, r) Round(a, b, c, d, e, f1(b, c, d), x, 0, r)
-
-// Macro to load words from the message blocks
-#define LOADW(i) _mm256_set_epi32(*((uint32_t *)blk[0] + i), *((uint32_t *)blk[1] + i), \
-                                  *((uint32_t *)blk[2] + i), *((uint32_t *)blk[3] + i), \
-                                  *((uint32_t *)blk[4] + i), *((uint32_t *)blk[5] + i), \
-                                  *((uint32_t *)blk[6] + i), *((uint32_t *)blk[7] + i))
+typedef Rounds<VecAvx2> R;
+typedef Rounds<VecAvx2x2> R2;
 
 // Initialize state with initial hash values
 void Initialize(__m256i *s) {
-    memcpy(s, _init, sizeof(_init));
+    R::Initialize(s);
+}
+
+// Transform function on message words already held in registers
+void Transform(__m256i *s, const __m256i *w) {
+    R::Transform(s, w);
 }
 
 // Transform function processes one block for each message
-void Transform(__m256i *s, uint8_t *blk[8]) {
-    // Load state variables
-    __m256i a1 = _mm256_load_si256(s + 0);
-    __m256i b1 = _mm256_load_si256(s + 1);
-    __m256i c1 = _mm256_load_si256(s + 2);
-    __m256i d1 = _mm256_load_si256(s + 3);
-    __m256i e1 = _mm256_load_si256(s + 4);
-
-    // Initialize second set of variables
-    __m256i a2 = a1;
-    __m256i b2 = b1;
-    __m256i c2 = c1;
-    __m256i d2 = d1;
-    __m256i e2 = e1;
-
-    __m256i u;
+void Transform(__m256i *s, const uint8_t *blk[8]) {
+    R::Transform(s, blk);
+}
+
+// Two interleaved streams of 8 blocks
+void Transform2(__m256i *s, const uint8_t *blk[16]) {
+    VecAvx2x2::vec s2[5];
+    for (int i = 0; i < 5; ++i) {
+        s2[i] = VecAvx2x2::Make(s[i], s[i + 5]);
+    }
+
+    R2::Transform(s2, blk);
+
+    for (int i = 0; i < 5; ++i) {
+        s[i] = s2[i].lo;
+        s[i + 5] = s2[i].hi;
+    }
+}
+
+// Transform of a 32-byte message per lane held in w[0..7], the padding is
+// folded into the round constants
+void Transform32(__m256i *s, const __m256i *w8) {
+    R::Transform32(s, w8);
+}
+
+// Precompute everything that does not depend on message word 0
+void PrepareMidstate32(Midstate *m, const uint8_t *data) {
+    Initialize(m->s);
+
+    // Message words 1..7 followed by the constant padding of a 32-byte message
+    m->w[0] = _mm256_setzero_si256();
+    for (int i = 1; i < 8; ++i) {
+        uint32_t word;
+        memcpy(&word, data + i * 4, 4);
+        m->w[i] = _mm256_set1_epi32((int)word);
+    }
+    m->w[8] = _mm256_set1_epi32(0x80);
+    for (int i = 9; i < 16; ++i) {
+        m->w[i] = _mm256_setzero_si256();
+    }
+    m->w[14] = _mm256_set1_epi32(32 << 3);
+
+    __m256i a2 = m->s[0];
+    __m256i b2 = m->s[1];
+    __m256i c2 = m->s[2];
+    __m256i d2 = m->s[3];
+    __m256i e2 = m->s[4];
+
+    R::RightHead(a2, b2, c2, d2, e2, m->w);
+
+    m->right[0] = a2;
+    m->right[1] = b2;
+    m->right[2] = c2;
+    m->right[3] = d2;
+    m->right[4] = e2;
+}
+
+// Finish the transform from a midstate, only message word 0 differs per lane
+void TransformMidstate(__m256i *s, const Midstate *m, __m256i w0) {
     __m256i w[16];
 
-    // Load message words
-    for (int i = 0; i < 16; ++i) {
-        w[i] = LOADW(i);
-    }
-
-    // Rounds 0-15
-    R11(a1, b1, c1, d1, e1, w[0], 11);
-    R12(a2, b2, c2, d2, e2, w[5], 8);
-    R11(e1, a1, b1, c1, d1, w[1], 14);
-    R12(e2, a2, b2, c2, d2, w[14], 9);
-    R11(d1, e1, a1, b1, c1, w[2], 15);
-    R12(d2, e2, a2, b2, c2, w[7], 9);
-    R11(c1, d1, e1, a1, b1, w[3], 12);
-    R12(c2, d2, e2, a2, b2, w[0], 11);
-    R11(b1, c1, d1, e1, a1, w[4], 5);
-    R12(b2, c2, d2, e2, a2, w[9], 13);
-    R11(a1, b1, c1, d1, e1, w[5], 8);
-    R12(a2, b2, c2, d2, e2, w[2], 15);
-    R11(e1, a1, b1, c1, d1, w[6], 7);
-    R12(e2, a2, b2, c2, d2, w[11], 15);
-    R11(d1, e1, a1, b1, c1, w[7], 9);
-    R12(d2, e2, a2, b2, c2, w[4], 5);
-    R11(c1, d1, e1, a1, b1, w[8], 11);
-    R12(c2, d2, e2, a2, b2, w[13], 7);
-    R11(b1, c1, d1, e1, a1, w[9], 13);
-    R12(b2, c2, d2, e2, a2, w[6], 7);
-    R11(a1, b1, c1, d1, e1, w[10], 14);
-    R12(a2, b2, c2, d2, e2, w[15], 8);
-    R11(e1, a1, b1, c1, d1, w[11], 15);
-    R12(e2, a2, b2, c2, d2, w[8], 11);
-    R11(d1, e1, a1, b1, c1, w[12], 6);
-    R12(d2, e2, a2, b2, c2, w[1], 14);
-    R11(c1, d1, e1, a1, b1, w[13], 7);
-    R12(c2, d2, e2, a2, b2, w[10], 14);
-    R11(b1, c1, d1, e1, a1, w[14], 9);
-    R12(b2, c2, d2, e2, a2, w[3], 12);
-    R11(a1, b1, c1, d1, e1, w[15], 8);
-    R12(a2, b2, c2, d2, e2, w[12], 6);
-
-    R21(e1, a1, b1, c1, d1, w[7], 7);
-    R22(e2, a2, b2, c2, d2, w[6], 9);
-    R21(d1, e1, a1, b1, c1, w[4], 6);
-    R22(d2, e2, a2, b2, c2, w[11], 13);
-    R21(c1, d1, e1, a1, b1, w[13], 8);
-    R22(c2, d2, e2, a2, b2, w[3], 15);
-    R21(b1, c1, d1, e1, a1, w[1], 13);
-    R22(b2, c2, d2, e2, a2, w[7], 7);
-    R21(a1, b1, c1, d1, e1, w[10], 11);
-    R22(a2, b2, c2, d2, e2, w[0], 12);
-    R21(e1, a1, b1, c1, d1, w[6], 9);
-    R22(e2, a2, b2, c2, d2, w[13], 8);
-    R21(d1, e1, a1, b1, c1, w[15], 7);
-    R22(d2, e2, a2, b2, c2, w[5], 9);
-    R21(c1, d1, e1, a1, b1, w[3], 15);
-    R22(c2, d2, e2, a2, b2, w[10], 11);
-    R21(b1, c1, d1, e1, a1, w[12], 7);
-    R22(b2, c2, d2, e2, a2, w[14], 7);
-    R21(a1, b1, c1, d1, e1, w[0], 12);
-    R22(a2, b2, c2, d2, e2, w[15], 7);
-    R21(e1, a1, b1, c1, d1, w[9], 15);
-    R22(e2, a2, b2, c2, d2, w[8], 12);
-    R21(d1, e1, a1, b1, c1, w[5], 9);
-    R22(d2, e2, a2, b2, c2, w[12], 7);
-    R21(c1, d1, e1, a1, b1, w[2], 11);
-    R22(c2, d2, e2, a2, b2, w[4], 6);
-    R21(b1, c1, d1, e1, a1, w[14], 7);
-    R22(b2, c2, d2, e2, a2, w[9], 15);
-    R21(a1, b1, c1, d1, e1, w[11], 13);
-    R22(a2, b2, c2, d2, e2, w[1], 13);
-    R21(e1, a1, b1, c1, d1, w[8], 12);
-    R22(e2, a2, b2, c2, d2, w[2], 11);
-
-    R31(d1, e1, a1, b1, c1, w[3], 11);
-    R32(d2, e2, a2, b2, c2, w[15], 9);
-    R31(c1, d1, e1, a1, b1, w[10], 13);
-    R32(c2, d2, e2, a2, b2, w[5], 7);
-    R31(b1, c1, d1, e1, a1, w[14], 6);
-    R32(b2, c2, d2, e2, a2, w[1], 15);
-    R31(a1, b1, c1, d1, e1, w[4], 7);
-    R32(a2, b2, c2, d2, e2, w[3], 11);
-    R31(e1, a1, b1, c1, d1, w[9], 14);
-    R32(e2, a2, b2, c2, d2, w[7], 8);
-    R31(d1, e1, a1, b1, c1, w[15], 9);
-    R32(d2, e2, a2, b2, c2, w[14], 6);
-    R31(c1, d1, e1, a1, b1, w[8], 13);
-    R32(c2, d2, e2, a2, b2, w[6], 6);
-    R31(b1, c1, d1, e1, a1, w[1], 15);
-    R32(b2, c2, d2, e2, a2, w[9], 14);
-    R31(a1, b1, c1, d1, e1, w[2], 14);
-    R32(a2, b2, c2, d2, e2, w[11], 12);
-    R31(e1, a1, b1, c1, d1, w[7], 8);
-    R32(e2, a2, b2, c2, d2, w[8], 13);
-    R31(d1, e1, a1, b1, c1, w[0], 13);
-    R32(d2, e2, a2, b2, c2, w[12], 5);
-    R31(c1, d1, e1, a1, b1, w[6], 6);
-    R32(c2, d2, e2, a2, b2, w[2], 14);
-    R31(b1, c1, d1, e1, a1, w[13], 5);
-    R32(b2, c2, d2, e2, a2, w[10], 13);
-    R31(a1, b1, c1, d1, e1, w[11], 12);
-    R32(a2, b2, c2, d2, e2, w[0], 13);
-    R31(e1, a1, b1, c1, d1, w[5], 7);
-    R32(e2, a2, b2, c2, d2, w[4], 7);
-    R31(d1, e1, a1, b1, c1, w[12], 5);
-    R32(d2, e2, a2, b2, c2, w[13], 5);
-
-    R41(c1, d1, e1, a1, b1, w[1], 11);
-    R42(c2, d2, e2, a2, b2, w[8], 15);
-    R41(b1, c1, d1, e1, a1, w[9], 12);
-    R42(b2, c2, d2, e2, a2, w[6], 5);
-    R41(a1, b1, c1, d1, e1, w[11], 14);
-    R42(a2, b2, c2, d2, e2, w[4], 8);
-    R41(e1, a1, b1, c1, d1, w[10], 15);
-    R42(e2, a2, b2, c2, d2, w[1], 11);
-    R41(d1, e1, a1, b1, c1, w[0], 14);
-    R42(d2, e2, a2, b2, c2, w[3], 14);
-    R41(c1, d1, e1, a1, b1, w[8], 15);
-    R42(c2, d2, e2, a2, b2, w[11], 14);
-    R41(b1, c1, d1, e1, a1, w[12], 9);
-    R42(b2, c2, d2, e2, a2, w[15], 6);
-    R41(a1, b1, c1, d1, e1, w[4], 8);
-    R42(a2, b2, c2, d2, e2, w[0], 14);
-    R41(e1, a1, b1, c1, d1, w[13], 9);
-    R42(e2, a2, b2, c2, d2, w[5], 6);
-    R41(d1, e1, a1, b1, c1, w[3], 14);
-    R42(d2, e2, a2, b2, c2, w[12], 9);
-    R41(c1, d1, e1, a1, b1, w[7], 5);
-    R42(c2, d2, e2, a2, b2, w[2], 12);
-    R41(b1, c1, d1, e1, a1, w[15], 6);
-    R42(b2, c2, d2, e2, a2, w[13], 9);
-    R41(a1, b1, c1, d1, e1, w[14], 8);
-    R42(a2, b2, c2, d2, e2, w[9], 12);
-    R41(e1, a1, b1, c1, d1, w[5], 6);
-    R42(e2, a2, b2, c2, d2, w[7], 5);
-    R41(d1, e1, a1, b1, c1, w[6], 5);
-    R42(d2, e2, a2, b2, c2, w[10], 15);
-    R41(c1, d1, e1, a1, b1, w[2], 12);
-    R42(c2, d2, e2, a2, b2, w[14], 8);
-
-    R51(b1, c1, d1, e1, a1, w[4], 9);
-    R52(b2, c2, d2, e2, a2, w[12], 8);
-    R51(a1, b1, c1, d1, e1, w[0], 15);
-    R52(a2, b2, c2, d2, e2, w[15], 5);
-    R51(e1, a1, b1, c1, d1, w[5], 5);
-    R52(e2, a2, b2, c2, d2, w[10], 12);
-    R51(d1, e1, a1, b1, c1, w[9], 11);
-    R52(d2, e2, a2, b2, c2, w[4], 9);
-    R51(c1, d1, e1, a1, b1, w[7], 6);
-    R52(c2, d2, e2, a2, b2, w[1], 12);
-    R51(b1, c1, d1, e1, a1, w[12], 8);
-    R52(b2, c2, d2, e2, a2, w[5], 5);
-    R51(a1, b1, c1, d1, e1, w[2], 13);
-    R52(a2, b2, c2, d2, e2, w[8], 14);
-    R51(e1, a1, b1, c1, d1, w[10], 12);
-    R52(e2, a2, b2, c2, d2, w[7], 6);
-    R51(d1, e1, a1, b1, c1, w[14], 5);
-    R52(d2, e2, a2, b2, c2, w[6], 8);
-    R51(c1, d1, e1, a1, b1, w[1], 12);
-    R52(c2, d2, e2, a2, b2, w[2], 13);
-    R51(b1, c1, d1, e1, a1, w[3], 13);
-    R52(b2, c2, d2, e2, a2, w[13], 6);
-    R51(a1, b1, c1, d1, e1, w[8], 14);
-    R52(a2, b2, c2, d2, e2, w[14], 5);
-    R51(e1, a1, b1, c1, d1, w[11], 11);
-    R52(e2, a2, b2, c2, d2, w[0], 15);
-    R51(d1, e1, a1, b1, c1, w[6], 8);
-    R52(d2, e2, a2, b2, c2, w[3], 13);
-    R51(c1, d1, e1, a1, b1, w[15], 5);
-    R52(c2, d2, e2, a2, b2, w[9], 11);
-    R51(b1, c1, d1, e1, a1, w[13], 6);
-    R52(b2, c2, d2, e2, a2, w[11], 11);
-    
-    // Combine results and update state
-    __m256i t = s[0];
-    s[0] = add3(s[1], c1, d2);
-    s[1] = add3(s[2], d1, e2);
-    s[2] = add3(s[3], e1, a2);
-    s[3] = add3(s[4], a1, b2);
-    s[4] = add3(t, b1, c2);
-}
-
-#ifdef WIN64
-#define DEPACK(d, i)                                   \
-    ((uint32_t *)d)[0] = _mm256_extract_epi32(s[0], i); \
-    ((uint32_t *)d)[1] = _mm256_extract_epi32(s[1], i); \
-    ((uint32_t *)d)[2] = _mm256_extract_epi32(s[2], i); \
-    ((uint32_t *)d)[3] = _mm256_extract_epi32(s[3], i); \
-    ((uint32_t *)d)[4] = _mm256_extract_epi32(s[4], i);
-#else
-#define DEPACK(d, i)                                  \
-    ((uint32_t *)d)[0] = ((uint32_t *)&s[0])[i];      \
-    ((uint32_t *)d)[1] = ((uint32_t *)&s[1])[i];      \
-    ((uint32_t *)d)[2] = ((uint32_t *)&s[2])[i];      \
-    ((uint32_t *)d)[3] = ((uint32_t *)&s[3])[i];      \
-    ((uint32_t *)d)[4] = ((uint32_t *)&s[4])[i];
-#endif
+    w[0] = w0;
+    for (int i = 1; i < 8; ++i) {
+        w[i] = m->w[i];
+    }
+
+    // Padding words as compile-time constants
+    w[8] = _mm256_set1_epi32(0x80);
+    for (int i = 9; i < 16; ++i) {
+        w[i] = _mm256_setzero_si256();
+    }
+    w[14] = _mm256_set1_epi32(32 << 3);
+
+    for (int i = 0; i < 5; ++i) {
+        s[i] = m->s[i];
+    }
+
+    R::Compress(s, w, m->right[0], m->right[1], m->right[2], m->right[3], m->right[4]);
+}
+
+void PrepareMatch(DigestMatch *match, const uint8_t mask[20], const uint8_t value[20]) {
+    for (int i = 0; i < 5; ++i) {
+        uint32_t mw, vw;
+        memcpy(&mw, mask + i * 4, 4);
+        memcpy(&vw, value + i * 4, 4);
+        match->mask[i] = _mm256_set1_epi32((int)mw);
+        match->value[i] = _mm256_set1_epi32((int)(vw & mw));
+    }
+}
 
-static const uint64_t sizedesc_32 = 32 << 3;
-static const unsigned char pad[64] = { 0x80 };
+int TransformMidstateMatch(__m256i *s, const Midstate *m, __m256i w0, const DigestMatch *match) {
+    TransformMidstate(s, m, w0);
+
+    __m256i pass = _mm256_cmpeq_epi32(_mm256_and_si256(s[0], match->mask[0]), match->value[0]);
+    for (int i = 1; i < 5; ++i) {
+        pass = _mm256_and_si256(pass, _mm256_cmpeq_epi32(_mm256_and_si256(s[i], match->mask[i]), match->value[i]));
+    }
+    return _mm256_movemask_ps(_mm256_castsi256_ps(pass));
+}
+
+// Write one 20-byte digest per lane, words A..D go through a 4x8 transpose
+void StoreDigests(const __m256i *s, unsigned char *digest[8]) {
+    VecAvx2::StoreWords(s, 5, digest);
+}
 
 // Main function to compute RIPEMD-160 hash for 8 messages of 32 bytes each
 void ripemd160avx2_32(
-    unsigned char *i0, unsigned char *i1,
-    unsigned char *i2, unsigned char *i3,
-    unsigned char *i4, unsigned char *i5,
-    unsigned char *i6, unsigned char *i7,
+    const unsigned char *i0, const unsigned char *i1,
+    const unsigned char *i2, const unsigned char *i3,
+    const unsigned char *i4, const unsigned char *i5,
+    const unsigned char *i6, const unsigned char *i7,
+    unsigned char *d0, unsigned char *d1,
+    unsigned char *d2, unsigned char *d3,
+    unsigned char *d4, unsigned char *d5,
+    unsigned char *d6, unsigned char *d7)
+{
+    const unsigned char *blk[] = { i0, i1, i2, i3, i4, i5, i6, i7 };
+    unsigned char *digest[] = { d0, d1, d2, d3, d4, d5, d6, d7 };
+
+    R::Hash32(blk, digest);
+}
+
+// Length-specialized RIPEMD-160 for 8 messages of exactly Len bytes.
+// Nothing is written to the input buffers.
+template <size_t Len>
+void ripemd160avx2(
+    const unsigned char *i0, const unsigned char *i1,
+    const unsigned char *i2, const unsigned char *i3,
+    const unsigned char *i4, const unsigned char *i5,
+    const unsigned char *i6, const unsigned char *i7,
+    unsigned char *d0, unsigned char *d1,
+    unsigned char *d2, unsigned char *d3,
+    unsigned char *d4, unsigned char *d5,
+    unsigned char *d6, unsigned char *d7)
+{
+    static_assert(Len == 32, "single-block length 32 only");
+
+    const unsigned char *blk[] = { i0, i1, i2, i3, i4, i5, i6, i7 };
+    unsigned char *digest[] = { d0, d1, d2, d3, d4, d5, d6, d7 };
+
+    R::Hash32(blk, digest);
+}
+
+template void ripemd160avx2<32>(
+    const unsigned char *, const unsigned char *, const unsigned char *, const unsigned char *,
+    const unsigned char *, const unsigned char *, const unsigned char *, const unsigned char *,
+    unsigned char *, unsigned char *, unsigned char *, unsigned char *,
+    unsigned char *, unsigned char *, unsigned char *, unsigned char *);
+
+// Compute RIPEMD-160 for 8 messages of 32 bytes sharing a midstate
+void ripemd160avx2_32_midstate(
+    const Midstate *m, const uint32_t w0[8],
     unsigned char *d0, unsigned char *d1,
     unsigned char *d2, unsigned char *d3,
     unsigned char *d4, unsigned char *d5,
     unsigned char *d6, unsigned char *d7)
 {
     __m256i s[5];
-    uint8_t *bs[] = { i0, i1, i2, i3, i4, i5, i6, i7 };
 
-    // Initialize state
-    ripemd160avx2::Initialize(s);
+    // Lane i holds message i
+    __m256i w = _mm256_loadu_si256((const __m256i *)w0);
 
-    // Add padding and length
+    ripemd160avx2::TransformMidstate(s, m, w);
+
+    // Unpack the hash values to the output buffers
+    unsigned char *digest[] = { d0, d1, d2, d3, d4, d5, d6, d7 };
+    ripemd160avx2::StoreDigests(s, digest);
+}
+
+// Masked search over 8 messages sharing a midstate, only matching lanes are depacked
+int ripemd160avx2_32_midstate_match(
+    const Midstate *m, const uint32_t w0[8],
+    const DigestMatch *match, unsigned char *digest[8])
+{
+    __m256i s[5];
+
+    __m256i w = _mm256_loadu_si256((const __m256i *)w0);
+    int found = ripemd160avx2::TransformMidstateMatch(s, m, w, match);
+    if (found == 0) {
+        return 0;
+    }
+
+    alignas(32) uint32_t words[5][8];
+    for (int i = 0; i < 5; ++i) {
+        _mm256_store_si256((__m256i *)words[i], s[i]);
+    }
+    for (int lane = 0; lane < 8; ++lane) {
+        if (found & (1 << lane)) {
+            for (int i = 0; i < 5; ++i) {
+                memcpy(digest[lane] + i * 4, &words[i][lane], 4);
+            }
+        }
+    }
+    return found;
+}
+
+// Counter keys through the midstate: groups of 8 keys that share bytes 4..31
+// only differ in message word 0, a group where word 0 wraps takes the full
+// transform. Without a match every digest is written to out, otherwise only
+// the matching ones, with their key offsets in index.
+static size_t HashCounter32Midstate(const uint8_t *key, size_t n, const DigestMatch *match,
+                                    uint32_t *index, uint8_t *out)
+{
+    uint32_t digits[8];
+    memcpy(digits, key, 32);
+
+    VecCounter<VecAvx2, 8> counter;
+    counter.Init(digits);
+
+    Midstate m;
+    bool midstateValid = false;
+    uint32_t low = digits[0];   // Word 0 of lane 0
+    size_t found = 0;
+    unsigned char scratch[8][20];
+
+    for (size_t base = 0; base < n; base += 8) {
+        __m256i s[5];
+        int lanes = (n - base < 8) ? (1 << (n - base)) - 1 : 0xFF;
+
+        if (low <= 0xFFFFFFF8u) {
+            if (!midstateValid) {
+                uint8_t data[32];
+                for (int i = 0; i < 8; ++i) {
+                    uint32_t word = (uint32_t)_mm256_cvtsi256_si32(counter.c[i]);
+                    memcpy(data + i * 4, &word, 4);
+                }
+                PrepareMidstate32(&m, data);
+                midstateValid = true;
+            }
+            TransformMidstate(s, &m, counter.c[0]);
+        } else {
+            R::Initialize(s);
+            R::Transform32(s, counter.c);
+            midstateValid = false;
+        }
+
+        if (match) {
+            __m256i pass = _mm256_cmpeq_epi32(_mm256_and_si256(s[0], match->mask[0]), match->value[0]);
+            for (int i = 1; i < 5; ++i) {
+                pass = _mm256_and_si256(pass, _mm256_cmpeq_epi32(_mm256_and_si256(s[i], match->mask[i]), match->value[i]));
+            }
+            lanes &= _mm256_movemask_ps(_mm256_castsi256_ps(pass));
+        }
+
+        if (!match) {
+            unsigned char *digest[8];
+            for (int i = 0; i < 8; ++i) {
+                digest[i] = (lanes & (1 << i)) ? out + (base + i) * 20 : scratch[i];
+            }
+            StoreDigests(s, digest);
+        } else if (lanes != 0) {
+            alignas(32) uint32_t words[5][8];
+            for (int i = 0; i < 5; ++i) {
+                _mm256_store_si256((__m256i *)words[i], s[i]);
+            }
+            for (int lane = 0; lane < 8; ++lane) {
+                if (lanes & (1 << lane)) {
+                    for (int i = 0; i < 5; ++i) {
+                        memcpy(out + found * 20 + i * 4, &words[i][lane], 4);
+                    }
+                    index[found++] = (uint32_t)(base + lane);
+                }
+            }
+        }
+
+        counter.Next();
+
+        // Bytes 4..31 change when word 0 wraps
+        uint32_t next = low + 8;
+        if (next < low) {
+            midstateValid = false;
+        }
+        low = next;
+    }
+
+    return found;
+}
+
+void ripemd160avx2_counter32(const uint8_t *key, size_t n, uint8_t *out)
+{
+    R::HashCounter32(key, n, out);
+}
+
+void ripemd160avx2x2_counter32(const uint8_t *key, size_t n, uint8_t *out)
+{
+    R2::HashCounter32(key, n, out);
+}
+
+void ripemd160avx2_random32(uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t *out)
+{
+    R::HashRandom32(seed, stream, block, n, out);
+}
+
+void ripemd160avx2x2_random32(uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t *out)
+{
+    R2::HashRandom32(seed, stream, block, n, out);
+}
+
+void ripemd160avx2_counter32_midstate(const uint8_t *key, size_t n, uint8_t *out)
+{
+    HashCounter32Midstate(key, n, nullptr, nullptr, out);
+}
+
+size_t ripemd160avx2_counter32_match(const uint8_t *key, size_t n, const DigestMatch *match,
+                                     uint32_t *index, uint8_t *out)
+{
+    return HashCounter32Midstate(key, n, match, index, out);
+}
+
+// Hash n 32-byte messages stored stride bytes apart, 8 per transform
+void ripemd160avx2_batch(const uint8_t *in, size_t stride, size_t n, uint8_t *out)
+{
+    R::HashStrided(in, stride, n, out);
+}
+
+// Same with two interleaved streams, 16 per transform
+void ripemd160avx2x2_batch(const uint8_t *in, size_t stride, size_t n, uint8_t *out)
+{
+    R2::HashStrided(in, stride, n, out);
+}
+
+Ripemd160x8::Ripemd160x8() {
+    reset();
+}
+
+void Ripemd160x8::reset() {
+    ripemd160avx2::Initialize(state);
     for (int i = 0; i < 8; ++i) {
-        memcpy(bs[i] + 32, pad, 24);           // Pad with 0x80 followed by zeros
-        memcpy(bs[i] + 56, &sizedesc_32, 8);   // Append message length in bits
+        bufferLen[i] = 0;
+        total[i] = 0;
     }
+}
 
-    // Process message blocks
-    ripemd160avx2::Transform(s, bs);
+void Ripemd160x8::process(const uint8_t *blocks[8], int mask) {
+    __m256i prev[5];
 
-#ifndef WIN64
-    uint32_t *s0 = (uint32_t *)&s[0];
-    uint32_t *s1 = (uint32_t *)&s[1];
-    uint32_t *s2 = (uint32_t *)&s[2];
-    uint32_t *s3 = (uint32_t *)&s[3];
-    uint32_t *s4 = (uint32_t *)&s[4];
-#endif
+    for (int i = 0; i < 5; ++i) {
+        prev[i] = state[i];
+    }
+
+    ripemd160avx2::Transform(state, blocks);
+
+    if (mask != 0xFF) {
+        // Restore the lanes that had no block to process
+        const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i active = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(mask), bits), bits);
+        for (int i = 0; i < 5; ++i) {
+            state[i] = _mm256_blendv_epi8(prev[i], state[i], active);
+        }
+    }
+}
+
+void Ripemd160x8::update(const uint8_t *const data[8], const size_t len[8]) {
+    const uint8_t *ptr[8];
+    size_t remaining[8];
+
+    for (int i = 0; i < 8; ++i) {
+        ptr[i] = data[i];
+        remaining[i] = len[i];
+        total[i] += len[i];
+
+        // Top up a partial block first
+        if (bufferLen[i] > 0 && remaining[i] > 0) {
+            size_t n = 64 - bufferLen[i];
+            if (n > remaining[i]) {
+                n = remaining[i];
+            }
+            memcpy(buffer[i] + bufferLen[i], ptr[i], n);
+            bufferLen[i] += n;
+            ptr[i] += n;
+            remaining[i] -= n;
+        }
+    }
+
+    // Compress full blocks, straight from the input when the lane has no partial block
+    for (;;) {
+        const uint8_t *blocks[8];
+        int mask = 0;
+
+        for (int i = 0; i < 8; ++i) {
+            if (bufferLen[i] == 64) {
+                blocks[i] = buffer[i];
+                mask |= 1 << i;
+            } else if (bufferLen[i] == 0 && remaining[i] >= 64) {
+                blocks[i] = ptr[i];
+                mask |= 1 << i;
+            } else {
+                blocks[i] = buffer[i];
+            }
+        }
+
+        if (mask == 0) {
+            break;
+        }
+
+        process(blocks, mask);
+
+        for (int i = 0; i < 8; ++i) {
+            if (!(mask & (1 << i))) {
+                continue;
+            }
+            if (bufferLen[i] == 64) {
+                bufferLen[i] = 0;
+            } else {
+                ptr[i] += 64;
+                remaining[i] -= 64;
+            }
+        }
+    }
+
+    // Keep the tails for the next update
+    for (int i = 0; i < 8; ++i) {
+        if (remaining[i] > 0) {
+            memcpy(buffer[i], ptr[i], remaining[i]);
+            bufferLen[i] = remaining[i];
+        }
+    }
+}
+
+void Ripemd160x8::finalize(unsigned char *const digest[8]) {
+    uint8_t tail[8][128];
+    const uint8_t *blocks[8];
+    int twoBlocks = 0;
+
+    // 0x80, zeros and the little-endian bit length, in one or two blocks
+    for (int i = 0; i < 8; ++i) {
+        size_t n = bufferLen[i];
+        size_t end = (n < 56) ? 64 : 128;
+
+        memcpy(tail[i], buffer[i], n);
+        tail[i][n] = 0x80;
+        memset(tail[i] + n + 1, 0, end - n - 1);
+
+        uint64_t bitLength = total[i] * 8;
+        memcpy(tail[i] + end - 8, &bitLength, 8);
+
+        if (end == 128) {
+            twoBlocks |= 1 << i;
+        }
+        blocks[i] = tail[i];
+    }
+
+    process(blocks, 0xFF);
+
+    if (twoBlocks) {
+        for (int i = 0; i < 8; ++i) {
+            blocks[i] = (twoBlocks & (1 << i)) ? tail[i] + 64 : tail[i];
+        }
+        process(blocks, twoBlocks);
+    }
 
     // Unpack the hash values to the output buffers
-    DEPACK(d0, 7);
-    DEPACK(d1, 6);
-    DEPACK(d2, 5);
-    DEPACK(d3, 4);
-    DEPACK(d4, 3);
-    DEPACK(d5, 2);
-    DEPACK(d6, 1);
-    DEPACK(d7, 0);
+    unsigned char *out[8];
+    for (int i = 0; i < 8; ++i) {
+        out[i] = digest[i];
+    }
+    StoreDigests(state, out);
+
+    reset();
+}
+
+Ripemd160JobManager::Ripemd160JobManager() {
+    ripemd160avx2::Initialize(state);
+    for (int i = 0; i < 8; ++i) {
+        lanes[i] = nullptr;
+        ptr[i] = tail[i];
+        dataBlocks[i] = 0;
+        tailBlocks[i] = 0;
+        tailIndex[i] = 0;
+    }
+    busy = 0;
+    completedHead = 0;
+    completedCount = 0;
+}
+
+Ripemd160Job *Ripemd160JobManager::submit(Ripemd160Job *job) {
+    int lane = 0;
+    while (lanes[lane] != nullptr) {
+        ++lane;
+    }
+
+    // Reset the lane to the initial hash values
+    __m256i init[5];
+    ripemd160avx2::Initialize(init);
+    __m256i laneMask = _mm256_cmpeq_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(lane));
+    for (int i = 0; i < 5; ++i) {
+        state[i] = _mm256_blendv_epi8(state[i], init[i], laneMask);
+    }
+
+    // Full blocks are read in place, the remainder is padded into the lane's tail
+    size_t rem = job->len % 64;
+    size_t end = (rem < 56) ? 64 : 128;
+    if (rem > 0) {
+        memcpy(tail[lane], job->data + job->len - rem, rem);
+    }
+    tail[lane][rem] = 0x80;
+    memset(tail[lane] + rem + 1, 0, end - rem - 1);
+
+    uint64_t bitLength = (uint64_t)job->len * 8;
+    memcpy(tail[lane] + end - 8, &bitLength, 8);
+
+    lanes[lane] = job;
+    ptr[lane] = job->data;
+    dataBlocks[lane] = job->len / 64;
+    tailBlocks[lane] = (int)(end / 64);
+    tailIndex[lane] = 0;
+    ++busy;
+
+    if (busy == 8) {
+        run();
+    }
+
+    if (completedCount == 0) {
+        return nullptr;
+    }
+    Ripemd160Job *done = completed[completedHead];
+    completedHead = (completedHead + 1) % 8;
+    --completedCount;
+    return done;
+}
+
+Ripemd160Job *Ripemd160JobManager::flush() {
+    if (completedCount == 0 && busy > 0) {
+        run();
+    }
+
+    if (completedCount == 0) {
+        return nullptr;
+    }
+    Ripemd160Job *done = completed[completedHead];
+    completedHead = (completedHead + 1) % 8;
+    --completedCount;
+    return done;
+}
+
+void Ripemd160JobManager::run() {
+    // Every busy lane can advance by the smallest block count left
+    uint64_t steps = UINT64_MAX;
+    for (int i = 0; i < 8; ++i) {
+        if (lanes[i] != nullptr && dataBlocks[i] + tailBlocks[i] < steps) {
+            steps = dataBlocks[i] + tailBlocks[i];
+        }
+    }
+
+    for (uint64_t step = 0; step < steps; ++step) {
+        const uint8_t *blocks[8];
+        for (int i = 0; i < 8; ++i) {
+            if (lanes[i] == nullptr) {
+                blocks[i] = tail[i];  // Free lane, its result is discarded
+            } else if (dataBlocks[i] > 0) {
+                blocks[i] = ptr[i];
+                ptr[i] += 64;
+                --dataBlocks[i];
+            } else {
+                blocks[i] = tail[i] + 64 * tailIndex[i];
+                ++tailIndex[i];
+                --tailBlocks[i];
+            }
+        }
+        ripemd160avx2::Transform(state, blocks);
+    }
+
+    // Lanes that ran out of blocks are done
+    unsigned char digest[8][20];
+    unsigned char *out[8];
+    for (int i = 0; i < 8; ++i) {
+        out[i] = digest[i];
+    }
+    StoreDigests(state, out);
+
+    for (int i = 0; i < 8; ++i) {
+        if (lanes[i] == nullptr || dataBlocks[i] + tailBlocks[i] > 0) {
+            continue;
+        }
+        memcpy(lanes[i]->digest, digest[i], 20);
+        completed[(completedHead + completedCount) % 8] = lanes[i];
+        ++completedCount;
+        lanes[i] = nullptr;
+        --busy;
+    }
 }
 
 }  // namespace ripemd160avx2
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
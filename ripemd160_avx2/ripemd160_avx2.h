@@ -2,6 +2,7 @@
 #define RIPEMD160_AVX2_H
 
 #include <immintrin.h>
+#include <cstddef>
 #include <cstdint>
 
 namespace ripemd160avx2 {
@@ -10,15 +11,172 @@ namespace ripemd160avx2 {
 void Initialize(__m256i *state);
 
 // Transform AVX2
-void Transform(__m256i *state, uint8_t *blocks[8]);
+void Transform(__m256i *state, const uint8_t *blocks[8]);
 
-// Hashing functions
+// Two-stream Transform: 16 blocks, two independent 8-lane states interleaved
+// through the same rounds. state[0..4] belongs to blocks[0..7] and
+// state[5..9] to blocks[8..15].
+void Transform2(__m256i *state, const uint8_t *blocks[16]);
+
+// Transform AVX2 on 16 message words already held in registers
+void Transform(__m256i *state, const __m256i *w);
+
+// Transform of one 32-byte message per lane held in registers (w[0..7]),
+// the padding words are folded into the round constants
+void Transform32(__m256i *state, const __m256i *w);
+
+// Midstate for 8 messages of 32 bytes that share every word except w[0]
+// (e.g. little-endian counters that differ only in their lowest byte)
+struct Midstate {
+    __m256i s[5];       // Chaining value the block starts from
+    __m256i right[5];   // Right line after the steps on w[5], w[14], w[7]
+    __m256i w[16];      // Shared message words and padding (w[0] unused)
+};
+
+// Compute the midstate of a 32-byte message, bytes 0..3 are ignored
+void PrepareMidstate32(Midstate *m, const uint8_t *data);
+
+// Transform from a midstate with a per-lane message word 0
+void TransformMidstate(__m256i *state, const Midstate *m, __m256i w0);
+
+// Masked digest search: a lane matches when (state[i] & mask[i]) == value[i]
+// for each digest word i (little-endian words, as in the state)
+struct DigestMatch {
+    __m256i mask[5];
+    __m256i value[5];
+};
+
+// Set up a search for the 20-byte digests d with (d & mask) == (value & mask)
+void PrepareMatch(DigestMatch *match, const uint8_t mask[20], const uint8_t value[20]);
+
+// TransformMidstate for a masked search, the 5 state words of all lanes are
+// compared at once. Returns the mask of matching lanes.
+int TransformMidstateMatch(__m256i *state, const Midstate *m, __m256i w0, const DigestMatch *match);
+
+// Write the 20-byte digest of lane i to digest[i]
+void StoreDigests(const __m256i *state, unsigned char *digest[8]);
+
+// Hash 8 messages of 32 bytes. Only the 32 message bytes are read and the
+// padding is built in registers, so inputs may be read-only and packed.
 void ripemd160avx2_32(
-    unsigned char *i0, unsigned char *i1, unsigned char *i2, unsigned char *i3,
-    unsigned char *i4, unsigned char *i5, unsigned char *i6, unsigned char *i7,
+    const unsigned char *i0, const unsigned char *i1, const unsigned char *i2, const unsigned char *i3,
+    const unsigned char *i4, const unsigned char *i5, const unsigned char *i6, const unsigned char *i7,
     unsigned char *d0, unsigned char *d1, unsigned char *d2, unsigned char *d3,
     unsigned char *d4, unsigned char *d5, unsigned char *d6, unsigned char *d7);
 
+// Length-specialized variant for messages of exactly Len bytes: padding is
+// generated in registers and the inputs are only read. Available for Len = 32.
+template <size_t Len>
+void ripemd160avx2(
+    const unsigned char *i0, const unsigned char *i1, const unsigned char *i2, const unsigned char *i3,
+    const unsigned char *i4, const unsigned char *i5, const unsigned char *i6, const unsigned char *i7,
+    unsigned char *d0, unsigned char *d1, unsigned char *d2, unsigned char *d3,
+    unsigned char *d4, unsigned char *d5, unsigned char *d6, unsigned char *d7);
+
+// Hash 8 messages sharing a midstate, w0[i] is message word 0 (little-endian) of lane i
+void ripemd160avx2_32_midstate(
+    const Midstate *m, const uint32_t w0[8],
+    unsigned char *d0, unsigned char *d1, unsigned char *d2, unsigned char *d3,
+    unsigned char *d4, unsigned char *d5, unsigned char *d6, unsigned char *d7);
+
+// Masked search over 8 messages sharing a midstate: returns the mask of lanes
+// whose digest matches, only their digests are written to digest[i]
+int ripemd160avx2_32_midstate_match(
+    const Midstate *m, const uint32_t w0[8],
+    const DigestMatch *match, unsigned char *digest[8]);
+
+// Hash n messages of 32 bytes stored stride bytes apart (stride >= 32) and write
+// n digests of 20 bytes contiguously to out. Inputs are only read, any n is accepted.
+void ripemd160avx2_batch(const uint8_t *in, size_t stride, size_t n, uint8_t *out);
+
+// Same as ripemd160avx2_batch with the two-stream kernel, 16 messages per transform
+void ripemd160avx2x2_batch(const uint8_t *in, size_t stride, size_t n, uint8_t *out);
+
+// Hash the n consecutive 32-byte keys key, key + 1, ... (little-endian
+// counter, byte 0 lowest) and write n digests of 20 bytes to out. The keys are
+// generated in registers, 8 (16 for x2) per transform.
+void ripemd160avx2_counter32(const uint8_t *key, size_t n, uint8_t *out);
+void ripemd160avx2x2_counter32(const uint8_t *key, size_t n, uint8_t *out);
+
+// Hash the first n random 32-byte keys of a block (see ripemd160_random32)
+void ripemd160avx2_random32(uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t *out);
+void ripemd160avx2x2_random32(uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t *out);
+
+// Same through the midstate: keys sharing bytes 4..31 reuse the right-line head
+void ripemd160avx2_counter32_midstate(const uint8_t *key, size_t n, uint8_t *out);
+
+// Masked search over n counter keys through the midstate. Writes the digests
+// that match and their key offsets (from key) to out and index, which need
+// room for n, and returns how many matched.
+size_t ripemd160avx2_counter32_match(const uint8_t *key, size_t n, const DigestMatch *match,
+                                     uint32_t *index, uint8_t *out);
+
+// Streaming RIPEMD-160 over 8 independent messages of arbitrary length.
+// Lanes may advance at different rates: whenever a lane has a full block it
+// is compressed together with the other ready lanes, idle lanes are masked.
+class Ripemd160x8 {
+public:
+    Ripemd160x8();
+
+    // Start 8 new messages
+    void reset();
+
+    // Append len[i] bytes of data[i] to message i (len[i] = 0 leaves lane i untouched)
+    void update(const uint8_t *const data[8], const size_t len[8]);
+
+    // Pad, process the final block(s) and write 8 digests of 20 bytes, then reset
+    void finalize(unsigned char *const digest[8]);
+
+private:
+    // Compress one block for the lanes set in mask, other lanes keep their state
+    void process(const uint8_t *blocks[8], int mask);
+
+    __m256i state[5];
+    uint8_t buffer[8][64];   // Partial block per message
+    size_t bufferLen[8];
+    uint64_t total[8];       // Message length in bytes per message
+};
+
+// Hash request for Ripemd160JobManager
+struct Ripemd160Job {
+    const uint8_t *data;     // Message (null allowed when len is 0), valid until the job is returned
+    size_t len;              // Message length in bytes
+    unsigned char *digest;   // 20-byte output
+    void *user;              // Caller context, not touched by the manager
+};
+
+// Multi-buffer job manager: jobs of any length share the 8 lanes, each lane
+// completes on its own when its blocks run out and is refilled by the next
+// submit, so callers never have to batch or pad to 8 themselves.
+class Ripemd160JobManager {
+public:
+    Ripemd160JobManager();
+
+    // Place a job in a free lane. When all lanes are busy, compress until at
+    // least one job finishes. Returns a completed job or nullptr.
+    Ripemd160Job *submit(Ripemd160Job *job);
+
+    // Return the next completed job, compressing partially filled batches as
+    // needed. Returns nullptr once every submitted job has been returned.
+    Ripemd160Job *flush();
+
+private:
+    // Compress until at least one busy lane has consumed all its blocks
+    void run();
+
+    __m256i state[5];
+    Ripemd160Job *lanes[8];      // Job per lane, nullptr when free
+    const uint8_t *ptr[8];       // Next full block of the job data
+    uint64_t dataBlocks[8];      // Full data blocks left
+    int tailBlocks[8];           // Padded final blocks left (1 or 2)
+    int tailIndex[8];            // Next padded block to process
+    uint8_t tail[8][128];        // Final padded block(s) per lane
+    int busy;                    // Number of busy lanes
+    Ripemd160Job *completed[8];  // Completed jobs not yet returned (ring)
+    int completedHead;
+    int completedCount;
+};
+
 }  // namespace ripemd160avx2
 
 #endif  // RIPEMD160_AVX2_H
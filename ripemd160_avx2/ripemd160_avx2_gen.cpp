@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cstdio>
 #include <string>
 #include <cstring>
 #include <chrono>
@@ -8,7 +9,24 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <filesystem>
 #include "ripemd160_avx2.h"  // Include the optimized RIPEMD-160 AVX2 header
+#include "ripemd160_dispatch.h"
+#include "../common/target_set.h"
+#include "../common/digest_mask.h"
+#include "../common/vec_random.h"
+#include "../common/work_scheduler.h"
+#include "../common/thread_affinity.h"
+#include "../common/thread_arena.h"
+#include "../common/mapped_file.h"
+#include "../common/stream_pipeline.h"
+#include "../common/result_writer.h"
+#include "../common/hex_codec.h"
+#include "../common/perf_counters.h"
 
 // Function to increment a byte array by a given value
 inline void incrementByteArray(uint8_t* bytes, size_t length, uint64_t increment) {
@@ -22,12 +40,91 @@ inline void incrementByteArray(uint8_t* bytes, size_t length, uint64_t increment
 
 // Function to convert a byte array to a hexadecimal string
 std::string bytesToHexString(const uint8_t* bytes, size_t length) {
-    std::ostringstream oss;
-    oss << std::hex << std::setfill('0');
-    for (size_t i = 0; i < length; ++i) {
-        oss << std::setw(2) << static_cast<int>(bytes[i]);
+    return HexString(bytes, length);
+}
+
+// Hits or matches of all threads in key order, whichever thread found them
+std::vector<std::string> mergeByKey(const std::vector<std::vector<std::pair<uint64_t, std::string>>>& perThread) {
+    std::vector<std::pair<uint64_t, std::string>> all;
+    for (const auto& found : perThread) {
+        all.insert(all.end(), found.begin(), found.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    std::vector<std::string> lines;
+    for (const auto& found : all) {
+        lines.push_back(found.second);
+    }
+    return lines;
+}
+
+// Hash n records of 32 bytes stored back to back
+void hashRecords(const uint8_t* in, size_t n, uint8_t* out) {
+    ripemd160_batch(in, 32, n, out);
+}
+
+// Text records of --stream --hex: 64 hex digits and a newline in, 40 digits
+// and a newline out. Decoded and hashed 256 records at a time.
+bool hashHexRecords(const uint8_t* in, size_t n, uint8_t* out) {
+    const size_t group = 256;
+    uint8_t keys[group * 32];
+    uint8_t digests[group * 20];
+
+    for (size_t first = 0; first < n; first += group) {
+        size_t count = std::min(group, n - first);
+        for (size_t r = 0; r < count; ++r) {
+            const char* text = (const char*)in + (first + r) * 65;
+            if (text[64] != '\n' || !HexDecode(text, 32, keys + r * 32)) {
+                return false;
+            }
+        }
+        hashRecords(keys, count, digests);
+        for (size_t r = 0; r < count; ++r) {
+            char* text = (char*)out + (first + r) * 41;
+            HexEncode(digests + r * 20, 20, text);
+            text[40] = '\n';
+        }
     }
-    return oss.str();
+    return true;
+}
+
+// Hash the recordLen-byte records of inPath into outPath, digest i for record
+// i. The threads take record ranges from the work scheduler and the kernels
+// read them straight from the input mapping and write the digests straight
+// into the output mapping.
+bool hashFile(const std::string& inPath, const std::string& outPath, size_t recordLen, int numThreads,
+              const ThreadAffinity& affinity, uint64_t* records, std::string* error) {
+    MappedFile in;
+    if (!in.openRead(inPath, error)) {
+        return false;
+    }
+    if (in.size() % recordLen != 0) {
+        *error = inPath + " is not a whole number of " + std::to_string(recordLen) + "-byte records";
+        return false;
+    }
+    *records = in.size() / recordLen;
+
+    MappedFile out;
+    if (!out.create(outPath, *records * 20, error)) {
+        return false;
+    }
+
+    omp_set_num_threads(numThreads);
+    WorkScheduler scheduler(*records, numThreads);
+
+    #pragma omp parallel
+    {
+        int threadId = omp_get_thread_num();
+        affinity.pin(threadId);
+
+        uint64_t begin, end;
+        while (scheduler.next(threadId, &begin, &end)) {
+            const uint8_t* src = in.data() + begin * recordLen;
+            uint8_t* dst = out.data() + begin * 20;
+            hashRecords(src, end - begin, dst);
+        }
+    }
+    return true;
 }
 
 // Function to display help message
@@ -35,10 +132,32 @@ void displayHelp() {
     std::cout << "Usage: program [options]\n"
               << "Options:\n"
               << "  -h                Display help information\n"
-              << "  -c <count>        Number of hashes to compute (multiple of 8, default 128)\n"
+              << "  -c <count>        Number of hashes to compute (default 128)\n"
               << "  -t <threads>      Number of threads to use (default is maximum available)\n"
               << "  -s                Save last keys and hashes from each thread to last_hashes.txt\n"
               << "  -i <initial_key>  Specify initial key (64 HEX characters)\n"
+              << "  -r                Random keys (key n is reproducible from the seed and n)\n"
+              << "  --seed <n>        Seed for -r (default: random, printed)\n"
+              << "  --no-midstate     Disable midstate reuse for keys sharing bytes 4..31\n"
+              << "  --save <file>     Write every key and RIPEMD-160 hash to a binary result file\n"
+              << "  --save-hits <file> Write only the --targets hits and --prefix matches to it\n"
+              << "  --profile         Count cycles, instructions, cache and branch misses of the\n"
+              << "                    hashing loop per thread (Linux perf events) and report IPC,\n"
+              << "                    cycles per hash and misses per batch\n"
+              << "  --affinity <cpus> Pin threads: compact (fill a NUMA node first), scatter\n"
+              << "                    (spread over the nodes) or a CPU list such as 0-7,16-23\n"
+              << "  --kernel <name>   Kernel to use: avx512, avx2x2, avx2, sse41 or scalar (default: widest supported, avx2x2 only when given)\n"
+              << "  --file <records>  Hash a binary file of 32-byte messages into --out, 20 bytes\n"
+              << "                    per record\n"
+              << "  --out <digests>   Output file of --file\n"
+              << "  --stream          Hash 32-byte records from stdin into digests on stdout,\n"
+              << "                    the report goes to stderr\n"
+              << "  --hex             Records of --stream are hex lines (64 digits in, 40 out)\n"
+              << "  --targets <file>  Report generated hashes found in a file of hex digests\n"
+              << "                    (one per line)\n"
+              << "  --prefix <hex>    Report hashes starting with these hex digits\n"
+              << "  --mask <hex>      Bit mask over the hash for --prefix (hex from the first\n"
+              << "                    byte, default: every digit given in --prefix)\n"
               << "  --test            Run test cases with known examples\n";
 }
 
@@ -62,53 +181,893 @@ bool runTests() {
     };
 
     bool allPassed = true;
+    bool hasAvx2 = ripemd160_kernel_supported("avx2");
 
     for (const auto& testCase : testCases) {
-        uint8_t keyBytes[64] = {0};  // Ensure buffer is at least 64 bytes
+        uint8_t keyBytes[32] = {0};
         // Convert hex string to byte array
-        for (size_t i = 0; i < 32; ++i) {
-            std::string byteString = testCase.input.substr(i * 2, 2);
-            keyBytes[i] = static_cast<uint8_t>(std::stoul(byteString, nullptr, 16));
-        }
+        HexDecode(testCase.input, 32, keyBytes);
 
-        // Prepare input buffers
-        unsigned char inputBuffers[8][64] = {0};
+        // Prepare input buffers, packed 32 bytes apart
+        unsigned char inputBuffers[8][32];
         for (int i = 0; i < 8; ++i) {
             memcpy(inputBuffers[i], keyBytes, 32);
         }
-        unsigned char* inputs[8];
+
+        unsigned char outputs[8][20];
+
+        ripemd160_batch(inputBuffers[0], 32, 8, outputs[0]);
+
+        bool kernelsMatch = true;
+
+        // The 8-pointer AVX2 entry points
+        if (hasAvx2) {
+            const unsigned char* inputs[8];
+            for (int i = 0; i < 8; ++i) {
+                inputs[i] = inputBuffers[i];
+            }
+
+            unsigned char outputsAvx2[8][20];
+
+            ripemd160avx2::ripemd160avx2_32(
+                inputs[0], inputs[1], inputs[2], inputs[3],
+                inputs[4], inputs[5], inputs[6], inputs[7],
+                outputsAvx2[0], outputsAvx2[1], outputsAvx2[2], outputsAvx2[3],
+                outputsAvx2[4], outputsAvx2[5], outputsAvx2[6], outputsAvx2[7]
+            );
+            kernelsMatch = kernelsMatch && memcmp(outputs, outputsAvx2, sizeof(outputs)) == 0;
+
+            // Length-specialized kernel on the unpadded 32-byte key
+            ripemd160avx2::ripemd160avx2<32>(
+                keyBytes, keyBytes, keyBytes, keyBytes,
+                keyBytes, keyBytes, keyBytes, keyBytes,
+                outputsAvx2[0], outputsAvx2[1], outputsAvx2[2], outputsAvx2[3],
+                outputsAvx2[4], outputsAvx2[5], outputsAvx2[6], outputsAvx2[7]
+            );
+            kernelsMatch = kernelsMatch && memcmp(outputs, outputsAvx2, sizeof(outputs)) == 0;
+        }
+
+        // The inputs are only read
+        bool inputsIntact = true;
+        for (int i = 0; i < 8; ++i) {
+            if (memcmp(inputBuffers[i], keyBytes, 32) != 0) {
+                inputsIntact = false;
+            }
+        }
+
+        std::string hashHex = bytesToHexString(outputs[0], 20);
+        if (hashHex != testCase.expectedHash || !kernelsMatch || !inputsIntact) {
+            std::cout << "Test failed for input: " << testCase.input << "\n"
+                      << "Expected: " << testCase.expectedHash << "\n"
+                      << "Got:      " << hashHex << "\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for input: " << testCase.input << "\n";
+        }
+    }
+
+    // Every supported kernel on a count that leaves a partial group, which the
+    // narrower kernels pick up
+    {
+        const char* initialKernel = ripemd160_kernel();
+        const char* kernelNames[] = { "avx512", "avx2x2", "avx2", "sse41", "scalar" };
+        const size_t count = 37;
+
+        std::vector<uint8_t> keys(count * 32);
+        for (size_t i = 0; i < count; ++i) {
+            HexDecode(testCases[i % testCases.size()].input, 32, keys.data() + i * 32);
+        }
+
+        // Counter keys from a key whose carry runs up to byte 31 within the count
+        uint8_t counterKey[32];
+        memset(counterKey, 0xFF, 32);
+        counterKey[0] = 0xE9;
+        counterKey[31] = 0x03;
+        std::vector<uint8_t> counterKeys(count * 32);
+        for (size_t i = 0; i < count; ++i) {
+            memcpy(counterKeys.data() + i * 32, counterKey, 32);
+            incrementByteArray(counterKeys.data() + i * 32, 32, i);
+        }
+        std::vector<unsigned char> counterExpected(count * 20);
+        ripemd160scalar_batch(counterKeys.data(), 32, count, counterExpected.data());
+
+        // Random keys from the middle of a stream, across a block boundary
+        const uint64_t randomFirst = 3 * kRandomBlock;
+        const size_t randomCount = kRandomBlock + count;
+        std::vector<uint8_t> randomKeys(randomCount * 32);
+        for (size_t i = 0; i < randomCount; ++i) {
+            ripemd160_random_key(42, 7, randomFirst + i, randomKeys.data() + i * 32);
+        }
+        std::vector<unsigned char> randomExpected(randomCount * 20);
+        ripemd160scalar_batch(randomKeys.data(), 32, randomCount, randomExpected.data());
+
+        for (const char* name : kernelNames) {
+            if (!ripemd160_select_kernel(name)) {
+                std::cout << "Skipping kernel " << name << " (not supported)\n";
+                continue;
+            }
+
+            std::vector<unsigned char> outputs(count * 20);
+            ripemd160_batch(keys.data(), 32, count, outputs.data());
+
+            std::vector<unsigned char> outputsCounter(count * 20);
+            ripemd160_counter32(counterKey, count, outputsCounter.data());
+
+            std::vector<unsigned char> outputsRandom(randomCount * 20);
+            ripemd160_random32(42, 7, randomFirst, randomCount, outputsRandom.data());
+
+            bool kernelPassed = outputsCounter == counterExpected && outputsRandom == randomExpected;
+            for (size_t i = 0; i < count; ++i) {
+                if (bytesToHexString(outputs.data() + i * 20, 20) != testCases[i % testCases.size()].expectedHash) {
+                    kernelPassed = false;
+                }
+            }
+
+            if (!kernelPassed) {
+                std::cout << "Test failed for kernel " << name << "\n";
+                allPassed = false;
+            } else {
+                std::cout << "Test passed for kernel " << name << " (" << count << " messages)\n";
+            }
+        }
+
+        ripemd160_select_kernel(initialKernel);
+    }
+
+    // Random keys: reference outputs of xoshiro128** from the state {1, 2, 3, 4},
+    // and distinct keys from neighbouring lanes, blocks and streams
+    {
+        uint32_t state[4] = { 1, 2, 3, 4 };
+        bool randomPassed = RandomNext(state) == 11520 && RandomNext(state) == 0 && RandomNext(state) == 5927040;
+
+        uint8_t keys[4][32];
+        ripemd160_random_key(1, 0, 0, keys[0]);
+        ripemd160_random_key(1, 0, 1, keys[1]);
+        ripemd160_random_key(1, 0, kRandomBlock, keys[2]);
+        ripemd160_random_key(1, 1, 0, keys[3]);
+        for (int a = 0; a < 4; ++a) {
+            for (int b = a + 1; b < 4; ++b) {
+                if (memcmp(keys[a], keys[b], 32) == 0) {
+                    randomPassed = false;
+                }
+            }
+        }
+
+
+        // Batch of keys across a block boundary against single keys
+        std::vector<uint8_t> batch(300 * 32);
+        ripemd160_random_keys(1, 0, kRandomBlock, 300, batch.data());
+        for (size_t r = 0; r < 300; ++r) {
+            uint8_t key[32];
+            ripemd160_random_key(1, 0, kRandomBlock + r, key);
+            if (memcmp(key, batch.data() + r * 32, 32) != 0) {
+                randomPassed = false;
+            }
+        }
+
+        if (!randomPassed) {
+            std::cout << "Test failed for random keys\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for random keys\n";
+        }
+    }
+
+    // Target set: every inserted digest is found among random ones, with the
+    // AVX2 and the scalar filter probe
+    {
+        const size_t digestLen = 20;
+        const size_t count = 4099;
+        std::vector<uint8_t> digests(count * digestLen);
+        uint64_t x = 0x9E3779B97F4A7C15ull;
+        for (size_t i = 0; i < digests.size(); ++i) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            digests[i] = static_cast<uint8_t>(x >> 56);
+        }
+
+        // Every 97th digest is a known-answer hash from the test cases
+        TargetSet targets(digestLen);
+        std::vector<uint32_t> expected;
+        for (size_t i = 0; i < count; i += 97) {
+            HexDecode(testCases[(i / 97) % testCases.size()].expectedHash, digestLen, digests.data() + i * digestLen);
+            targets.add(digests.data() + i * digestLen);
+            expected.push_back(static_cast<uint32_t>(i));
+        }
+        targets.build();
+
+        bool targetsPassed = true;
+        for (int pass = 0; pass < 2; ++pass) {
+            if (pass == 1) {
+                targets.selectScalarProbe();
+            }
+
+            std::vector<uint32_t> hits(count);
+            size_t hitCount = targets.probe(digests.data(), digestLen, count, hits.data());
+            hits.resize(hitCount);
+            if (hits != expected) {
+                targetsPassed = false;
+            }
+        }
+
+        // A copy with its filter in a thread arena finds the same hits
+        ThreadArena arena(targets.filterBytes());
+        TargetSet local(targets, arena.alloc(targets.filterBytes()));
+        std::vector<uint32_t> localHits(count);
+        localHits.resize(local.probe(digests.data(), digestLen, count, localHits.data()));
+        if (localHits != expected) {
+            targetsPassed = false;
+        }
+
+        if (!targetsPassed) {
+            std::cout << "Test failed for target set\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for target set (" << expected.size() << " hits in " << count << " digests)\n";
+        }
+    }
+
+    {
+        // File mode: records written through a mapping and hashed by 3 threads
+        // into a mapped output file, against the batch API
+        const size_t count = 3000 + 7;
+        std::filesystem::path dir = std::filesystem::temp_directory_path();
+        std::string inPath = (dir / "ripemd160_file_test.in").string();
+        std::string outPath = (dir / "ripemd160_file_test.out").string();
+
+        std::vector<uint8_t> records(count * 32);
+        for (size_t i = 0; i < records.size(); ++i) {
+            records[i] = static_cast<uint8_t>(i * 131 + (i >> 8));
+        }
+        std::vector<uint8_t> expected(count * 20);
+        ripemd160_batch(records.data(), 32, count, expected.data());
+
+        std::string error;
+        uint64_t hashed = 0;
+        ThreadAffinity affinity;
+        bool filePassed = false;
+        {
+            MappedFile in;
+            if (in.create(inPath, records.size(), &error)) {
+                memcpy(in.data(), records.data(), records.size());
+                in.close();
+                MappedFile out;
+                filePassed = hashFile(inPath, outPath, 32, 3, affinity, &hashed, &error) && hashed == count &&
+                             out.openRead(outPath, &error) && out.size() == expected.size() &&
+                             memcmp(out.data(), expected.data(), expected.size()) == 0;
+            }
+
+            // A partial record is refused
+            if (filePassed && in.create(inPath, 32 + 1, &error)) {
+                in.close();
+                filePassed = !hashFile(inPath, outPath, 32, 3, affinity, &hashed, &error);
+            }
+        }
+        std::remove(inPath.c_str());
+        std::remove(outPath.c_str());
+
+        if (!filePassed) {
+            std::cout << "Test failed for file mode" << (error.empty() ? "" : ": " + error) << "\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for file mode (" << count << " records)\n";
+        }
+    }
+
+    {
+        // Stream mode: 3007 records through 31 slabs of 100 on 3 workers, the
+        // digests must come out in input order
+        const size_t count = 3000 + 7;
+        std::vector<uint8_t> records(count * 32);
+        for (size_t i = 0; i < records.size(); ++i) {
+            records[i] = static_cast<uint8_t>(i * 167 + (i >> 9));
+        }
+        auto hash32 = [](const uint8_t* in, size_t n, uint8_t* out) {
+            hashRecords(in, n, out);
+            return true;
+        };
+        std::vector<uint8_t> expected(count * 20);
+        hashRecords(records.data(), count, expected.data());
+
+        std::string error;
+        uint64_t hashed = 0;
+        ThreadAffinity affinity;
+        StreamPipeline pipeline(32, 20, 100);
+        bool streamPassed = false;
+
+        FILE* in = std::tmpfile();
+        FILE* out = std::tmpfile();
+        if (in != nullptr && out != nullptr) {
+            fwrite(records.data(), 1, records.size(), in);
+            fflush(in);
+            fseek(in, 0, SEEK_SET);
+            std::vector<uint8_t> digests(expected.size() + 1);
+            streamPassed = pipeline.run(fileno(in), fileno(out), 3, affinity, hash32, &hashed, &error) &&
+                           hashed == count && fseek(out, 0, SEEK_SET) == 0 &&
+                           fread(digests.data(), 1, digests.size(), out) == expected.size() &&
+                           memcmp(digests.data(), expected.data(), expected.size()) == 0;
+
+            // A partial record is refused
+            fseek(in, 32 + 1, SEEK_SET);
+            streamPassed = streamPassed && !pipeline.run(fileno(in), fileno(out), 3, affinity, hash32, &hashed, &error);
+        }
+        if (in != nullptr) {
+            fclose(in);
+        }
+        if (out != nullptr) {
+            fclose(out);
+        }
+
+        if (!streamPassed) {
+            std::cout << "Test failed for stream mode" << (error.empty() ? "" : ": " + error) << "\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for stream mode (" << count << " records)\n";
+        }
+    }
+
+    {
+        // Hex codec: the AVX2 and scalar code against a printf reference on
+        // every length up to 100 bytes (whole 16-byte steps and tails), upper
+        // case accepted, every non-hex character refused at every position
+        bool hexPassed = true;
+        std::vector<uint8_t> bytes(100), decoded(100);
+        for (size_t i = 0; i < bytes.size(); ++i) {
+            bytes[i] = static_cast<uint8_t>(i * 73 + 29);
+        }
+        for (int scalar = 0; scalar < 2; ++scalar) {
+            HexSelectScalar(scalar != 0);
+            for (size_t n = 0; n <= bytes.size(); ++n) {
+                std::string reference;
+                char digits[3];
+                for (size_t i = 0; i < n; ++i) {
+                    snprintf(digits, sizeof(digits), "%02x", bytes[i]);
+                    reference += digits;
+                }
+                std::string upper = reference;
+                std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+                hexPassed = hexPassed && HexString(bytes.data(), n) == reference &&
+                            HexDecode(upper, n, decoded.data()) && std::equal(decoded.begin(), decoded.begin() + n, bytes.begin());
+            }
+            std::string text = HexString(bytes.data(), 40);
+            for (size_t at = 0; at < text.size(); ++at) {
+                for (char bad : { 'g', 'G', '/', ':', '@', '`', ' ', '\0', '\x80', '\xb0', '\xe1' }) {
+                    std::string broken = text;
+                    broken[at] = bad;
+                    hexPassed = hexPassed && !HexDecode(broken, 40, decoded.data());
+                }
+            }
+        }
+        HexSelectScalar(false);
+
+        // Hex lines of --stream --hex, a bad digit or a missing newline is refused
+        const size_t count = 300;
+        std::vector<uint8_t> keys(count * 32), expected(count * 20);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            keys[i] = static_cast<uint8_t>(i * 151 + 3);
+        }
+        hashRecords(keys.data(), count, expected.data());
+        std::string lines, expectedLines;
+        for (size_t i = 0; i < count; ++i) {
+            lines += bytesToHexString(keys.data() + i * 32, 32) + "\n";
+            expectedLines += bytesToHexString(expected.data() + i * 20, 20) + "\n";
+        }
+        std::string out(count * 41, ' ');
+        hexPassed = hexPassed && hashHexRecords((const uint8_t*)lines.data(), count, (uint8_t*)&out[0]) && out == expectedLines;
+        lines[280 * 65 + 5] = 'x';
+        hexPassed = hexPassed && !hashHexRecords((const uint8_t*)lines.data(), count, (uint8_t*)&out[0]);
+        lines[280 * 65 + 5] = '0';
+        lines[280 * 65 + 64] = ' ';
+        hexPassed = hexPassed && !hashHexRecords((const uint8_t*)lines.data(), count, (uint8_t*)&out[0]);
+
+        if (!hexPassed) {
+            std::cout << "Test failed for hex codec\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for hex codec (" << (hasAvx2 ? "avx2 and scalar" : "scalar") << ")\n";
+        }
+    }
+
+    {
+        // Result file: 2 threads append through blocks of 13 records, each
+        // record must be saved once after the header
+        const size_t count = 5000;
+        std::string path = (std::filesystem::temp_directory_path() / "ripemd160_result_test.bin").string();
+        ResultHeader header = {};
+        memcpy(header.magic, "HASHRES1", 8);
+        header.algorithm = ResultHeader::kRipemd160;
+        header.keyLen = 32;
+        header.digestLen = 20;
+        header.threads = 2;
+        header.count = count;
+
+        std::string error;
+        ResultWriter writer(2, 32, 20, 13 * 60, 3);
+        bool resultPassed = writer.open(path, header, &error);
+        if (resultPassed) {
+            #pragma omp parallel num_threads(2)
+            {
+                int t = omp_get_thread_num();
+                for (size_t r = t; r < count; r += 2) {
+                    uint8_t key[32];
+                    uint8_t digest[20];
+                    memset(key, static_cast<int>(r & 0xFF), sizeof(key));
+                    memset(digest, static_cast<int>((r * 7) & 0xFF), sizeof(digest));
+                    writer.append(t, r, key, digest);
+                }
+                writer.flush(t);
+            }
+            resultPassed = writer.close(&error) && writer.records() == count;
+        }
+
+        std::ifstream in(path, std::ios::binary);
+        std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        std::remove(path.c_str());
+
+        resultPassed = resultPassed && data.size() == sizeof(header) + count * 60 &&
+                       memcmp(data.data(), &header, sizeof(header)) == 0;
+        std::vector<int> seen(count, 0);
+        for (size_t offset = sizeof(header); resultPassed && offset < data.size(); offset += 60) {
+            const uint8_t* record = reinterpret_cast<const uint8_t*>(data.data()) + offset;
+            uint64_t index = 0;
+            for (int b = 0; b < 8; ++b) {
+                index |= static_cast<uint64_t>(record[b]) << (8 * b);
+            }
+            resultPassed = index < count && seen[index]++ == 0 && record[8] == static_cast<uint8_t>(index) &&
+                           record[8 + 32] == static_cast<uint8_t>(index * 7);
+        }
+
+        if (!resultPassed) {
+            std::cout << "Test failed for result file" << (error.empty() ? "" : ": " + error) << "\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for result file (" << count << " records)\n";
+        }
+    }
+
+    if (!hasAvx2) {
+        std::cout << "Skipping the AVX2 tests (not supported)\n";
+        return allPassed;
+    }
+
+    // Streaming context: 8 messages of different lengths fed in uneven chunks
+    {
+        std::vector<std::string> messages = {
+            "",
+            "a",
+            "abc",
+            "message digest",
+            "abcdefghijklmnopqrstuvwxyz",
+            "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+            std::string(1000000, 'a')
+        };
+        const char* expectedHashes[8] = {
+            "9c1185a5c5e9fc54612808977ee8f548b2258d31",
+            "0bdc9d2d256b3ee9daae347be6f4dc835a467ffe",
+            "8eb208f7e05d987a9b044a8e98c6b087f15a0bfc",
+            "5d0689ef49d2fae572b881b123a85ffa21595f36",
+            "f71c27109c692c1b56bbdceb5b9d2865b3708dbc",
+            "12a053384a9c0c88e405a06c27dcf49ada62eb2b",
+            "b0e20b6e3116640286ed3a87a5713079b21f5189",
+            "52783243c1697bdbe16d37f97f68f08325dc1528"
+        };
+
+        ripemd160avx2::Ripemd160x8 ctx;
+        size_t offset[8] = {0};
+        for (size_t chunk = 1; ; chunk = chunk * 3 + 1) {
+            const uint8_t* data[8];
+            size_t len[8];
+            bool done = true;
+            for (int i = 0; i < 8; ++i) {
+                size_t n = std::min(chunk + i, messages[i].size() - offset[i]);
+                data[i] = reinterpret_cast<const uint8_t*>(messages[i].data()) + offset[i];
+                len[i] = n;
+                offset[i] += n;
+                done = done && offset[i] == messages[i].size();
+            }
+            ctx.update(data, len);
+            if (done) {
+                break;
+            }
+        }
+
+        unsigned char outputs[8][20];
+        unsigned char* digests[8];
+        for (int i = 0; i < 8; ++i) {
+            digests[i] = outputs[i];
+        }
+        ctx.finalize(digests);
+
+        for (int i = 0; i < 8; ++i) {
+            std::string hashHex = bytesToHexString(outputs[i], 20);
+            if (hashHex != expectedHashes[i]) {
+                std::cout << "Test failed for streaming lane " << i << "\n"
+                          << "Expected: " << expectedHashes[i] << "\n"
+                          << "Got:      " << hashHex << "\n";
+                allPassed = false;
+            } else {
+                std::cout << "Test passed for streaming lane " << i << " (" << messages[i].size() << " bytes)\n";
+            }
+        }
+    }
+
+    // Job manager: jobs of mixed lengths must match the streaming context
+    {
+        const size_t lengths[] = { 0, 1, 32, 55, 56, 63, 64, 65, 119, 120, 128, 200, 1000, 4096, 100000, 3, 777, 64, 31, 512 };
+        const int jobCount = sizeof(lengths) / sizeof(lengths[0]);
+
+        std::vector<std::vector<uint8_t>> messages(jobCount);
+        std::vector<std::vector<unsigned char>> digests(jobCount, std::vector<unsigned char>(20));
+        std::vector<ripemd160avx2::Ripemd160Job> jobs(jobCount);
+        for (int i = 0; i < jobCount; ++i) {
+            messages[i].resize(lengths[i]);
+            for (size_t j = 0; j < lengths[i]; ++j) {
+                messages[i][j] = static_cast<uint8_t>(j * 31 + i);
+            }
+            // Empty messages are submitted without data
+            jobs[i] = { lengths[i] > 0 ? messages[i].data() : nullptr, lengths[i], digests[i].data(), &messages[i] };
+        }
+
+        ripemd160avx2::Ripemd160JobManager manager;
+        std::vector<int> returned(jobCount, 0);
+        for (int i = 0; i < jobCount; ++i) {
+            ripemd160avx2::Ripemd160Job* done = manager.submit(&jobs[i]);
+            if (done != nullptr) {
+                returned[done - jobs.data()]++;
+            }
+        }
+        while (ripemd160avx2::Ripemd160Job* done = manager.flush()) {
+            returned[done - jobs.data()]++;
+        }
+
+        bool jobsPassed = true;
+        for (int i = 0; i < jobCount; i += 8) {
+            ripemd160avx2::Ripemd160x8 ctx;
+            const uint8_t* data[8];
+            size_t len[8];
+            unsigned char outputs[8][20];
+            unsigned char* hashes[8];
+            for (int j = 0; j < 8; ++j) {
+                int k = std::min(i + j, jobCount - 1);
+                data[j] = messages[k].data();
+                len[j] = lengths[k];
+                hashes[j] = outputs[j];
+            }
+            ctx.update(data, len);
+            ctx.finalize(hashes);
+            for (int j = 0; j < 8 && i + j < jobCount; ++j) {
+                if (returned[i + j] != 1 || memcmp(outputs[j], digests[i + j].data(), 20) != 0) {
+                    jobsPassed = false;
+                }
+            }
+        }
+
+        if (!jobsPassed) {
+            std::cout << "Test failed for job manager\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for job manager (" << jobCount << " jobs)\n";
+        }
+    }
+
+    // Two-stream transform must match two single-stream transforms
+    {
+        uint8_t blocks[16][64];
+        const uint8_t* data[16];
+        for (int i = 0; i < 16; ++i) {
+            for (int j = 0; j < 64; ++j) {
+                blocks[i][j] = static_cast<uint8_t>(i * 31 + j * 7);
+            }
+            data[i] = blocks[i];
+        }
+
+        __m256i state2[10];
+        ripemd160avx2::Initialize(state2);
+        ripemd160avx2::Initialize(state2 + 5);
+        ripemd160avx2::Transform2(state2, data);
+
+        __m256i state[10];
+        ripemd160avx2::Initialize(state);
+        ripemd160avx2::Initialize(state + 5);
+        ripemd160avx2::Transform(state, data);
+        ripemd160avx2::Transform(state + 5, data + 8);
+
+        if (memcmp(state, state2, sizeof(state)) != 0) {
+            std::cout << "Test failed for two-stream transform\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for two-stream transform\n";
+        }
+    }
+
+    // Midstate path must match the full transform for 8 consecutive keys
+    {
+        unsigned char inputBuffers[8][32];
+        const unsigned char* inputs[8];
+        uint32_t w0[8];
         for (int i = 0; i < 8; ++i) {
+            for (int j = 0; j < 32; ++j) {
+                inputBuffers[i][j] = static_cast<uint8_t>(j * 7 + 3);
+            }
+            inputBuffers[i][0] = static_cast<uint8_t>(0xF0 + i);
             inputs[i] = inputBuffers[i];
+            memcpy(&w0[i], inputBuffers[i], 4);
         }
 
+        unsigned char expected[8][20];
         unsigned char outputs[8][20];
 
         ripemd160avx2::ripemd160avx2_32(
             inputs[0], inputs[1], inputs[2], inputs[3],
             inputs[4], inputs[5], inputs[6], inputs[7],
+            expected[0], expected[1], expected[2], expected[3],
+            expected[4], expected[5], expected[6], expected[7]
+        );
+
+        ripemd160avx2::Midstate midstate;
+        ripemd160avx2::PrepareMidstate32(&midstate, inputBuffers[0]);
+        ripemd160avx2::ripemd160avx2_32_midstate(
+            &midstate, w0,
             outputs[0], outputs[1], outputs[2], outputs[3],
             outputs[4], outputs[5], outputs[6], outputs[7]
         );
 
-        std::string hashHex = bytesToHexString(outputs[0], 20);
-        if (hashHex != testCase.expectedHash) {
-            std::cout << "Test failed for input: " << testCase.input << "\n"
-                      << "Expected: " << testCase.expectedHash << "\n"
-                      << "Got:      " << hashHex << "\n";
+        if (memcmp(expected, outputs, sizeof(outputs)) != 0) {
+            std::cout << "Test failed for midstate reuse\n";
             allPassed = false;
         } else {
-            std::cout << "Test passed for input: " << testCase.input << "\n";
+            std::cout << "Test passed for midstate reuse\n";
+        }
+
+        // Masked search: 24-bit prefix of lane 5, 24 bits of the last word of
+        // lane 2 and a prefix no lane has
+        struct MaskCase { std::string prefix, mask; };
+        std::string flipped = bytesToHexString(expected[0], 4);
+        flipped[0] = flipped[0] == 'f' ? '0' : 'f';
+        const MaskCase maskCases[3] = {
+            { bytesToHexString(expected[5], 3), "" },
+            { std::string(32, '0') + bytesToHexString(expected[2] + 16, 3), std::string(32, '0') + "ffffff" },
+            { flipped, "" },
+        };
+        const int maskLanes[3] = { 5, 2, -1 };
+
+        bool matchPassed = true;
+        for (int c = 0; c < 3; ++c) {
+            DigestMask digestMask;
+            if (!ParseDigestMask(&digestMask, 20, maskCases[c].prefix, maskCases[c].mask)) {
+                matchPassed = false;
+                continue;
+            }
+            ripemd160avx2::DigestMatch match;
+            ripemd160avx2::PrepareMatch(&match, digestMask.mask, digestMask.value);
+
+            unsigned char found[8][20] = {};
+            unsigned char* foundPtr[8] = { found[0], found[1], found[2], found[3], found[4], found[5], found[6], found[7] };
+            int lanes = ripemd160avx2::ripemd160avx2_32_midstate_match(&midstate, w0, &match, foundPtr);
+
+            int expectedLanes = 0;
+            for (int j = 0; j < 8; ++j) {
+                if (DigestMatches(&digestMask, expected[j])) {
+                    expectedLanes |= 1 << j;
+                    if (memcmp(found[j], expected[j], 20) != 0) {
+                        matchPassed = false;
+                    }
+                }
+            }
+            if (lanes != expectedLanes || (maskLanes[c] >= 0 && !(lanes & (1 << maskLanes[c])))) {
+                matchPassed = false;
+            }
+        }
+
+        if (!matchPassed) {
+            std::cout << "Test failed for masked search\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for masked search\n";
+        }
+    }
+
+    // Counter keys through the midstate, starting off a multiple of 8 so that
+    // groups straddle changes of bytes 4..31, plus a masked search over them
+    {
+        const size_t count = 601;
+        uint8_t counterKey[32] = {0xF3, 0xFF, 0xFF, 0xFF, 0xFE};
+        counterKey[31] = 0x02;
+
+        std::vector<uint8_t> keys(count * 32);
+        for (size_t i = 0; i < count; ++i) {
+            memcpy(keys.data() + i * 32, counterKey, 32);
+            incrementByteArray(keys.data() + i * 32, 32, i);
+        }
+        std::vector<unsigned char> expected(count * 20);
+        ripemd160scalar_batch(keys.data(), 32, count, expected.data());
+
+        std::vector<unsigned char> outputs(count * 20);
+        ripemd160avx2::ripemd160avx2_counter32_midstate(counterKey, count, outputs.data());
+        bool counterPassed = outputs == expected;
+
+        DigestMask digestMask;
+        ParseDigestMask(&digestMask, 20, "a", "");
+        ripemd160avx2::DigestMatch match;
+        ripemd160avx2::PrepareMatch(&match, digestMask.mask, digestMask.value);
+
+        std::vector<uint32_t> index(count);
+        std::vector<unsigned char> found(count * 20);
+        size_t foundCount = ripemd160avx2::ripemd160avx2_counter32_match(counterKey, count, &match, index.data(), found.data());
+
+        size_t expectedCount = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (DigestMatches(&digestMask, expected.data() + i * 20)) {
+                if (expectedCount >= foundCount || index[expectedCount] != i ||
+                    memcmp(found.data() + expectedCount * 20, expected.data() + i * 20, 20) != 0) {
+                    counterPassed = false;
+                }
+                ++expectedCount;
+            }
+        }
+        if (expectedCount != foundCount || expectedCount == 0) {
+            counterPassed = false;
+        }
+
+        if (!counterPassed) {
+            std::cout << "Test failed for midstate counter\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for midstate counter (" << count << " keys, " << foundCount << " matches)\n";
+        }
+    }
+
+    // Strided batch API: any count, packed and spaced 32-byte messages
+    {
+        const size_t count = 21;
+        const size_t stride = 40;
+        std::vector<uint8_t> spaced(count * stride, 0);
+        std::vector<uint8_t> packed(count * 32);
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t j = 0; j < 32; ++j) {
+                packed[i * 32 + j] = static_cast<uint8_t>(j * 13 + i);
+            }
+            memcpy(spaced.data() + i * stride, packed.data() + i * 32, 32);
+        }
+
+        std::vector<unsigned char> outputs(count * 20);
+        std::vector<unsigned char> outputsSpaced(count * 20);
+        ripemd160avx2::ripemd160avx2_batch(packed.data(), 32, count, outputs.data());
+        ripemd160avx2::ripemd160avx2_batch(spaced.data(), stride, count, outputsSpaced.data());
+
+        bool batchPassed = true;
+        for (size_t i = 0; i < count; i += 8) {
+            const unsigned char* inputs[8];
+            unsigned char expected[8][20];
+            for (size_t j = 0; j < 8; ++j) {
+                inputs[j] = packed.data() + std::min(i + j, count - 1) * 32;
+            }
+            ripemd160avx2::ripemd160avx2<32>(
+                inputs[0], inputs[1], inputs[2], inputs[3],
+                inputs[4], inputs[5], inputs[6], inputs[7],
+                expected[0], expected[1], expected[2], expected[3],
+                expected[4], expected[5], expected[6], expected[7]
+            );
+            for (size_t j = 0; j < 8 && i + j < count; ++j) {
+                if (memcmp(expected[j], outputs.data() + (i + j) * 20, 20) != 0 ||
+                    memcmp(expected[j], outputsSpaced.data() + (i + j) * 20, 20) != 0) {
+                    batchPassed = false;
+                }
+            }
+        }
+
+        if (!batchPassed) {
+            std::cout << "Test failed for strided batch\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for strided batch (" << count << " messages)\n";
         }
     }
 
     return allPassed;
 }
 
+// Hash a file of records into a file of digests
+int runFile(const std::string& inPath, const std::string& outPath, size_t recordLen, int numThreads,
+            const ThreadAffinity& affinity) {
+    std::cout << "Number of threads                  : " << numThreads << "\n";
+    if (affinity.enabled()) {
+        std::cout << "Thread affinity                    : " << affinity.describe() << "\n";
+    }
+    std::cout << "Kernel                             : " << ripemd160_kernel() << " (" << ripemd160_kernel_lanes() << " lanes)\n";
+
+    auto totalStart = std::chrono::high_resolution_clock::now();
+
+    uint64_t records = 0;
+    std::string error;
+    if (!hashFile(inPath, outPath, recordLen, numThreads, affinity, &records, &error)) {
+        std::cerr << "Error: " << error << ".\n";
+        return 1;
+    }
+
+    auto totalEnd = std::chrono::high_resolution_clock::now();
+
+    // Mapping, hashing and unmapping, the written pages are flushed later
+    auto totalDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(totalEnd - totalStart).count();
+    double totalSeconds = totalDuration / 1e9;
+    double avgHashTime = records > 0 ? totalDuration / static_cast<double>(records) : 0;
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Records hashed                     : " << records << "\n";
+    std::cout << "Total execution time      (seconds): " << totalSeconds << "\n";
+    std::cout << "Average time per hash (nanoseconds): " << avgHashTime << "\n";
+    std::cout << "Input read              (MB/second): " << records * recordLen / 1e6 / totalSeconds << "\n";
+
+    return 0;
+}
+
+// Hash records from stdin into digests on stdout, the report goes to stderr
+int runStream(size_t recordLen, bool hex, int numThreads, const ThreadAffinity& affinity) {
+    std::cerr << "Number of threads                  : " << numThreads << "\n";
+    if (affinity.enabled()) {
+        std::cerr << "Thread affinity                    : " << affinity.describe() << "\n";
+    }
+    std::cerr << "Kernel                             : " << ripemd160_kernel() << " (" << ripemd160_kernel_lanes() << " lanes)\n";
+
+    auto totalStart = std::chrono::high_resolution_clock::now();
+
+    // Hex records are lines of text around the same binary kernels
+    size_t inLen = hex ? 2 * recordLen + 1 : recordLen;
+    StreamPipeline pipeline(inLen, hex ? 41 : 20);
+    auto hash = [hex](const uint8_t* in, size_t n, uint8_t* out) {
+        if (hex) {
+            return hashHexRecords(in, n, out);
+        }
+        hashRecords(in, n, out);
+        return true;
+    };
+    uint64_t records = 0;
+    std::string error;
+    if (!pipeline.run(fileno(stdin), fileno(stdout), numThreads, affinity, hash, &records, &error)) {
+        std::cerr << "Error: " << error << ".\n";
+        return 1;
+    }
+
+    auto totalEnd = std::chrono::high_resolution_clock::now();
+
+    auto totalDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(totalEnd - totalStart).count();
+    double totalSeconds = totalDuration / 1e9;
+    double avgHashTime = records > 0 ? totalDuration / static_cast<double>(records) : 0;
+
+    std::cerr << std::fixed << std::setprecision(2);
+    std::cerr << "Records hashed                     : " << records << "\n";
+    std::cerr << "Total execution time      (seconds): " << totalSeconds << "\n";
+    std::cerr << "Average time per hash (nanoseconds): " << avgHashTime << "\n";
+    std::cerr << "Input read              (MB/second): " << records * inLen / 1e6 / totalSeconds << "\n";
+
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     uint64_t hashCount = 128;  // Default number of hashes
     int numThreads = omp_get_max_threads();  // Default number of threads
     bool saveLastHashes = false;
     bool testMode = false;
+    bool useMidstate = true;
+    std::string kernelName;
+    std::string targetsPath;
+    std::string prefixHex;
+    std::string maskHex;
+    std::string affinitySpec;
+    std::string savePath;
+    bool saveHitsOnly = false;
+    std::string filePath;
+    std::string outPath;
+    bool streamMode = false;
+    bool profile = false;
+    bool hexRecords = false;
+    const size_t recordLen = 32;
+    bool randomMode = false;
+    bool seedGiven = false;
+    uint64_t seed = 0;
     std::string initialKeyHex = "0000000000000000000000000000000000000000000000000000000000011111";  // Default initial key
 
     // Parse command-line arguments
@@ -121,8 +1080,8 @@ int main(int argc, char* argv[]) {
             if (i + 1 < argc) {
                 try {
                     hashCount = std::stoull(argv[++i]);
-                    if (hashCount == 0 || hashCount % 8 != 0) {
-                        std::cerr << "Error: -c value must be a positive multiple of 8.\n";
+                    if (hashCount == 0) {
+                        std::cerr << "Error: -c value must be a positive integer.\n";
                         return 1;
                     }
                 } catch (const std::invalid_argument&) {
@@ -167,10 +1126,98 @@ int main(int argc, char* argv[]) {
                     std::cerr << "Error: Initial key must be at most 64 hex digits.\n";
                     return 1;
                 }
+                if (initialKeyHex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+                    std::cerr << "Error: Initial key must be hex digits.\n";
+                    return 1;
+                }
             } else {
                 std::cerr << "Error: -i requires a value.\n";
                 return 1;
             }
+        } else if (arg == "-r") {
+            randomMode = true;
+        } else if (arg == "--seed") {
+            if (i + 1 < argc) {
+                try {
+                    seed = std::stoull(argv[++i], nullptr, 0);
+                    seedGiven = true;
+                } catch (const std::exception&) {
+                    std::cerr << "Error: Invalid value for --seed.\n";
+                    return 1;
+                }
+            } else {
+                std::cerr << "Error: --seed requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--no-midstate") {
+            useMidstate = false;
+        } else if (arg == "--file") {
+            if (i + 1 < argc) {
+                filePath = argv[++i];
+            } else {
+                std::cerr << "Error: --file requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--stream") {
+            streamMode = true;
+        } else if (arg == "--hex") {
+            hexRecords = true;
+        } else if (arg == "--out") {
+            if (i + 1 < argc) {
+                outPath = argv[++i];
+            } else {
+                std::cerr << "Error: --out requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--save" || arg == "--save-hits") {
+            if (!savePath.empty()) {
+                std::cerr << "Error: Only one of --save and --save-hits can be given.\n";
+                return 1;
+            }
+            if (i + 1 < argc) {
+                saveHitsOnly = arg == "--save-hits";
+                savePath = argv[++i];
+            } else {
+                std::cerr << "Error: " << arg << " requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--affinity") {
+            if (i + 1 < argc) {
+                affinitySpec = argv[++i];
+            } else {
+                std::cerr << "Error: --affinity requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--kernel") {
+            if (i + 1 < argc) {
+                kernelName = argv[++i];
+            } else {
+                std::cerr << "Error: --kernel requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--targets") {
+            if (i + 1 < argc) {
+                targetsPath = argv[++i];
+            } else {
+                std::cerr << "Error: --targets requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--prefix") {
+            if (i + 1 < argc) {
+                prefixHex = argv[++i];
+            } else {
+                std::cerr << "Error: --prefix requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--mask") {
+            if (i + 1 < argc) {
+                maskHex = argv[++i];
+            } else {
+                std::cerr << "Error: --mask requires a value.\n";
+                return 1;
+            }
         } else if (arg == "--test") {
             testMode = true;
             if (argc > 2) {
@@ -190,15 +1237,87 @@ int main(int argc, char* argv[]) {
         return testsPassed ? 0 : 1;
     }
 
-    // Check if hashCount is divisible by numThreads
-    if (hashCount % numThreads != 0) {
-        std::cerr << "Error: Number of hashes must be divisible by the number of threads.\n";
+    if (hexRecords && !streamMode) {
+        std::cerr << "Error: --hex is only for --stream.\n";
         return 1;
     }
 
+    ThreadAffinity affinity;
+    std::string affinityError;
+    if (!affinitySpec.empty() && !affinity.parse(affinitySpec, &affinityError)) {
+        std::cerr << "Error: " << affinityError << ".\n";
+        return 1;
+    }
+
+    if (!kernelName.empty() && !ripemd160_select_kernel(kernelName.c_str())) {
+        std::cerr << "Error: Kernel " << kernelName << " is not available on this CPU.\n";
+        return 1;
+    }
+
+    if (streamMode) {
+        return runStream(recordLen, hexRecords, numThreads, affinity);
+    }
+
+    if (!filePath.empty()) {
+        if (outPath.empty()) {
+            std::cerr << "Error: --file requires --out.\n";
+            return 1;
+        }
+        return runFile(filePath, outPath, recordLen, numThreads, affinity);
+    }
+
+    // Digests to look for while generating
+    TargetSet targets(20);
+    if (!targetsPath.empty()) {
+        size_t badLine = 0;
+        if (!targets.loadHexFile(targetsPath.c_str(), &badLine)) {
+            if (badLine == 0) {
+                std::cerr << "Error: Cannot read " << targetsPath << ".\n";
+            } else {
+                std::cerr << "Error: Line " << badLine << " of " << targetsPath << " is not a 40-digit hex hash.\n";
+            }
+            return 1;
+        }
+        targets.build();
+    }
+    bool useTargets = targets.size() > 0;
+
+    // Masked search
+    bool searchMode = !prefixHex.empty() || !maskHex.empty();
+    DigestMask digestMask;
+    if (searchMode && !ParseDigestMask(&digestMask, 20, prefixHex, maskHex)) {
+        std::cerr << "Error: --prefix and --mask must be at most 40 hex digits and the prefix must lie within the mask.\n";
+        return 1;
+    }
+
+    if (randomMode && !seedGiven) {
+        std::random_device device;
+        seed = ((uint64_t)device() << 32) | device();
+    }
+
     omp_set_num_threads(numThreads);
 
     std::cout << "Number of threads                  : " << numThreads << "\n";
+    if (affinity.enabled()) {
+        std::cout << "Thread affinity                    : " << affinity.describe() << "\n";
+    }
+    if (randomMode) {
+        std::cout << "Random seed                        : " << seed << "\n";
+    }
+    if (!targetsPath.empty()) {
+        std::cout << "Targets loaded                     : " << targets.size() << "\n";
+    }
+    if (searchMode) {
+        std::cout << "Search mask                        : " << bytesToHexString(digestMask.mask, 20) << "\n";
+        std::cout << "Search value                       : " << bytesToHexString(digestMask.value, 20) << "\n";
+    }
+    // Midstate reuse is a single-stream AVX2 kernel, so it only stands in for
+    // the avx2 kernel: avx2x2 and the 16-lane AVX-512 kernel keep the plain
+    // counter path they were selected for. Random keys share no prefix.
+    bool midstateEnabled = useMidstate && !randomMode && strcmp(ripemd160_kernel(), "avx2") == 0;
+
+    std::cout << "Kernel                             : " << ripemd160_kernel() << " (" << ripemd160_kernel_lanes() << " lanes)\n";
+    std::cout << "Hash path                          : " << (midstateEnabled ? "avx2 midstate" : "full transform") << "\n";
 
     auto totalStart = std::chrono::high_resolution_clock::now();
 
@@ -206,75 +1325,265 @@ int main(int argc, char* argv[]) {
     std::vector<std::string> lastKeys(numThreads);
     std::vector<std::vector<unsigned char>> lastHashes(numThreads, std::vector<unsigned char>(20));
 
+    // Target hits and matches per thread with their key index, no locking in
+    // the loop
+    std::vector<std::vector<std::pair<uint64_t, std::string>>> hits(numThreads);
+    std::vector<std::vector<std::pair<uint64_t, std::string>>> matches(numThreads);
+
     size_t keyLength = 32;  // 32 bytes
 
     // Convert initial key from hex string to byte array
-    uint8_t initialKeyBytes[64] = {0};  // Ensure buffer is at least 64 bytes
-    for (size_t i = 0; i < 32; ++i) {
-        std::string byteString = initialKeyHex.substr(i * 2, 2);
-        initialKeyBytes[i] = static_cast<uint8_t>(std::stoul(byteString, nullptr, 16));
+    uint8_t initialKeyBytes[32] = {0};
+    HexDecode(initialKeyHex, 32, initialKeyBytes);
+
+    // The threads take chunks of the key range and steal from each other at
+    // the end, chunks are whole blocks of random keys
+    WorkScheduler scheduler(hashCount, numThreads, kRandomBlock);
+
+    // Binary results, written out by a background thread
+    std::unique_ptr<ResultWriter> results;
+    bool saveAll = !savePath.empty() && !saveHitsOnly;
+    bool saveHits = !savePath.empty() && saveHitsOnly;
+    if (!savePath.empty()) {
+        ResultHeader header = {};
+        memcpy(header.magic, "HASHRES1", 8);
+        header.algorithm = ResultHeader::kRipemd160;
+        header.keyLen = 32;
+        header.digestLen = 20;
+        header.flags = (saveHitsOnly ? ResultHeader::kHitsOnly : 0) | (randomMode ? ResultHeader::kRandomKeys : 0);
+        header.threads = numThreads;
+        header.chunkAlign = kRandomBlock;
+        header.count = hashCount;
+        header.seed = randomMode ? seed : 0;
+        memcpy(header.startKey, initialKeyBytes, keyLength);
+
+        std::string error;
+        results.reset(new ResultWriter(numThreads, 32, 20));
+        if (!results->open(savePath, header, &error)) {
+            std::cerr << "Error: " << error << ".\n";
+            return 1;
+        }
     }
 
+    // Arenas per page kind, and threads the OS would not pin
+    std::atomic<int> arenaPages[3] = {{0}, {0}, {0}};
+    std::atomic<int> unpinned(0);
+
+    // Hardware counts of each thread's hashing loop for --profile
+    std::vector<PerfSample> profiles(profile ? numThreads : 0);
+
     #pragma omp parallel
     {
         int threadId = omp_get_thread_num();
-        uint64_t hashesPerThread = hashCount / numThreads;
+        if (affinity.enabled() && !affinity.pin(threadId)) {
+            unpinned++;
+        }
 
-        // Each thread gets a copy of the starting key
-        uint8_t startingKeyBytes[64] = {0};
-        memcpy(startingKeyBytes, initialKeyBytes, 32);  // Copy only the first 32 bytes
+        // Keys per kernel call: the kernels generate them in registers from
+        // the first one, the digests of a batch stay in L1
+        const uint64_t batchSize = 256;
 
-        // Increment starting key for each thread
-        incrementByteArray(startingKeyBytes, keyLength, threadId * hashesPerThread);
+        // Buffers and a copy of the target filter in huge pages, allocated
+        // after pinning so they sit on the thread's node
+        ThreadArena arena(batchSize * 20 + batchSize * 4 + (saveAll ? batchSize * 32 : 0) +
+                          (useTargets ? targets.filterBytes() : 0) + 4 * 64);
+        arenaPages[arena.pages()]++;
+        unsigned char (*hashesBatch)[20] = arena.allocArray<unsigned char[20]>(batchSize);
+        uint32_t* hitIndex = arena.allocArray<uint32_t>(batchSize);
+        uint8_t (*batchKeys)[32] = saveAll ? arena.allocArray<uint8_t[32]>(batchSize) : nullptr;
+        std::unique_ptr<TargetSet> localTargets;
+        if (useTargets) {
+            localTargets.reset(new TargetSet(targets, arena.alloc(targets.filterBytes())));
+        }
 
-        unsigned char keysBatch[8][64] = {0};
-        unsigned char hashesBatch[8][20];
-        unsigned char* keysBatchPtr[8];
-        unsigned char* hashesBatchPtr[8];
+        // First key of the current batch and its index in the range
+        uint8_t keyBytes[32];
+        uint64_t i = 0;
 
-        for (uint64_t i = 0; i < hashesPerThread; i += 8) {
-            // Prepare batch of 8 keys
-            for (int j = 0; j < 8; ++j) {
-                memcpy(keysBatch[j], startingKeyBytes, keyLength);
-                keysBatchPtr[j] = keysBatch[j];
-                hashesBatchPtr[j] = hashesBatch[j];
-                incrementByteArray(startingKeyBytes, keyLength, 1);
+        // Key of hash j of the current batch
+        auto keyAt = [&](uint64_t j, uint8_t* key) {
+            if (randomMode) {
+                ripemd160_random_key(seed, 0, i + j, key);
+            } else {
+                memcpy(key, keyBytes, keyLength);
+                incrementByteArray(key, keyLength, j);
             }
+        };
 
-            // Compute hashes using the optimized RIPEMD-160 AVX2 function
-            ripemd160avx2::ripemd160avx2_32(
-                keysBatchPtr[0], keysBatchPtr[1], keysBatchPtr[2], keysBatchPtr[3],
-                keysBatchPtr[4], keysBatchPtr[5], keysBatchPtr[6], keysBatchPtr[7],
-                hashesBatchPtr[0], hashesBatchPtr[1], hashesBatchPtr[2], hashesBatchPtr[3],
-                hashesBatchPtr[4], hashesBatchPtr[5], hashesBatchPtr[6], hashesBatchPtr[7]
-            );
+        auto keyHex = [&](uint64_t j) {
+            uint8_t key[32];
+            keyAt(j, key);
+            return bytesToHexString(key, keyLength);
+        };
 
-            // Save the last key and hash from this thread
-            if (i + 8 >= hashesPerThread) {
-                lastKeys[threadId] = bytesToHexString(keysBatch[7], keyLength);
-                lastHashes[threadId].assign(hashesBatch[7], hashesBatch[7] + 20);
+        // Hit or match j of the batch for --save-hits
+        auto saveHit = [&](uint64_t j, const uint8_t* digest) {
+            if (saveHits) {
+                uint8_t key[32];
+                keyAt(j, key);
+                results->append(threadId, i + j, key, digest);
             }
+        };
+
+        // Masked search on the midstate path, only matching lanes are depacked
+        ripemd160avx2::DigestMatch match;
+        if (midstateEnabled && searchMode) {
+            ripemd160avx2::PrepareMatch(&match, digestMask.mask, digestMask.value);
+        }
+
+        // The counters only run around the loop, setup and output are left out
+        PerfCounters counters;
+        bool counting = profile && counters.open(&profiles[threadId].error);
+        uint64_t hashed = 0;
+        if (counting) {
+            counters.start();
+        }
+
+        bool saved = false;
+        uint64_t lastIndex = 0;
+        uint64_t begin, end;
+        while (scheduler.next(threadId, &begin, &end)) {
+            hashed += end - begin;
+            memcpy(keyBytes, initialKeyBytes, keyLength);
+            incrementByteArray(keyBytes, keyLength, begin);
+
+            for (i = begin; i < end;) {
+                uint64_t count = std::min(batchSize, end - i);
+                bool lastBatch = saveLastHashes && i + count == end;
+
+                if (searchMode && !useTargets && midstateEnabled && !lastBatch && !saveAll) {
+                    // A search alone needs no digests but the matching ones
+                    // (the last batch of a chunk is stored in full for -s)
+                    size_t found = ripemd160avx2::ripemd160avx2_counter32_match(keyBytes, count, &match, hitIndex, hashesBatch[0]);
+                    for (size_t j = 0; j < found; ++j) {
+                        matches[threadId].emplace_back(i + hitIndex[j], keyHex(hitIndex[j]) + " " + bytesToHexString(hashesBatch[j], 20));
+                        saveHit(hitIndex[j], hashesBatch[j]);
+                    }
+                } else {
+                    if (randomMode) {
+                        ripemd160_random32(seed, 0, i, count, hashesBatch[0]);
+                    } else if (midstateEnabled) {
+                        ripemd160avx2::ripemd160avx2_counter32_midstate(keyBytes, count, hashesBatch[0]);
+                    } else {
+                        // Full groups on the selected kernel, the rest on narrower ones
+                        ripemd160_counter32(keyBytes, count, hashesBatch[0]);
+                    }
+
+                    if (useTargets) {
+                        size_t hitCount = localTargets->probe(hashesBatch[0], 20, count, hitIndex);
+                        for (size_t h = 0; h < hitCount; ++h) {
+                            hits[threadId].emplace_back(i + hitIndex[h], keyHex(hitIndex[h]) + " " + bytesToHexString(hashesBatch[hitIndex[h]], 20));
+                            saveHit(hitIndex[h], hashesBatch[hitIndex[h]]);
+                        }
+                    }
+
+                    for (uint64_t j = 0; searchMode && j < count; ++j) {
+                        if (DigestMatches(&digestMask, hashesBatch[j])) {
+                            matches[threadId].emplace_back(i + j, keyHex(j) + " " + bytesToHexString(hashesBatch[j], 20));
+                            saveHit(j, hashesBatch[j]);
+                        }
+                    }
+                }
+
+                // Every key and hash for --save
+                if (saveAll) {
+                    if (randomMode) {
+                        ripemd160_random_keys(seed, 0, i, count, batchKeys[0]);
+                    } else {
+                        memcpy(batchKeys[0], keyBytes, keyLength);
+                        for (uint64_t j = 1; j < count; ++j) {
+                            memcpy(batchKeys[j], batchKeys[j - 1], keyLength);
+                            incrementByteArray(batchKeys[j], keyLength, 1);
+                        }
+                    }
+                    for (uint64_t j = 0; j < count; ++j) {
+                        results->append(threadId, i + j, batchKeys[j], hashesBatch[j]);
+                    }
+                }
+
+                // Save the last key (highest index) and hash from this thread
+                if (lastBatch && (!saved || end - 1 > lastIndex)) {
+                    saved = true;
+                    lastIndex = end - 1;
+                    lastKeys[threadId] = keyHex(count - 1);
+                    lastHashes[threadId].assign(hashesBatch[count - 1], hashesBatch[count - 1] + 20);
+                }
+
+                i += count;
+                incrementByteArray(keyBytes, keyLength, count);
+            }
+        }
+
+        if (counting) {
+            counters.stop();
+            profiles[threadId].take(counters, hashed);
+        }
+
+        if (results) {
+            results->flush(threadId);
         }
     }
 
+    // The last blocks of the result file are written before the clock stops
+    std::string saveError;
+    bool resultsSaved = !results || results->close(&saveError);
+
     auto totalEnd = std::chrono::high_resolution_clock::now();
 
-    // Output last keys and hashes
+    if (!resultsSaved) {
+        std::cerr << "Error: " << saveError << ".\n";
+        return 1;
+    }
+
+    // Output last keys and hashes (threads that got no work are left out)
     if (saveLastHashes) {
         std::ofstream outFile("last_hashes.txt");
         for (int i = 0; i < numThreads; ++i) {
+            if (lastKeys[i].empty()) {
+                continue;
+            }
             outFile << "Thread " << i << " last key: " << lastKeys[i] << "\n";
             outFile << "Thread " << i << " last hash: " << bytesToHexString(lastHashes[i].data(), 20) << "\n";
         }
         outFile.close();
     }
 
+    // Output target hits (key and hash)
+    if (!targetsPath.empty()) {
+        std::vector<std::string> hitLines = mergeByKey(hits);
+        std::cout << "Target hits                        : " << hitLines.size() << "\n";
+        for (const auto& hit : hitLines) {
+            std::cout << "Hit: " << hit << "\n";
+        }
+    }
+
+    // Output search matches (key and hash)
+    if (searchMode) {
+        std::vector<std::string> matchLines = mergeByKey(matches);
+        std::cout << "Matches found                      : " << matchLines.size() << "\n";
+        for (const auto& match : matchLines) {
+            std::cout << "Match: " << match << "\n";
+        }
+    }
+
     // Output statistics
     auto totalDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(totalEnd - totalStart).count();
     double totalSeconds = totalDuration / 1e9;
     double avgHashTime = (totalDuration / static_cast<double>(hashCount));
 
     std::cout << std::fixed << std::setprecision(2);
+    if (results) {
+        std::cout << "Records saved                      : " << results->records() << "\n";
+    }
+    std::cout << "Chunks stolen                      : " << scheduler.steals() << "\n";
+    std::cout << "Thread arenas (2 MB pages)         : " << arenaPages[ThreadArena::kReserved] << " reserved, "
+              << arenaPages[ThreadArena::kTransparent] << " transparent, " << arenaPages[ThreadArena::kSmall] << " small\n";
+    if (unpinned > 0) {
+        std::cout << "Threads left unpinned              : " << unpinned << "\n";
+    }
+    if (profile) {
+        PrintProfile(std::cout, profiles, 256);  // Batches of the hashing loop
+    }
     std::cout << "Total execution time      (seconds): " << totalSeconds << "\n";
     std::cout << "Average time per hash (nanoseconds): " << avgHashTime << "\n";
 
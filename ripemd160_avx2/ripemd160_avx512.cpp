@@ -0,0 +1,35 @@
+#include "ripemd160_dispatch.h"
+#include <immintrin.h>
+
+// AVX-512 kernel, 16 messages per transform. Only called after the dispatcher
+// has checked the CPU. Left out when built with -DNO_AVX512.
+#ifndef NO_AVX512
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC target("avx512f")
+// GCC 12 reports the intentionally undefined operands inside avx512fintrin.h
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+#endif
+
+#include "ripemd160_rounds.h"
+
+void ripemd160avx512_batch(const uint8_t *in, size_t stride, size_t n, uint8_t *out) {
+    ripemd160avx2::Rounds<VecAvx512>::HashStrided(in, stride, n, out);
+}
+
+void ripemd160avx512_counter32(const uint8_t *key, size_t n, uint8_t *out) {
+    ripemd160avx2::Rounds<VecAvx512>::HashCounter32(key, n, out);
+}
+
+void ripemd160avx512_random32(uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t *out) {
+    ripemd160avx2::Rounds<VecAvx512>::HashRandom32(seed, stream, block, n, out);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif  // NO_AVX512
@@ -0,0 +1,178 @@
+#include "ripemd160_dispatch.h"
+#include "ripemd160_avx2.h"
+#include "ripemd160_rounds.h"
+#include "../common/cpu_features.h"
+#include <string.h>
+
+// Built for the baseline target: this file only decides which kernel runs,
+// plus the scalar kernel that handles the last few messages.
+
+void ripemd160scalar_batch(const uint8_t *in, size_t stride, size_t n, uint8_t *out) {
+    ripemd160avx2::Rounds<VecScalar>::HashStrided(in, stride, n, out);
+}
+
+void ripemd160scalar_counter32(const uint8_t *key, size_t n, uint8_t *out) {
+    ripemd160avx2::Rounds<VecScalar>::HashCounter32(key, n, out);
+}
+
+void ripemd160scalar_random32(uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t *out) {
+    ripemd160avx2::Rounds<VecScalar>::HashRandom32(seed, stream, block, n, out);
+}
+
+namespace {
+
+typedef void (*BatchFunc)(const uint8_t *in, size_t stride, size_t n, uint8_t *out);
+typedef void (*CounterFunc)(const uint8_t *key, size_t n, uint8_t *out);
+typedef void (*RandomFunc)(uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t *out);
+
+struct Kernel {
+    const char *name;
+    int lanes;
+    bool (*supported)();
+    BatchFunc batch;
+    CounterFunc counter32;
+    RandomFunc random32;
+    bool automatic;  // Candidate for the startup choice, otherwise only used
+                     // when picked with ripemd160_select_kernel
+};
+
+bool Always() {
+    return true;
+}
+
+// Widest first, the scalar kernel must stay last
+const Kernel kernels[] = {
+#ifndef NO_AVX512
+    { "avx512", 16, CpuHasAvx512f, ripemd160avx512_batch, ripemd160avx512_counter32, ripemd160avx512_random32, true },
+#endif
+    // Two interleaved AVX2 streams, opt-in until it is measured on the target cores
+    { "avx2x2", 16, CpuHasAvx2, ripemd160avx2::ripemd160avx2x2_batch, ripemd160avx2::ripemd160avx2x2_counter32, ripemd160avx2::ripemd160avx2x2_random32, false },
+    { "avx2", 8, CpuHasAvx2, ripemd160avx2::ripemd160avx2_batch, ripemd160avx2::ripemd160avx2_counter32, ripemd160avx2::ripemd160avx2_random32, true },
+    { "sse41", 4, CpuHasSse41, ripemd160sse41_batch, ripemd160sse41_counter32, ripemd160sse41_random32, true },
+    { "scalar", 1, Always, ripemd160scalar_batch, ripemd160scalar_counter32, ripemd160scalar_random32, true },
+};
+
+const int kernelCount = sizeof(kernels) / sizeof(kernels[0]);
+
+int FindKernel(const char *name) {
+    for (int k = 0; k < kernelCount; ++k) {
+        if (strcmp(kernels[k].name, name) == 0) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+bool available[kernelCount];
+
+int DetectKernel() {
+    for (int k = 0; k < kernelCount; ++k) {
+        available[k] = kernels[k].supported();
+    }
+
+    int k = 0;
+    while (!available[k] || !kernels[k].automatic) {
+        ++k;
+    }
+    return k;
+}
+
+// Picked once at startup
+int selected = DetectKernel();
+
+// key += count, little-endian
+void AdvanceKey32(uint8_t *key, uint64_t count) {
+    for (int i = 0; i < 32 && count != 0; ++i) {
+        uint64_t sum = key[i] + (count & 0xFF);
+        key[i] = (uint8_t)sum;
+        count = (count >> 8) + (sum >> 8);
+    }
+}
+
+}  // namespace
+
+void ripemd160_batch(const uint8_t *in, size_t stride, size_t n, uint8_t *out) {
+    // Every full group goes to the widest kernel, the rest to narrower ones
+    for (int k = selected; n > 0; ++k) {
+        const Kernel &kernel = kernels[k];
+        size_t count = n - n % kernel.lanes;
+        if (count == 0 || !available[k]) {
+            continue;
+        }
+
+        kernel.batch(in, stride, count, out);
+
+        in += count * stride;
+        out += count * 20;
+        n -= count;
+    }
+}
+
+void ripemd160_counter32(const uint8_t *key, size_t n, uint8_t *out) {
+    uint8_t next[32];
+    memcpy(next, key, 32);
+
+    for (int k = selected; n > 0; ++k) {
+        const Kernel &kernel = kernels[k];
+        size_t count = n - n % kernel.lanes;
+        if (count == 0 || !available[k]) {
+            continue;
+        }
+
+        kernel.counter32(next, count, out);
+
+        AdvanceKey32(next, count);
+        out += count * 20;
+        n -= count;
+    }
+}
+
+void ripemd160_random32(uint64_t seed, uint64_t stream, uint64_t first, size_t n, uint8_t *out) {
+    // The keys of a block depend on all 16 generator lanes, so the selected
+    // kernel takes a whole block and leaves the lanes past n idle
+    uint64_t block = first / kRandomBlock;
+    for (; n > 0; ++block) {
+        size_t count = n < kRandomBlock ? n : (size_t)kRandomBlock;
+        kernels[selected].random32(seed, stream, block, count, out);
+        out += count * 20;
+        n -= count;
+    }
+}
+
+void ripemd160_random_key(uint64_t seed, uint64_t stream, uint64_t counter, uint8_t *key) {
+    uint32_t words[kRandomWords];
+    RandomKeyWords(seed, stream, counter, words);
+    memcpy(key, words, 32);
+}
+
+void ripemd160_random_keys(uint64_t seed, uint64_t stream, uint64_t first, size_t n, uint8_t *keys) {
+    uint32_t words[kRandomBlock][kRandomWords];
+    for (uint64_t block = first / kRandomBlock; n > 0; ++block) {
+        size_t count = n < kRandomBlock ? n : (size_t)kRandomBlock;
+        RandomBlockWords(seed, stream, block, count, words);
+        memcpy(keys, words, count * 32);
+        keys += count * 32;
+        n -= count;
+    }
+}
+
+const char *ripemd160_kernel() {
+    return kernels[selected].name;
+}
+
+int ripemd160_kernel_lanes() {
+    return kernels[selected].lanes;
+}
+
+bool ripemd160_kernel_supported(const char *name) {
+    int k = FindKernel(name);
+    return k >= 0 && available[k];
+}
+
+bool ripemd160_select_kernel(const char *name) {
+    if (!ripemd160_kernel_supported(name)) {
+        return false;
+    }
+    selected = FindKernel(name);
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef RIPEMD160_DISPATCH_H
+#define RIPEMD160_DISPATCH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Portable RIPEMD-160 entry points. At startup the widest kernel the CPU
+// supports is selected: "avx512" (16 lanes), "avx2" (8), "sse41" (4) or
+// "scalar" (1). "avx2x2" (16 lanes, two interleaved AVX2 streams) is only
+// used when selected. The selected kernel hashes every full group of its
+// width, the leftover messages go to the narrower kernels, so any n is hashed
+// at full speed.
+
+// Hash n messages of 32 bytes stored stride bytes apart and write n digests
+// of 20 bytes contiguously to out
+void ripemd160_batch(const uint8_t *in, size_t stride, size_t n, uint8_t *out);
+
+// Hash the n consecutive 32-byte keys key, key + 1, ... (little-endian
+// counter, byte 0 lowest) and write n digests. The kernels generate the keys
+// in registers, nothing but the digests touches memory.
+void ripemd160_counter32(const uint8_t *key, size_t n, uint8_t *out);
+
+// Hash the n random 32-byte keys first, first + 1, ... of a stream (first a
+// multiple of 256) and write n digests. The keys are the little-endian words
+// of lane-parallel xoshiro128** generators seeded from (seed, stream) per
+// block of 256 keys (see common/vec_random.h), fed straight into the
+// transform. The keys are the same on every kernel; ripemd160_random_key
+// regenerates one.
+void ripemd160_random32(uint64_t seed, uint64_t stream, uint64_t first, size_t n, uint8_t *out);
+void ripemd160_random_key(uint64_t seed, uint64_t stream, uint64_t counter, uint8_t *key);
+
+// The n keys ripemd160_random32 hashes for the same arguments, 32 bytes each
+void ripemd160_random_keys(uint64_t seed, uint64_t stream, uint64_t first, size_t n, uint8_t *keys);
+
+// Name and width of the kernel ripemd160_batch starts with
+const char *ripemd160_kernel();
+int ripemd160_kernel_lanes();
+
+// True if the kernel is compiled in and the CPU can run it
+bool ripemd160_kernel_supported(const char *name);
+
+// Start with another kernel (e.g. to compare widths); returns false and keeps
+// the current one when the kernel is not supported. Call before hashing starts.
+bool ripemd160_select_kernel(const char *name);
+
+// Kernels for one instruction set, called by the dispatcher. Any n works, but
+// only full groups of the kernel width run without idle lanes.
+void ripemd160scalar_batch(const uint8_t *in, size_t stride, size_t n, uint8_t *out);
+void ripemd160sse41_batch(const uint8_t *in, size_t stride, size_t n, uint8_t *out);
+void ripemd160avx512_batch(const uint8_t *in, size_t stride, size_t n, uint8_t *out);
+void ripemd160scalar_counter32(const uint8_t *key, size_t n, uint8_t *out);
+void ripemd160scalar_random32(uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t *out);
+void ripemd160sse41_counter32(const uint8_t *key, size_t n, uint8_t *out);
+void ripemd160sse41_random32(uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t *out);
+void ripemd160avx512_counter32(const uint8_t *key, size_t n, uint8_t *out);
+void ripemd160avx512_random32(uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t *out);
+
+#endif  // RIPEMD160_DISPATCH_H
@@ -0,0 +1,417 @@
+#ifndef RIPEMD160_ROUNDS_H
+#define RIPEMD160_ROUNDS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "../common/vec_traits.h"
+#include "../common/vec_counter.h"
+#include "../common/vec_random.h"
+
+// Width-generic RIPEMD-160 round logic. V is one of the vector traits of
+// common/vec_traits.h; include this header after the target pragma of the
+// translation unit that instantiates it.
+
+namespace ripemd160avx2 {
+
+// Initial hash values
+static const uint32_t H0[5] = {
+    0x67452301ul, 0xEFCDAB89ul, 0x98BADCFEul, 0x10325476ul, 0xC3D2E1F0ul
+};
+
+// RIPEMD-160 functions
+#define f1(x, y, z) V::Xor(x, V::Xor(y, z))
+#define f2(x, y, z) V::Or(V::And(x, y), V::AndNot(x, z))
+#define f3(x, y, z) V::Xor(V::Or(x, V::Not(y)), z)
+#define f4(x, y, z) V::Or(V::And(x, z), V::AndNot(z, y))
+#define f5(x, y, z) V::Xor(x, V::Or(y, V::Not(z)))
+
+#define ROL(x, n) V::template Rotl<n>(x)
+
+// Addition helpers
+#define add3(x0, x1, x2) V::Add(V::Add(x0, x1), x2)
+#define add4(x0, x1, x2, x3) V::Add(V::Add(x0, x1), V::Add(x2, x3))
+
+// Round function
+#define Round(a, b, c, d, e, f, x, k, r) \
+    u = add4(a, f, x, V::Set1(k));       \
+    a = V::Add(ROL(u, r), e);            \
+    c = ROL(c, 10);
+
+// Macro definitions for each operation in the rounds
+#define R11(a, b, c, d, e, x, r) Round(a, b, c, d, e, f1(b, c, d), x, 0, r)
+#define R21(a, b, c, d, e, x, r) Round(a, b, c, d, e, f2(b, c, d), x, 0x5A827999ul, r)
+#define R31(a, b, c, d, e, x, r) Round(a, b, c, d, e, f3(b, c, d), x, 0x6ED9EBA1ul, r)
+#define R41(a, b, c, d, e, x, r) Round(a, b, c, d, e, f4(b, c, d), x, 0x8F1BBCDCul, r)
+#define R51(a, b, c, d, e, x, r) Round(a, b, c, d, e, f5(b, c, d), x, 0xA953FD4Eul, r)
+#define R12(a, b, c, d, e, x, r) Round(a, b, c, d, e, f5(b, c, d), x, 0x50A28BE6ul, r)
+#define R22(a, b, c, d, e, x, r) Round(a, b, c, d, e, f4(b, c, d), x, 0x5C4DD124ul, r)
+#define R32(a, b, c, d, e, x, r) Round(a, b, c, d, e, f3(b, c, d), x, 0x6D703EF3ul, r)
+#define R42(a, b, c, d, e, x, r) Round(a, b, c, d, e, f2(b, c, d), x, 0x7A6D76E9ul, r)
+#define R52(a, b, c, d, e, x, r) Round(a, b, c, d, e, f1(b, c, d), x, 0, r)
+
+template <class V>
+struct Rounds {
+    typedef typename V::vec vec;
+
+    static VEC_INLINE void Initialize(vec *s) {
+        for (int i = 0; i < 5; ++i) {
+            s[i] = V::Set1(H0[i]);
+        }
+    }
+
+    // First three right-line steps, they only read w[5], w[14] and w[7]
+    static VEC_INLINE void RightHead(vec &a2, vec &b2, vec &c2, vec &d2, vec &e2, const vec *w) {
+        vec u;
+
+        R12(a2, b2, c2, d2, e2, w[5], 8);
+        R12(e2, a2, b2, c2, d2, w[14], 9);
+        R12(d2, e2, a2, b2, c2, w[7], 9);
+    }
+
+    // Both lines of rounds; a2..e2 already include the first three right-line
+    // steps (w[5], w[14], w[7]), which are the only ones that precede w[0]
+    static VEC_INLINE void Compress(vec *s, const vec *w, vec a2, vec b2, vec c2, vec d2, vec e2) {
+        // Load state variables
+        vec a1 = s[0];
+        vec b1 = s[1];
+        vec c1 = s[2];
+        vec d1 = s[3];
+        vec e1 = s[4];
+
+        vec u;
+
+        // Rounds 0-15
+        R11(a1, b1, c1, d1, e1, w[0], 11);
+        R11(e1, a1, b1, c1, d1, w[1], 14);
+        R11(d1, e1, a1, b1, c1, w[2], 15);
+        R11(c1, d1, e1, a1, b1, w[3], 12);
+        R12(c2, d2, e2, a2, b2, w[0], 11);
+        R11(b1, c1, d1, e1, a1, w[4], 5);
+        R12(b2, c2, d2, e2, a2, w[9], 13);
+        R11(a1, b1, c1, d1, e1, w[5], 8);
+        R12(a2, b2, c2, d2, e2, w[2], 15);
+        R11(e1, a1, b1, c1, d1, w[6], 7);
+        R12(e2, a2, b2, c2, d2, w[11], 15);
+        R11(d1, e1, a1, b1, c1, w[7], 9);
+        R12(d2, e2, a2, b2, c2, w[4], 5);
+        R11(c1, d1, e1, a1, b1, w[8], 11);
+        R12(c2, d2, e2, a2, b2, w[13], 7);
+        R11(b1, c1, d1, e1, a1, w[9], 13);
+        R12(b2, c2, d2, e2, a2, w[6], 7);
+        R11(a1, b1, c1, d1, e1, w[10], 14);
+        R12(a2, b2, c2, d2, e2, w[15], 8);
+        R11(e1, a1, b1, c1, d1, w[11], 15);
+        R12(e2, a2, b2, c2, d2, w[8], 11);
+        R11(d1, e1, a1, b1, c1, w[12], 6);
+        R12(d2, e2, a2, b2, c2, w[1], 14);
+        R11(c1, d1, e1, a1, b1, w[13], 7);
+        R12(c2, d2, e2, a2, b2, w[10], 14);
+        R11(b1, c1, d1, e1, a1, w[14], 9);
+        R12(b2, c2, d2, e2, a2, w[3], 12);
+        R11(a1, b1, c1, d1, e1, w[15], 8);
+        R12(a2, b2, c2, d2, e2, w[12], 6);
+
+        R21(e1, a1, b1, c1, d1, w[7], 7);
+        R22(e2, a2, b2, c2, d2, w[6], 9);
+        R21(d1, e1, a1, b1, c1, w[4], 6);
+        R22(d2, e2, a2, b2, c2, w[11], 13);
+        R21(c1, d1, e1, a1, b1, w[13], 8);
+        R22(c2, d2, e2, a2, b2, w[3], 15);
+        R21(b1, c1, d1, e1, a1, w[1], 13);
+        R22(b2, c2, d2, e2, a2, w[7], 7);
+        R21(a1, b1, c1, d1, e1, w[10], 11);
+        R22(a2, b2, c2, d2, e2, w[0], 12);
+        R21(e1, a1, b1, c1, d1, w[6], 9);
+        R22(e2, a2, b2, c2, d2, w[13], 8);
+        R21(d1, e1, a1, b1, c1, w[15], 7);
+        R22(d2, e2, a2, b2, c2, w[5], 9);
+        R21(c1, d1, e1, a1, b1, w[3], 15);
+        R22(c2, d2, e2, a2, b2, w[10], 11);
+        R21(b1, c1, d1, e1, a1, w[12], 7);
+        R22(b2, c2, d2, e2, a2, w[14], 7);
+        R21(a1, b1, c1, d1, e1, w[0], 12);
+        R22(a2, b2, c2, d2, e2, w[15], 7);
+        R21(e1, a1, b1, c1, d1, w[9], 15);
+        R22(e2, a2, b2, c2, d2, w[8], 12);
+        R21(d1, e1, a1, b1, c1, w[5], 9);
+        R22(d2, e2, a2, b2, c2, w[12], 7);
+        R21(c1, d1, e1, a1, b1, w[2], 11);
+        R22(c2, d2, e2, a2, b2, w[4], 6);
+        R21(b1, c1, d1, e1, a1, w[14], 7);
+        R22(b2, c2, d2, e2, a2, w[9], 15);
+        R21(a1, b1, c1, d1, e1, w[11], 13);
+        R22(a2, b2, c2, d2, e2, w[1], 13);
+        R21(e1, a1, b1, c1, d1, w[8], 12);
+        R22(e2, a2, b2, c2, d2, w[2], 11);
+
+        R31(d1, e1, a1, b1, c1, w[3], 11);
+        R32(d2, e2, a2, b2, c2, w[15], 9);
+        R31(c1, d1, e1, a1, b1, w[10], 13);
+        R32(c2, d2, e2, a2, b2, w[5], 7);
+        R31(b1, c1, d1, e1, a1, w[14], 6);
+        R32(b2, c2, d2, e2, a2, w[1], 15);
+        R31(a1, b1, c1, d1, e1, w[4], 7);
+        R32(a2, b2, c2, d2, e2, w[3], 11);
+        R31(e1, a1, b1, c1, d1, w[9], 14);
+        R32(e2, a2, b2, c2, d2, w[7], 8);
+        R31(d1, e1, a1, b1, c1, w[15], 9);
+        R32(d2, e2, a2, b2, c2, w[14], 6);
+        R31(c1, d1, e1, a1, b1, w[8], 13);
+        R32(c2, d2, e2, a2, b2, w[6], 6);
+        R31(b1, c1, d1, e1, a1, w[1], 15);
+        R32(b2, c2, d2, e2, a2, w[9], 14);
+        R31(a1, b1, c1, d1, e1, w[2], 14);
+        R32(a2, b2, c2, d2, e2, w[11], 12);
+        R31(e1, a1, b1, c1, d1, w[7], 8);
+        R32(e2, a2, b2, c2, d2, w[8], 13);
+        R31(d1, e1, a1, b1, c1, w[0], 13);
+        R32(d2, e2, a2, b2, c2, w[12], 5);
+        R31(c1, d1, e1, a1, b1, w[6], 6);
+        R32(c2, d2, e2, a2, b2, w[2], 14);
+        R31(b1, c1, d1, e1, a1, w[13], 5);
+        R32(b2, c2, d2, e2, a2, w[10], 13);
+        R31(a1, b1, c1, d1, e1, w[11], 12);
+        R32(a2, b2, c2, d2, e2, w[0], 13);
+        R31(e1, a1, b1, c1, d1, w[5], 7);
+        R32(e2, a2, b2, c2, d2, w[4], 7);
+        R31(d1, e1, a1, b1, c1, w[12], 5);
+        R32(d2, e2, a2, b2, c2, w[13], 5);
+
+        R41(c1, d1, e1, a1, b1, w[1], 11);
+        R42(c2, d2, e2, a2, b2, w[8], 15);
+        R41(b1, c1, d1, e1, a1, w[9], 12);
+        R42(b2, c2, d2, e2, a2, w[6], 5);
+        R41(a1, b1, c1, d1, e1, w[11], 14);
+        R42(a2, b2, c2, d2, e2, w[4], 8);
+        R41(e1, a1, b1, c1, d1, w[10], 15);
+        R42(e2, a2, b2, c2, d2, w[1], 11);
+        R41(d1, e1, a1, b1, c1, w[0], 14);
+        R42(d2, e2, a2, b2, c2, w[3], 14);
+        R41(c1, d1, e1, a1, b1, w[8], 15);
+        R42(c2, d2, e2, a2, b2, w[11], 14);
+        R41(b1, c1, d1, e1, a1, w[12], 9);
+        R42(b2, c2, d2, e2, a2, w[15], 6);
+        R41(a1, b1, c1, d1, e1, w[4], 8);
+        R42(a2, b2, c2, d2, e2, w[0], 14);
+        R41(e1, a1, b1, c1, d1, w[13], 9);
+        R42(e2, a2, b2, c2, d2, w[5], 6);
+        R41(d1, e1, a1, b1, c1, w[3], 14);
+        R42(d2, e2, a2, b2, c2, w[12], 9);
+        R41(c1, d1, e1, a1, b1, w[7], 5);
+        R42(c2, d2, e2, a2, b2, w[2], 12);
+        R41(b1, c1, d1, e1, a1, w[15], 6);
+        R42(b2, c2, d2, e2, a2, w[13], 9);
+        R41(a1, b1, c1, d1, e1, w[14], 8);
+        R42(a2, b2, c2, d2, e2, w[9], 12);
+        R41(e1, a1, b1, c1, d1, w[5], 6);
+        R42(e2, a2, b2, c2, d2, w[7], 5);
+        R41(d1, e1, a1, b1, c1, w[6], 5);
+        R42(d2, e2, a2, b2, c2, w[10], 15);
+        R41(c1, d1, e1, a1, b1, w[2], 12);
+        R42(c2, d2, e2, a2, b2, w[14], 8);
+
+        R51(b1, c1, d1, e1, a1, w[4], 9);
+        R52(b2, c2, d2, e2, a2, w[12], 8);
+        R51(a1, b1, c1, d1, e1, w[0], 15);
+        R52(a2, b2, c2, d2, e2, w[15], 5);
+        R51(e1, a1, b1, c1, d1, w[5], 5);
+        R52(e2, a2, b2, c2, d2, w[10], 12);
+        R51(d1, e1, a1, b1, c1, w[9], 11);
+        R52(d2, e2, a2, b2, c2, w[4], 9);
+        R51(c1, d1, e1, a1, b1, w[7], 6);
+        R52(c2, d2, e2, a2, b2, w[1], 12);
+        R51(b1, c1, d1, e1, a1, w[12], 8);
+        R52(b2, c2, d2, e2, a2, w[5], 5);
+        R51(a1, b1, c1, d1, e1, w[2], 13);
+        R52(a2, b2, c2, d2, e2, w[8], 14);
+        R51(e1, a1, b1, c1, d1, w[10], 12);
+        R52(e2, a2, b2, c2, d2, w[7], 6);
+        R51(d1, e1, a1, b1, c1, w[14], 5);
+        R52(d2, e2, a2, b2, c2, w[6], 8);
+        R51(c1, d1, e1, a1, b1, w[1], 12);
+        R52(c2, d2, e2, a2, b2, w[2], 13);
+        R51(b1, c1, d1, e1, a1, w[3], 13);
+        R52(b2, c2, d2, e2, a2, w[13], 6);
+        R51(a1, b1, c1, d1, e1, w[8], 14);
+        R52(a2, b2, c2, d2, e2, w[14], 5);
+        R51(e1, a1, b1, c1, d1, w[11], 11);
+        R52(e2, a2, b2, c2, d2, w[0], 15);
+        R51(d1, e1, a1, b1, c1, w[6], 8);
+        R52(d2, e2, a2, b2, c2, w[3], 13);
+        R51(c1, d1, e1, a1, b1, w[15], 5);
+        R52(c2, d2, e2, a2, b2, w[9], 11);
+        R51(b1, c1, d1, e1, a1, w[13], 6);
+        R52(b2, c2, d2, e2, a2, w[11], 11);
+
+        // Combine results and update state
+        vec t = s[0];
+        s[0] = add3(s[1], c1, d2);
+        s[1] = add3(s[2], d1, e2);
+        s[2] = add3(s[3], e1, a2);
+        s[3] = add3(s[4], a1, b2);
+        s[4] = add3(t, b1, c2);
+    }
+
+    // Transform on 16 message words already held in registers
+    static VEC_INLINE void Transform(vec *s, const vec *w) {
+        vec a2 = s[0];
+        vec b2 = s[1];
+        vec c2 = s[2];
+        vec d2 = s[3];
+        vec e2 = s[4];
+
+        RightHead(a2, b2, c2, d2, e2, w);
+        Compress(s, w, a2, b2, c2, d2, e2);
+    }
+
+    // One 64-byte block per lane
+    static VEC_INLINE void Transform(vec *s, const uint8_t *const *blk) {
+        vec w[16];
+
+        // Load message words, two transposed halves per block
+        V::LoadWords(w, blk, 0);
+        V::LoadWords(w + 8, blk, 32);
+
+        Transform(s, w);
+    }
+
+    // Transform of a 32-byte message per lane held in w8[0..7]. The padding
+    // words are compile-time constants, so w[t] + K folds into a single
+    // constant and the zero words drop out of the rounds.
+    static VEC_INLINE void Transform32(vec *s, const vec *w8) {
+        vec w[16];
+
+        for (int i = 0; i < 8; ++i) {
+            w[i] = w8[i];
+        }
+
+        // Padding: 0x80, zeros and the length in bits
+        w[8] = V::Set1(0x80);
+        for (int i = 9; i < 16; ++i) {
+            w[i] = V::Zero();
+        }
+        w[14] = V::Set1(32 << 3);
+
+        Transform(s, w);
+    }
+
+    // Hash one 32-byte message per lane and write the 20-byte digests. Only
+    // the 32 message bytes are read, the padding is generated in registers.
+    static VEC_INLINE void Hash32(const uint8_t *const *blk, unsigned char *const *digest) {
+        vec s[5];
+        vec w[8];
+
+        V::LoadWords(w, blk, 0);
+        Initialize(s);
+        Transform32(s, w);
+        V::StoreWords(s, 5, digest);
+    }
+
+    // Hash the n consecutive 32-byte keys key, key + 1, ... (little-endian
+    // counter) and write n digests. The counter digits are the message words,
+    // so each transform reads them straight from the registers.
+    static void HashCounter32(const uint8_t *key, size_t n, uint8_t *out) {
+        unsigned char scratch[V::lanes][20];
+        uint32_t digits[8];
+        memcpy(digits, key, 32);
+
+        VecCounter<V, 8> counter;
+        counter.Init(digits);
+
+        for (size_t base = 0; base < n; base += V::lanes) {
+            unsigned char *digest[V::lanes];
+            for (size_t i = 0; i < (size_t)V::lanes; ++i) {
+                digest[i] = (base + i < n) ? out + (base + i) * 20 : scratch[i];
+            }
+
+            vec s[5];
+            Initialize(s);
+            Transform32(s, counter.c);
+            V::StoreWords(s, 5, digest);
+
+            counter.Next();
+        }
+    }
+
+    // Hash the first n (at most kRandomBlock) random keys of a block of a
+    // stream (see common/vec_random.h). The random words are the message
+    // words, they go from the generators straight into the transform.
+    static void HashRandom32(uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t *out) {
+        unsigned char scratch[V::lanes][20];
+        VecRandom<V> random;
+        random.Seed(seed, stream, block);
+
+        for (size_t base = 0; base < n; base += V::lanes) {
+            unsigned char *digest[V::lanes];
+            for (size_t i = 0; i < (size_t)V::lanes; ++i) {
+                digest[i] = (base + i < n) ? out + (base + i) * 20 : scratch[i];
+            }
+
+            int set = (int)(base / V::lanes % VecRandom<V>::sets);
+            vec w[kRandomWords];
+            for (int k = 0; k < kRandomWords; ++k) {
+                w[k] = random.Next(set);
+            }
+
+            vec s[5];
+            Initialize(s);
+            Transform32(s, w);
+            V::StoreWords(s, 5, digest);
+        }
+    }
+
+    // Hash n 32-byte messages stored stride bytes apart, V::lanes per
+    // transform. The last group may be partial: its idle lanes rehash the
+    // last message into a scratch buffer.
+    static void HashStrided(const uint8_t *in, size_t stride, size_t n, uint8_t *out) {
+        unsigned char scratch[V::lanes][20];
+
+        for (size_t base = 0; base < n; base += V::lanes) {
+            const uint8_t *blk[V::lanes];
+            unsigned char *digest[V::lanes];
+
+            for (size_t i = 0; i < (size_t)V::lanes; ++i) {
+                if (base + i < n) {
+                    blk[i] = in + (base + i) * stride;
+                    digest[i] = out + (base + i) * 20;
+                } else {
+                    blk[i] = in + (n - 1) * stride;
+                    digest[i] = scratch[i];
+                }
+            }
+
+            // Prefetch the next group while this one is compressed
+            for (size_t i = base + V::lanes; i < base + 2 * V::lanes && i < n; ++i) {
+                const char *ptr = (const char *)(in + i * stride);
+                _mm_prefetch(ptr, _MM_HINT_T0);
+                _mm_prefetch(ptr + 31, _MM_HINT_T0);
+            }
+
+            Hash32(blk, digest);
+        }
+    }
+};
+
+#undef f1
+#undef f2
+#undef f3
+#undef f4
+#undef f5
+#undef ROL
+#undef add3
+#undef add4
+#undef Round
+#undef R11
+#undef R21
+#undef R31
+#undef R41
+#undef R51
+#undef R12
+#undef R22
+#undef R32
+#undef R42
+#undef R52
+
+}  // namespace ripemd160avx2
+
+#endif  // RIPEMD160_ROUNDS_H
@@ -0,0 +1,28 @@
+#include "ripemd160_dispatch.h"
+#include <immintrin.h>
+
+// SSE4.1 kernel, 4 messages per transform. Only called after the dispatcher
+// has checked the CPU.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC target("sse4.1")
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse4.1"))), apply_to = function)
+#endif
+
+#include "ripemd160_rounds.h"
+
+void ripemd160sse41_batch(const uint8_t *in, size_t stride, size_t n, uint8_t *out) {
+    ripemd160avx2::Rounds<VecSse41>::HashStrided(in, stride, n, out);
+}
+
+void ripemd160sse41_counter32(const uint8_t *key, size_t n, uint8_t *out) {
+    ripemd160avx2::Rounds<VecSse41>::HashCounter32(key, n, out);
+}
+
+void ripemd160sse41_random32(uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t *out) {
+    ripemd160avx2::Rounds<VecSse41>::HashRandom32(seed, stream, block, n, out);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
@@ -1,124 +1,352 @@
 #include "sha256_avx2.h"
 #include <immintrin.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdint.h>
 
+// This file is built for AVX2 whatever the command line says, callers check
+// the CPU first (see sha256_dispatch.cpp)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC target("avx2")
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#endif
+
+#include "sha256_rounds.h"
+
 namespace _sha256avx2 {
 
-#ifdef _MSC_VER
-#define ALIGN32 __declspec(align(32))
-#else
-#define ALIGN32 __attribute__((aligned(32)))
-#endif
+typedef Rounds<VecAvx2> R;
+typedef Rounds<VecAvx2x2> R2;
 
 // Initialize SHA-256 state with initial hash values
 void Initialize(__m256i* s) {
-    const uint32_t init[8] = {
-        0x6a09e667,
-        0xbb67ae85,
-        0x3c6ef372,
-        0xa54ff53a,
-        0x510e527f,
-        0x9b05688c,
-        0x1f83d9ab,
-        0x5be0cd19
-    };
-
-    for (int i = 0; i < 8; ++i) {
-        s[i] = _mm256_set1_epi32(init[i]);
-    }
-}
-
-// SHA-256 macros using AVX2 intrinsics
-#define Maj(x, y, z) _mm256_or_si256(_mm256_and_si256(x, y), _mm256_and_si256(z, _mm256_or_si256(x, y)))
-#define Ch(x, y, z)  _mm256_xor_si256(_mm256_and_si256(x, y), _mm256_andnot_si256(x, z))
-#define ROR(x, n)    _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n))
-#define SHR(x, n)    _mm256_srli_epi32(x, n)
-
-#define S0(x) (_mm256_xor_si256(ROR(x, 2), _mm256_xor_si256(ROR(x, 13), ROR(x, 22))))
-#define S1(x) (_mm256_xor_si256(ROR(x, 6), _mm256_xor_si256(ROR(x, 11), ROR(x, 25))))
-#define s0(x) (_mm256_xor_si256(ROR(x, 7), _mm256_xor_si256(ROR(x, 18), SHR(x, 3))))
-#define s1(x) (_mm256_xor_si256(ROR(x, 17), _mm256_xor_si256(ROR(x, 19), SHR(x, 10))))
-
-#define Round(a, b, c, d, e, f, g, h, Kt, Wt)                                    \
-    T1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(h, S1(e)), Ch(e, f, g)), Kt), Wt); \
-    T2 = _mm256_add_epi32(S0(a), Maj(a, b, c));                                  \
-    h = g;                                                                       \
-    g = f;                                                                       \
-    f = e;                                                                       \
-    e = _mm256_add_epi32(d, T1);                                                 \
-    d = c;                                                                       \
-    c = b;                                                                       \
-    b = a;                                                                       \
-    a = _mm256_add_epi32(T1, T2);
+    R::Initialize(s);
+}
 
 void Transform(__m256i* state, const uint8_t* data[8]) {
+    R::Transform(state, data);
+}
+
+void Transform2(__m256i* state, const uint8_t* data[16]) {
+    VecAvx2x2::vec s[8];
+    for (int i = 0; i < 8; ++i) {
+        s[i] = VecAvx2x2::Make(state[i], state[i + 8]);
+    }
+
+    R2::Transform(s, data);
+
+    for (int i = 0; i < 8; ++i) {
+        state[i] = s[i].lo;
+        state[i + 8] = s[i].hi;
+    }
+}
+
+// Precompute everything that does not depend on message word 8
+void PrepareMidstate(Midstate* m, const uint8_t* block) {
     __m256i a, b, c, d, e, f, g, h;
-    __m256i W[64];
-    __m256i T1, T2;
-
-    // Load state into local variables
-    a = state[0];
-    b = state[1];
-    c = state[2];
-    d = state[3];
-    e = state[4];
-    f = state[5];
-    g = state[6];
-    h = state[7];
-
-    // Prepare message schedule W[0..15]
+    __m256i W[23];
+
+    Initialize(m->init);
+
+    // Message words shared by all lanes (W[8] is filled in per batch)
     for (int t = 0; t < 16; ++t) {
-        uint32_t wt[8];
-        for (int i = 0; i < 8; ++i) {
-            const uint8_t* ptr = data[i] + t * 4;
-            wt[i] = ((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | ((uint32_t)ptr[3]);
-        }
-        W[t] = _mm256_setr_epi32(wt[0], wt[1], wt[2], wt[3], wt[4], wt[5], wt[6], wt[7]);
+        const uint8_t* ptr = block + t * 4;
+        W[t] = _mm256_set1_epi32((int)(((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | ((uint32_t)ptr[3])));
     }
 
-    // Message schedule (message expansion) W[16..63]
-    for (int t = 16; t < 64; ++t) {
+    // W[16..22] do not reference W[8]
+    for (int t = 16; t < 23; ++t) {
         W[t] = _mm256_add_epi32(
-                    _mm256_add_epi32(s1(W[t - 2]), W[t - 7]),
-                    _mm256_add_epi32(s0(W[t - 15]), W[t - 16]));
-    }
-
-    // SHA-256 constants
-    static const uint32_t K[64] = {
-        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
-        0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
-        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
-        0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
-        0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
-        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
-        0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
-        0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
-    };
-
-    // Main loop of SHA-256
-    for (int t = 0; t < 64; ++t) {
+                    _mm256_add_epi32(R::s1(W[t - 2]), W[t - 7]),
+                    _mm256_add_epi32(R::s0(W[t - 15]), W[t - 16]));
+    }
+
+    // Rounds 0..7
+    a = m->init[0];
+    b = m->init[1];
+    c = m->init[2];
+    d = m->init[3];
+    e = m->init[4];
+    f = m->init[5];
+    g = m->init[6];
+    h = m->init[7];
+
+    for (int t = 0; t < 8; ++t) {
         __m256i Kt = _mm256_set1_epi32(K[t]);
-        Round(a, b, c, d, e, f, g, h, Kt, W[t]);
+        R::Round(a, b, c, d, e, f, g, h, Kt, W[t]);
+    }
+
+    m->mid[0] = a;
+    m->mid[1] = b;
+    m->mid[2] = c;
+    m->mid[3] = d;
+    m->mid[4] = e;
+    m->mid[5] = f;
+    m->mid[6] = g;
+    m->mid[7] = h;
+
+    // K[t] + W[t] for the constant words of rounds 9..22
+    for (int t = 9; t < 23; ++t) {
+        m->KW[t] = _mm256_add_epi32(_mm256_set1_epi32(K[t]), W[t]);
+    }
+
+    // Raw W[16..22] and the constant parts of W[23..37]
+    for (int t = 16; t < 23; ++t) {
+        m->W[t] = W[t];
+    }
+    m->W[23] = _mm256_add_epi32(_mm256_add_epi32(R::s1(W[21]), W[16]), W[7]);
+    m->W[24] = _mm256_add_epi32(_mm256_add_epi32(R::s1(W[22]), W[17]), R::s0(W[9]));
+    for (int t = 25; t < 30; ++t) {
+        m->W[t] = _mm256_add_epi32(W[t - 7], _mm256_add_epi32(R::s0(W[t - 15]), W[t - 16]));
+    }
+    m->W[30] = _mm256_add_epi32(R::s0(W[15]), W[14]);
+    for (int t = 31; t < 38; ++t) {
+        m->W[t] = _mm256_add_epi32(R::s0(W[t - 15]), W[t - 16]);
+    }
+}
+
+// Message schedule of a midstate block with message word 8 = w8, reusing the
+// constant parts (W[9..15] are not needed, rounds 9..22 use m->KW)
+static inline void MidstateSchedule(__m256i* W, const Midstate* m, __m256i w8) {
+    W[8] = w8;
+    for (int t = 16; t < 23; ++t) {
+        W[t] = m->W[t];
+    }
+    W[23] = _mm256_add_epi32(R::s0(w8), m->W[23]);
+    W[24] = _mm256_add_epi32(w8, m->W[24]);
+    for (int t = 25; t < 30; ++t) {
+        W[t] = _mm256_add_epi32(R::s1(W[t - 2]), m->W[t]);
+    }
+    for (int t = 30; t < 38; ++t) {
+        W[t] = _mm256_add_epi32(_mm256_add_epi32(R::s1(W[t - 2]), W[t - 7]), m->W[t]);
+    }
+    for (int t = 38; t < 64; ++t) {
+        W[t] = _mm256_add_epi32(
+                    _mm256_add_epi32(R::s1(W[t - 2]), W[t - 7]),
+                    _mm256_add_epi32(R::s0(W[t - 15]), W[t - 16]));
+    }
+}
+
+// Rounds 8..last-1 from a midstate on the working variables v[0..7] = a..h
+static inline void MidstateRounds(__m256i* v, const Midstate* m, const __m256i* W, int last) {
+    __m256i a = m->mid[0], b = m->mid[1], c = m->mid[2], d = m->mid[3];
+    __m256i e = m->mid[4], f = m->mid[5], g = m->mid[6], h = m->mid[7];
+
+    // K[t] + W[t] is precomputed for rounds 9..22
+    R::Round(a, b, c, d, e, f, g, h, _mm256_set1_epi32(K[8]), W[8]);
+    for (int t = 9; t < 23; ++t) {
+        R::Round(a, b, c, d, e, f, g, h, m->KW[t], _mm256_setzero_si256());
+    }
+    for (int t = 23; t < last; ++t) {
+        R::Round(a, b, c, d, e, f, g, h, _mm256_set1_epi32(K[t]), W[t]);
+    }
+
+    v[0] = a; v[1] = b; v[2] = c; v[3] = d;
+    v[4] = e; v[5] = f; v[6] = g; v[7] = h;
+}
+
+// Finish the transform from a midstate, only message word 8 differs per lane
+void TransformMidstate(__m256i* state, const Midstate* m, __m256i w8) {
+    __m256i W[64];
+    __m256i v[8];
+
+    MidstateSchedule(W, m, w8);
+    MidstateRounds(v, m, W, 64);
+
+    for (int i = 0; i < 8; ++i) {
+        state[i] = _mm256_add_epi32(m->init[i], v[i]);
+    }
+}
+
+void PrepareMatch(DigestMatch* match, const uint8_t mask[32], const uint8_t value[32]) {
+    match->words = 0;
+    for (int i = 0; i < 8; ++i) {
+        const uint8_t* mp = mask + i * 4;
+        const uint8_t* vp = value + i * 4;
+        uint32_t mw = ((uint32_t)mp[0] << 24) | ((uint32_t)mp[1] << 16) | ((uint32_t)mp[2] << 8) | mp[3];
+        uint32_t vw = ((uint32_t)vp[0] << 24) | ((uint32_t)vp[1] << 16) | ((uint32_t)vp[2] << 8) | vp[3];
+        match->mask[i] = _mm256_set1_epi32((int)mw);
+        match->value[i] = _mm256_set1_epi32((int)(vw & mw));
+        if (mw != 0) {
+            match->words |= 1 << i;
+        }
+    }
+}
+
+// Lanes of pass where word matches digest word i of the search
+static inline __m256i MatchWord(__m256i pass, __m256i word, const DigestMatch* match, int i) {
+    if (!(match->words & (1 << i))) {
+        return pass;
+    }
+    __m256i eq = _mm256_cmpeq_epi32(_mm256_and_si256(word, match->mask[i]), match->value[i]);
+    return _mm256_and_si256(pass, eq);
+}
+
+// After round t (60..63) the new a is final for digest word 63 - t and the new
+// e for word 67 - t, so the last rounds run only while some lane can match
+int TransformMidstateMatch(__m256i* state, const Midstate* m, __m256i w8, const DigestMatch* match) {
+    __m256i W[64];
+    __m256i v[8];
+
+    MidstateSchedule(W, m, w8);
+    MidstateRounds(v, m, W, 60);
+
+    __m256i pass = _mm256_set1_epi32(-1);
+    for (int t = 60; t < 64; ++t) {
+        R::Round(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], _mm256_set1_epi32(K[t]), W[t]);
+
+        int j = 63 - t;
+        if (match->words & (0x11 << j)) {
+            pass = MatchWord(pass, _mm256_add_epi32(m->init[j], v[0]), match, j);
+            pass = MatchWord(pass, _mm256_add_epi32(m->init[j + 4], v[4]), match, j + 4);
+            if (_mm256_testz_si256(pass, pass)) {
+                return 0;
+            }
+        }
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        state[i] = _mm256_add_epi32(m->init[i], v[i]);
+    }
+    return _mm256_movemask_ps(_mm256_castsi256_ps(pass));
+}
+
+// The nonce is message word 3 of the second block; W[t] for t < 18 and t != 3
+// are constants
+static inline bool HeaderWordIsConstant(int t) {
+    return t < 18 && t != 3;
+}
+
+// Precompute everything that does not depend on the nonce
+void PrepareHeader(HeaderMidstate* m, const uint8_t header[80]) {
+    __m256i W[18];
+
+    // First block
+    const uint8_t* first[8] = { header, header, header, header, header, header, header, header };
+    Initialize(m->init);
+    Transform(m->init, first);
+
+    // Second block: merkle root tail, time, bits, nonce and the padding of 80 bytes
+    for (int t = 0; t < 3; ++t) {
+        const uint8_t* ptr = header + 64 + t * 4;
+        W[t] = _mm256_set1_epi32((int)(((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | ((uint32_t)ptr[3])));
+    }
+    W[3] = _mm256_setzero_si256();
+    W[4] = _mm256_set1_epi32((int)0x80000000);
+    for (int t = 5; t < 15; ++t) {
+        W[t] = _mm256_setzero_si256();
+    }
+    W[15] = _mm256_set1_epi32(80 * 8);
+    for (int t = 16; t < 18; ++t) {
+        W[t] = _mm256_add_epi32(
+                    _mm256_add_epi32(R::s1(W[t - 2]), W[t - 7]),
+                    _mm256_add_epi32(R::s0(W[t - 15]), W[t - 16]));
+    }
+
+    // Rounds 0..2 come before the nonce
+    __m256i a = m->init[0], b = m->init[1], c = m->init[2], d = m->init[3];
+    __m256i e = m->init[4], f = m->init[5], g = m->init[6], h = m->init[7];
+    for (int t = 0; t < 3; ++t) {
+        R::Round(a, b, c, d, e, f, g, h, _mm256_set1_epi32(K[t]), W[t]);
+    }
+    m->pre[0] = a;
+    m->pre[1] = b;
+    m->pre[2] = c;
+    m->pre[3] = d;
+    m->pre[4] = e;
+    m->pre[5] = f;
+    m->pre[6] = g;
+    m->pre[7] = h;
+
+    for (int t = 4; t < 18; ++t) {
+        m->KW[t] = _mm256_add_epi32(_mm256_set1_epi32(K[t]), W[t]);
+    }
+
+    // Sum of the constant terms of W[18..33], later words have no constant term
+    for (int t = 18; t < 34; ++t) {
+        __m256i sum = _mm256_setzero_si256();
+        if (HeaderWordIsConstant(t - 2)) sum = _mm256_add_epi32(sum, R::s1(W[t - 2]));
+        if (HeaderWordIsConstant(t - 7)) sum = _mm256_add_epi32(sum, W[t - 7]);
+        if (HeaderWordIsConstant(t - 15)) sum = _mm256_add_epi32(sum, R::s0(W[t - 15]));
+        if (HeaderWordIsConstant(t - 16)) sum = _mm256_add_epi32(sum, W[t - 16]);
+        m->C[t] = sum;
+    }
+}
+
+// Second block of the header from the midstate, only the nonce differs per lane
+void TransformHeader(__m256i* state, const HeaderMidstate* m, __m256i nonce) {
+    __m256i W[64];
+
+    // The nonce is stored little-endian, message words are big-endian
+    __m256i w3 = VecAvx2::Bswap(nonce);
+
+    W[18] = _mm256_add_epi32(R::s0(w3), m->C[18]);
+    W[19] = _mm256_add_epi32(w3, m->C[19]);
+    for (int t = 20; t < 25; ++t) {
+        W[t] = _mm256_add_epi32(R::s1(W[t - 2]), m->C[t]);
+    }
+    for (int t = 25; t < 33; ++t) {
+        W[t] = _mm256_add_epi32(_mm256_add_epi32(R::s1(W[t - 2]), W[t - 7]), m->C[t]);
+    }
+    W[33] = _mm256_add_epi32(
+                _mm256_add_epi32(R::s1(W[31]), W[26]),
+                _mm256_add_epi32(R::s0(W[18]), m->C[33]));
+    for (int t = 34; t < 64; ++t) {
+        W[t] = _mm256_add_epi32(
+                    _mm256_add_epi32(R::s1(W[t - 2]), W[t - 7]),
+                    _mm256_add_epi32(R::s0(W[t - 15]), W[t - 16]));
     }
 
-    // Add the compressed chunk to the current hash value
-    state[0] = _mm256_add_epi32(state[0], a);
-    state[1] = _mm256_add_epi32(state[1], b);
-    state[2] = _mm256_add_epi32(state[2], c);
-    state[3] = _mm256_add_epi32(state[3], d);
-    state[4] = _mm256_add_epi32(state[4], e);
-    state[5] = _mm256_add_epi32(state[5], f);
-    state[6] = _mm256_add_epi32(state[6], g);
-    state[7] = _mm256_add_epi32(state[7], h);
+    __m256i a = m->pre[0], b = m->pre[1], c = m->pre[2], d = m->pre[3];
+    __m256i e = m->pre[4], f = m->pre[5], g = m->pre[6], h = m->pre[7];
+
+    // Round 3 takes the nonce, rounds 4..17 only constants
+    R::Round(a, b, c, d, e, f, g, h, _mm256_set1_epi32(K[3]), w3);
+    for (int t = 4; t < 18; ++t) {
+        R::Round(a, b, c, d, e, f, g, h, m->KW[t], _mm256_setzero_si256());
+    }
+    for (int t = 18; t < 64; ++t) {
+        R::Round(a, b, c, d, e, f, g, h, _mm256_set1_epi32(K[t]), W[t]);
+    }
+
+    state[0] = _mm256_add_epi32(m->init[0], a);
+    state[1] = _mm256_add_epi32(m->init[1], b);
+    state[2] = _mm256_add_epi32(m->init[2], c);
+    state[3] = _mm256_add_epi32(m->init[3], d);
+    state[4] = _mm256_add_epi32(m->init[4], e);
+    state[5] = _mm256_add_epi32(m->init[5], f);
+    state[6] = _mm256_add_epi32(m->init[6], g);
+    state[7] = _mm256_add_epi32(m->init[7], h);
+}
+
+// H7 = H0[7] + h after round 63, and h then is the e computed in round 60
+__m256i Sha256dH7(const __m256i* state) {
+    __m256i W[64];
+    __m256i v[8];
+
+    for (int i = 0; i < 8; ++i) {
+        W[i] = state[i];
+    }
+    W[8] = _mm256_set1_epi32((int)0x80000000);
+
+    R::Initialize(v);
+    R::ScheduleLen<32>(W, 61);
+    R::FirstRoundsLen<32>(v, W);
+    for (int t = 16; t < 60; ++t) {
+        R::Round(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], _mm256_set1_epi32(K[t]), W[t]);
+    }
+
+    // Round 60, e only
+    __m256i T1 = _mm256_add_epi32(
+                    _mm256_add_epi32(_mm256_add_epi32(v[7], R::S1(v[4])), R::Ch(v[4], v[5], v[6])),
+                    _mm256_add_epi32(_mm256_set1_epi32(K[60]), W[60]));
+    return _mm256_add_epi32(_mm256_add_epi32(v[3], T1), _mm256_set1_epi32((int)H0[7]));
+}
+
+// Copy one digest per lane to the output buffers
+static void StoreDigests(const __m256i* state, unsigned char* hashArray[8]) {
+    R::StoreDigests(state, hashArray);
 }
 
 } // namespace _sha256avx2
@@ -139,27 +367,688 @@ void sha256avx2_8B(
     // Process the data blocks
     _sha256avx2::Transform(state, data);
 
-    // Store the resulting state
-    ALIGN32 uint32_t digest[8][8]; // digest[state_index][element_index]
+    unsigned char* hashArray[8] = { hash0, hash1, hash2, hash3, hash4, hash5, hash6, hash7 };
+
+    // Extract the hash values and copy to output buffers
+    _sha256avx2::StoreDigests(state, hashArray);
+}
+
+template <size_t Len>
+void sha256avx2_8B(
+    const uint8_t* data0, const uint8_t* data1, const uint8_t* data2, const uint8_t* data3,
+    const uint8_t* data4, const uint8_t* data5, const uint8_t* data6, const uint8_t* data7,
+    unsigned char* hash0, unsigned char* hash1, unsigned char* hash2, unsigned char* hash3,
+    unsigned char* hash4, unsigned char* hash5, unsigned char* hash6, unsigned char* hash7) {
+
+    __m256i state[8];
+
+    const uint8_t* data[8] = { data0, data1, data2, data3, data4, data5, data6, data7 };
+
+    // Process the messages, padding is generated in registers
+    _sha256avx2::R::TransformLen<Len>(state, data);
+
+    unsigned char* hashArray[8] = { hash0, hash1, hash2, hash3, hash4, hash5, hash6, hash7 };
+
+    // Extract the hash values and copy to output buffers
+    _sha256avx2::StoreDigests(state, hashArray);
+}
+
+template void sha256avx2_8B<32>(
+    const uint8_t*, const uint8_t*, const uint8_t*, const uint8_t*,
+    const uint8_t*, const uint8_t*, const uint8_t*, const uint8_t*,
+    unsigned char*, unsigned char*, unsigned char*, unsigned char*,
+    unsigned char*, unsigned char*, unsigned char*, unsigned char*);
 
+template void sha256avx2_8B<33>(
+    const uint8_t*, const uint8_t*, const uint8_t*, const uint8_t*,
+    const uint8_t*, const uint8_t*, const uint8_t*, const uint8_t*,
+    unsigned char*, unsigned char*, unsigned char*, unsigned char*,
+    unsigned char*, unsigned char*, unsigned char*, unsigned char*);
+
+void sha256avx2_8B_midstate(
+    const _sha256avx2::Midstate* midstate, const uint32_t w8[8],
+    unsigned char* hash0, unsigned char* hash1, unsigned char* hash2, unsigned char* hash3,
+    unsigned char* hash4, unsigned char* hash5, unsigned char* hash6, unsigned char* hash7) {
+
+    __m256i state[8];
+
+    __m256i w = _mm256_loadu_si256((const __m256i*)w8);
+
+    // Process the data blocks from the shared midstate
+    _sha256avx2::TransformMidstate(state, midstate, w);
+
+    unsigned char* hashArray[8] = { hash0, hash1, hash2, hash3, hash4, hash5, hash6, hash7 };
+
+    // Extract the hash values and copy to output buffers
+    _sha256avx2::StoreDigests(state, hashArray);
+}
+
+int sha256avx2_8B_midstate_match(
+    const _sha256avx2::Midstate* midstate, const uint32_t w8[8],
+    const _sha256avx2::DigestMatch* match, unsigned char* hash[8]) {
+
+    __m256i state[8];
+
+    __m256i w = _mm256_loadu_si256((const __m256i*)w8);
+    int found = _sha256avx2::TransformMidstateMatch(state, midstate, w, match);
+    if (found == 0) {
+        return 0;
+    }
+
+    // Depack the matching lanes only
+    alignas(32) uint32_t words[8][8];
     for (int i = 0; i < 8; ++i) {
-        _mm256_store_si256((__m256i*)digest[i], state[i]);
+        _mm256_store_si256((__m256i*)words[i], VecAvx2::Bswap(state[i]));
+    }
+    for (int lane = 0; lane < 8; ++lane) {
+        if (found & (1 << lane)) {
+            for (int i = 0; i < 8; ++i) {
+                memcpy(hash[lane] + i * 4, &words[i][lane], 4);
+            }
+        }
     }
+    return found;
+}
 
-    unsigned char* hashArray[8] = { hash0, hash1, hash2, hash3, hash4, hash5, hash6, hash7 };
+void sha256avx2_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    _sha256avx2::R::HashStrided<0>(in, stride, n, out);
+}
+
+template <size_t Len>
+void sha256avx2_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    _sha256avx2::R::HashStrided<Len>(in, stride, n, out);
+}
+
+template void sha256avx2_batch<32>(const uint8_t*, size_t, size_t, uint8_t*);
+template void sha256avx2_batch<33>(const uint8_t*, size_t, size_t, uint8_t*);
+
+void sha256avx2x2_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    _sha256avx2::R2::HashStrided<0>(in, stride, n, out);
+}
+
+template <size_t Len>
+void sha256avx2x2_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    _sha256avx2::R2::HashStrided<Len>(in, stride, n, out);
+}
+
+template void sha256avx2x2_batch<32>(const uint8_t*, size_t, size_t, uint8_t*);
+template void sha256avx2x2_batch<33>(const uint8_t*, size_t, size_t, uint8_t*);
+
+void sha256avx2_counter33(const uint8_t* key, size_t n, uint8_t* out) {
+    _sha256avx2::R::HashCounter33(key, n, out);
+}
+
+void sha256avx2x2_counter33(const uint8_t* key, size_t n, uint8_t* out) {
+    _sha256avx2::R2::HashCounter33(key, n, out);
+}
+
+void sha256avx2_random33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t* out) {
+    _sha256avx2::R::HashRandom33(prefix, seed, stream, block, n, out);
+}
+
+void sha256avx2x2_random33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t* out) {
+    _sha256avx2::R2::HashRandom33(prefix, seed, stream, block, n, out);
+}
+
+namespace _sha256avx2 {
+
+// Lanes whose digest words match (used when the midstate does not apply)
+static int MatchLanes(const __m256i* state, const DigestMatch* match) {
+    __m256i pass = _mm256_set1_epi32(-1);
+    for (int i = 0; i < 8; ++i) {
+        pass = MatchWord(pass, state[i], match, i);
+    }
+    return _mm256_movemask_ps(_mm256_castsi256_ps(pass));
+}
+
+// Midstate of the keys held by the counter in lane 0, message word 8 ignored
+static void PrepareCounterMidstate(Midstate* m, const __m256i* W) {
+    alignas(32) uint8_t block[64] = {0};
+    for (int k = 0; k < 8; ++k) {
+        uint32_t w = (uint32_t)_mm256_cvtsi256_si32(W[k]);
+        block[k * 4] = (uint8_t)(w >> 24);
+        block[k * 4 + 1] = (uint8_t)(w >> 16);
+        block[k * 4 + 2] = (uint8_t)(w >> 8);
+        block[k * 4 + 3] = (uint8_t)w;
+    }
+    block[33] = 0x80;
+    block[62] = (33 * 8) >> 8;
+    block[63] = (uint8_t)(33 * 8);
+    PrepareMidstate(m, block);
+}
+
+// Counter keys through the midstate: groups of 8 keys that share bytes 0..31
+// only differ in message word 8. A group that straddles a change of byte 31
+// takes the full transform. Without a match every digest is written to out,
+// otherwise only the matching ones, with their key offsets in index.
+static size_t HashCounter33Midstate(const uint8_t* key, size_t n, const DigestMatch* match,
+                                    uint32_t* index, uint8_t* out) {
+    uint32_t digits[9];
+    KeyDigits33(key, digits);
+
+    VecCounter<VecAvx2, 9> counter;
+    counter.Init(digits);
+
+    Midstate m;
+    bool midstateValid = false;
+    uint32_t low = digits[0] & 0xFF;   // Last key byte of lane 0
+    size_t found = 0;
+    unsigned char scratch[8][32];
+
+    for (size_t base = 0; base < n; base += 8) {
+        __m256i W[64];
+        __m256i state[8];
+        int lanes = (n - base < 8) ? (1 << (n - base)) - 1 : 0xFF;
+
+        R::CounterWords33(W, counter.c);
+        if (low <= 0xF8) {
+            if (!midstateValid) {
+                PrepareCounterMidstate(&m, W);
+                midstateValid = true;
+            }
+            if (match) {
+                lanes &= TransformMidstateMatch(state, &m, W[8], match);
+            } else {
+                TransformMidstate(state, &m, W[8]);
+            }
+        } else {
+            R::TransformLenWords<33>(state, W);
+            midstateValid = false;
+            if (match) {
+                lanes &= MatchLanes(state, match);
+            }
+        }
+
+        if (!match) {
+            unsigned char* hashArray[8];
+            for (int i = 0; i < 8; ++i) {
+                hashArray[i] = (lanes & (1 << i)) ? out + (base + i) * 32 : scratch[i];
+            }
+            StoreDigests(state, hashArray);
+        } else if (lanes != 0) {
+            alignas(32) uint32_t words[8][8];
+            for (int i = 0; i < 8; ++i) {
+                _mm256_store_si256((__m256i*)words[i], VecAvx2::Bswap(state[i]));
+            }
+            for (int lane = 0; lane < 8; ++lane) {
+                if (lanes & (1 << lane)) {
+                    for (int i = 0; i < 8; ++i) {
+                        memcpy(out + found * 32 + i * 4, &words[i][lane], 4);
+                    }
+                    index[found++] = (uint32_t)(base + lane);
+                }
+            }
+        }
+
+        counter.Next();
+
+        // Byte 31 changes when the last byte wraps
+        uint32_t next = (low + 8) & 0xFF;
+        if (next < low) {
+            midstateValid = false;
+        }
+        low = next;
+    }
+
+    return found;
+}
+
+} // namespace _sha256avx2
+
+void sha256avx2_counter33_midstate(const uint8_t* key, size_t n, uint8_t* out) {
+    _sha256avx2::HashCounter33Midstate(key, n, nullptr, nullptr, out);
+}
+
+size_t sha256avx2_counter33_match(const uint8_t* key, size_t n, const _sha256avx2::DigestMatch* match,
+                                  uint32_t* index, uint8_t* out) {
+    return _sha256avx2::HashCounter33Midstate(key, n, match, index, out);
+}
+
+// Compare two 32-byte little-endian numbers
+static bool HashAtMostTarget(const unsigned char* hash, const uint8_t* target) {
+    for (int i = 31; i >= 0; --i) {
+        if (hash[i] != target[i]) {
+            return hash[i] < target[i];
+        }
+    }
+    return true;
+}
+
+bool sha256davx2_scan(const uint8_t header[80], const uint8_t target[32],
+                      uint32_t nonceStart, uint64_t count,
+                      uint32_t* nonce, unsigned char hash[32]) {
+    _sha256avx2::HeaderMidstate m;
+    _sha256avx2::PrepareHeader(&m, header);
+
+    // Hash bytes 28..31 as a little-endian word are the byte-swapped H7
+    uint32_t targetTop;
+    memcpy(&targetTop, target + 28, 4);
+    const __m256i top = _mm256_set1_epi32((int)targetTop);
+    const __m256i laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    for (uint64_t i = 0; i < count; i += 8) {
+        uint32_t base = nonceStart + (uint32_t)i;
+        __m256i nonces = _mm256_add_epi32(_mm256_set1_epi32((int)base), laneOffsets);
+
+        __m256i state[8];
+        _sha256avx2::TransformHeader(state, &m, nonces);
+
+        // Early rejection on the top word: unsigned hashTop <= targetTop
+        __m256i hashTop = VecAvx2::Bswap(_sha256avx2::Sha256dH7(state));
+        __m256i pass = _mm256_cmpeq_epi32(_mm256_max_epu32(hashTop, top), top);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(pass));
+        if (count - i < 8) {
+            mask &= (1 << (count - i)) - 1;
+        }
+        if (mask == 0) {
+            continue;
+        }
+
+        // Rare: finish the second hash and compare the full 256 bits
+        __m256i W[64];
+        for (int j = 0; j < 8; ++j) {
+            W[j] = state[j];
+        }
+        W[8] = _mm256_set1_epi32((int)0x80000000);
+        __m256i state2[8];
+        _sha256avx2::R::TransformLenWords<32>(state2, W);
+
+        unsigned char digest[8][32];
+        unsigned char* hashArray[8] = { digest[0], digest[1], digest[2], digest[3], digest[4], digest[5], digest[6], digest[7] };
+        _sha256avx2::StoreDigests(state2, hashArray);
+
+        for (int j = 0; j < 8; ++j) {
+            if ((mask & (1 << j)) && HashAtMostTarget(digest[j], target)) {
+                *nonce = base + j;
+                memcpy(hash, digest[j], 32);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// K[t] + W[t] of the padding block that follows a 64-byte message
+static void PaddingBlockKW(uint32_t* KW) {
+    uint32_t W[64] = { 0x80000000 };
+    W[15] = 64 * 8;
+    for (int t = 16; t < 64; ++t) {
+        W[t] = _sha256avx2::sig1(W[t - 2]) + W[t - 7] + _sha256avx2::sig0(W[t - 15]) + W[t - 16];
+    }
+    for (int t = 0; t < 64; ++t) {
+        KW[t] = _sha256avx2::K[t] + W[t];
+    }
+}
+
+// sha256d of 8 messages of 64 bytes (two concatenated nodes per lane)
+static void MerklePairs8(const uint8_t* const* pairs, unsigned char* const* out, const uint32_t* paddingKW) {
+    typedef _sha256avx2::R R;
+    __m256i state[8];
+
+    R::Initialize(state);
+    R::Transform(state, pairs);
+
+    // The padding block is the same for every lane, only K[t] + W[t] is needed
+    __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+    __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int t = 0; t < 64; ++t) {
+        R::Round(a, b, c, d, e, f, g, h, _mm256_set1_epi32((int)paddingKW[t]), _mm256_setzero_si256());
+    }
+
+    // Second SHA-256 on the 32-byte digest words, still in registers
+    __m256i W[64];
+    W[0] = _mm256_add_epi32(state[0], a);
+    W[1] = _mm256_add_epi32(state[1], b);
+    W[2] = _mm256_add_epi32(state[2], c);
+    W[3] = _mm256_add_epi32(state[3], d);
+    W[4] = _mm256_add_epi32(state[4], e);
+    W[5] = _mm256_add_epi32(state[5], f);
+    W[6] = _mm256_add_epi32(state[6], g);
+    W[7] = _mm256_add_epi32(state[7], h);
+    W[8] = _mm256_set1_epi32((int)0x80000000);
+    R::TransformLenWords<32>(state, W);
+
+    R::StoreDigests(state, out);
+}
+
+void sha256davx2_merkle_level(const uint8_t* in, size_t n, uint8_t* out) {
+    uint32_t paddingKW[64];
+    PaddingBlockKW(paddingKW);
+
+    // Adjacent nodes already form the 64-byte messages, except for the
+    // duplicated last node of an odd level
+    size_t pairs = (n + 1) / 2;
+    uint8_t lastPair[64];
+    if (n % 2 == 1) {
+        memcpy(lastPair, in + (n - 1) * 32, 32);
+        memcpy(lastPair + 32, in + (n - 1) * 32, 32);
+    }
+
+    long long groups = (long long)((pairs + 7) / 8);
+
+    #pragma omp parallel for schedule(static) if (groups >= 256)
+    for (long long group = 0; group < groups; ++group) {
+        size_t base = (size_t)group * 8;
+        const uint8_t* data[8];
+        unsigned char* digest[8];
+        unsigned char scratch[8][32];
+
+        // Idle lanes of the last group rehash the last pair into scratch
+        for (size_t i = 0; i < 8; ++i) {
+            size_t pair = (base + i < pairs) ? base + i : pairs - 1;
+            data[i] = (n % 2 == 1 && pair == pairs - 1) ? lastPair : in + pair * 64;
+            digest[i] = (base + i < pairs) ? out + pair * 32 : scratch[i];
+        }
+
+        MerklePairs8(data, digest, paddingKW);
+    }
+}
+
+bool sha256davx2_merkle_root(const uint8_t* leaves, size_t n, uint8_t root[32]) {
+    if (n == 0) {
+        return false;
+    }
+    if (n == 1) {
+        memcpy(root, leaves, 32);
+        return true;
+    }
+
+    // Two level buffers, each level is half the size of the previous one
+    size_t size = ((n + 1) / 2) * 32;
+    uint8_t* buffer = (uint8_t*)malloc(2 * size);
+    if (buffer == nullptr) {
+        return false;
+    }
+    uint8_t* level[2] = { buffer, buffer + size };
+
+    sha256davx2_merkle_level(leaves, n, level[0]);
+    n = (n + 1) / 2;
+
+    int current = 0;
+    while (n > 1) {
+        sha256davx2_merkle_level(level[current], n, level[current ^ 1]);
+        current ^= 1;
+        n = (n + 1) / 2;
+    }
+
+    memcpy(root, level[current], 32);
+    free(buffer);
+    return true;
+}
+
+Sha256x8::Sha256x8() {
+    reset();
+}
+
+void Sha256x8::reset() {
+    _sha256avx2::Initialize(state);
+    for (int i = 0; i < 8; ++i) {
+        bufferLen[i] = 0;
+        total[i] = 0;
+    }
+}
+
+void Sha256x8::process(const uint8_t* blocks[8], int mask) {
+    __m256i prev[8];
+
+    for (int i = 0; i < 8; ++i) {
+        prev[i] = state[i];
+    }
+
+    _sha256avx2::Transform(state, blocks);
+
+    if (mask != 0xFF) {
+        // Restore the lanes that had no block to process
+        const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        __m256i active = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(mask), bits), bits);
+        for (int i = 0; i < 8; ++i) {
+            state[i] = _mm256_blendv_epi8(prev[i], state[i], active);
+        }
+    }
+}
+
+void Sha256x8::update(const uint8_t* const data[8], const size_t len[8]) {
+    const uint8_t* ptr[8];
+    size_t remaining[8];
+
+    for (int i = 0; i < 8; ++i) {
+        ptr[i] = data[i];
+        remaining[i] = len[i];
+        total[i] += len[i];
+
+        // Top up a partial block first
+        if (bufferLen[i] > 0 && remaining[i] > 0) {
+            size_t n = 64 - bufferLen[i];
+            if (n > remaining[i]) {
+                n = remaining[i];
+            }
+            memcpy(buffer[i] + bufferLen[i], ptr[i], n);
+            bufferLen[i] += n;
+            ptr[i] += n;
+            remaining[i] -= n;
+        }
+    }
+
+    // Compress full blocks, straight from the input when the lane has no partial block
+    for (;;) {
+        const uint8_t* blocks[8];
+        int mask = 0;
+
+        for (int i = 0; i < 8; ++i) {
+            if (bufferLen[i] == 64) {
+                blocks[i] = buffer[i];
+                mask |= 1 << i;
+            } else if (bufferLen[i] == 0 && remaining[i] >= 64) {
+                blocks[i] = ptr[i];
+                mask |= 1 << i;
+            } else {
+                blocks[i] = buffer[i];
+            }
+        }
+
+        if (mask == 0) {
+            break;
+        }
+
+        process(blocks, mask);
+
+        for (int i = 0; i < 8; ++i) {
+            if (!(mask & (1 << i))) {
+                continue;
+            }
+            if (bufferLen[i] == 64) {
+                bufferLen[i] = 0;
+            } else {
+                ptr[i] += 64;
+                remaining[i] -= 64;
+            }
+        }
+    }
+
+    // Keep the tails for the next update
+    for (int i = 0; i < 8; ++i) {
+        if (remaining[i] > 0) {
+            memcpy(buffer[i], ptr[i], remaining[i]);
+            bufferLen[i] = remaining[i];
+        }
+    }
+}
+
+void Sha256x8::finalize(unsigned char* const hash[8]) {
+    uint8_t tail[8][128];
+    const uint8_t* blocks[8];
+    int twoBlocks = 0;
+
+    // 0x80, zeros and the big-endian bit length, in one or two blocks
+    for (int i = 0; i < 8; ++i) {
+        size_t n = bufferLen[i];
+        size_t end = (n < 56) ? 64 : 128;
+
+        memcpy(tail[i], buffer[i], n);
+        tail[i][n] = 0x80;
+        memset(tail[i] + n + 1, 0, end - n - 1);
+
+        uint64_t bitLength = total[i] * 8;
+#ifdef _MSC_VER
+        bitLength = _byteswap_uint64(bitLength);
+#else
+        bitLength = __builtin_bswap64(bitLength);
+#endif
+        memcpy(tail[i] + end - 8, &bitLength, 8);
+
+        if (end == 128) {
+            twoBlocks |= 1 << i;
+        }
+        blocks[i] = tail[i];
+    }
+
+    process(blocks, 0xFF);
+
+    if (twoBlocks) {
+        for (int i = 0; i < 8; ++i) {
+            blocks[i] = (twoBlocks & (1 << i)) ? tail[i] + 64 : tail[i];
+        }
+        process(blocks, twoBlocks);
+    }
+
+    unsigned char* hashArray[8];
+    for (int i = 0; i < 8; ++i) {
+        hashArray[i] = hash[i];
+    }
 
     // Extract the hash values and copy to output buffers
-    for (int i = 0; i < 8; ++i) { // For each hash
-        unsigned char* hash = hashArray[i];
-        for (int j = 0; j < 8; ++j) { // For each state variable
-            uint32_t word = digest[j][i]; // digest[state_index][element_index]
+    _sha256avx2::StoreDigests(state, hashArray);
+
+    reset();
+}
+
+Sha256JobManager::Sha256JobManager() {
+    _sha256avx2::Initialize(state);
+    for (int i = 0; i < 8; ++i) {
+        lanes[i] = nullptr;
+        ptr[i] = tail[i];
+        dataBlocks[i] = 0;
+        tailBlocks[i] = 0;
+        tailIndex[i] = 0;
+    }
+    busy = 0;
+    completedHead = 0;
+    completedCount = 0;
+}
+
+Sha256Job* Sha256JobManager::submit(Sha256Job* job) {
+    int lane = 0;
+    while (lanes[lane] != nullptr) {
+        ++lane;
+    }
+
+    // Reset the lane to the initial hash values
+    __m256i init[8];
+    _sha256avx2::Initialize(init);
+    __m256i laneMask = _mm256_cmpeq_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(lane));
+    for (int i = 0; i < 8; ++i) {
+        state[i] = _mm256_blendv_epi8(state[i], init[i], laneMask);
+    }
+
+    // Full blocks are read in place, the remainder is padded into the lane's tail
+    size_t rem = job->len % 64;
+    size_t end = (rem < 56) ? 64 : 128;
+    if (rem > 0) {
+        memcpy(tail[lane], job->data + job->len - rem, rem);
+    }
+    tail[lane][rem] = 0x80;
+    memset(tail[lane] + rem + 1, 0, end - rem - 1);
+
+    uint64_t bitLength = (uint64_t)job->len * 8;
 #ifdef _MSC_VER
-            word = _byteswap_ulong(word);
+    bitLength = _byteswap_uint64(bitLength);
 #else
-            word = __builtin_bswap32(word);
+    bitLength = __builtin_bswap64(bitLength);
 #endif
-            memcpy(hash + j * 4, &word, 4);
+    memcpy(tail[lane] + end - 8, &bitLength, 8);
+
+    lanes[lane] = job;
+    ptr[lane] = job->data;
+    dataBlocks[lane] = job->len / 64;
+    tailBlocks[lane] = (int)(end / 64);
+    tailIndex[lane] = 0;
+    ++busy;
+
+    if (busy == 8) {
+        run();
+    }
+
+    if (completedCount == 0) {
+        return nullptr;
+    }
+    Sha256Job* done = completed[completedHead];
+    completedHead = (completedHead + 1) % 8;
+    --completedCount;
+    return done;
+}
+
+Sha256Job* Sha256JobManager::flush() {
+    if (completedCount == 0 && busy > 0) {
+        run();
+    }
+
+    if (completedCount == 0) {
+        return nullptr;
+    }
+    Sha256Job* done = completed[completedHead];
+    completedHead = (completedHead + 1) % 8;
+    --completedCount;
+    return done;
+}
+
+void Sha256JobManager::run() {
+    // Every busy lane can advance by the smallest block count left
+    uint64_t steps = UINT64_MAX;
+    for (int i = 0; i < 8; ++i) {
+        if (lanes[i] != nullptr && dataBlocks[i] + tailBlocks[i] < steps) {
+            steps = dataBlocks[i] + tailBlocks[i];
+        }
+    }
+
+    for (uint64_t step = 0; step < steps; ++step) {
+        const uint8_t* blocks[8];
+        for (int i = 0; i < 8; ++i) {
+            if (lanes[i] == nullptr) {
+                blocks[i] = tail[i];  // Free lane, its result is discarded
+            } else if (dataBlocks[i] > 0) {
+                blocks[i] = ptr[i];
+                ptr[i] += 64;
+                --dataBlocks[i];
+            } else {
+                blocks[i] = tail[i] + 64 * tailIndex[i];
+                ++tailIndex[i];
+                --tailBlocks[i];
+            }
         }
+        _sha256avx2::Transform(state, blocks);
+    }
+
+    // Lanes that ran out of blocks are done
+    unsigned char digest[8][32];
+    unsigned char* out[8];
+    for (int i = 0; i < 8; ++i) {
+        out[i] = digest[i];
+    }
+    _sha256avx2::StoreDigests(state, out);
+
+    for (int i = 0; i < 8; ++i) {
+        if (lanes[i] == nullptr || dataBlocks[i] + tailBlocks[i] > 0) {
+            continue;
+        }
+        memcpy(lanes[i]->digest, digest[i], 32);
+        completed[(completedHead + completedCount) % 8] = lanes[i];
+        ++completedCount;
+        lanes[i] = nullptr;
+        --busy;
     }
 }
 
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
@@ -1,8 +1,78 @@
 #ifndef SHA256_AVX2_H
 #define SHA256_AVX2_H
 
+#include <immintrin.h>
+#include <cstddef>
 #include <cstdint>
 
+namespace _sha256avx2 {
+
+// Initialize SHA-256 state with initial hash values
+void Initialize(__m256i* s);
+
+// Transform AVX2 (one 64-byte block per lane, state left in registers)
+void Transform(__m256i* state, const uint8_t* data[8]);
+
+// Two-stream Transform: 16 blocks, two independent 8-lane states interleaved
+// through the same rounds. state[0..7] belongs to data[0..7] and
+// state[8..15] to data[8..15].
+void Transform2(__m256i* state, const uint8_t* data[16]);
+
+// Midstate for 8 blocks that share every message word except W[8]
+// (e.g. 33-byte keys that differ only in their last byte)
+struct Midstate {
+    __m256i init[8];   // Chaining value the block starts from
+    __m256i mid[8];    // a..h after rounds 0..7
+    __m256i KW[23];    // K[t] + W[t] for the constant words of rounds 9..22
+    __m256i W[38];     // W[16..22] and the constant parts of W[23..37]
+};
+
+// Compute the midstate of a pre-padded 64-byte block, W[8] is ignored
+void PrepareMidstate(Midstate* m, const uint8_t* block);
+
+// Rounds 8..63 from a midstate with a per-lane message word 8
+void TransformMidstate(__m256i* state, const Midstate* m, __m256i w8);
+
+// Masked digest search: a lane matches when (state[i] & mask[i]) == value[i]
+// for each digest word i (big-endian words, as in the state). Words with a
+// zero mask are not compared.
+struct DigestMatch {
+    __m256i mask[8];
+    __m256i value[8];
+    int words;         // Bit i set when mask word i is non-zero
+};
+
+// Set up a search for the 32-byte digests d with (d & mask) == (value & mask)
+void PrepareMatch(DigestMatch* match, const uint8_t mask[32], const uint8_t value[32]);
+
+// TransformMidstate for a masked search. Digest words 3 and 7 are final after
+// round 60, 2 and 6 after round 61 and so on: each is compared as soon as it
+// is known and the remaining rounds are skipped once no lane can match.
+// Returns the mask of matching lanes, state is only set when it is non-zero.
+int TransformMidstateMatch(__m256i* state, const Midstate* m, __m256i w8, const DigestMatch* match);
+
+// Midstate of an 80-byte block header for sha256d nonce scanning. Only the
+// nonce (word 3 of the second block) differs between lanes.
+struct HeaderMidstate {
+    __m256i init[8];   // Chaining value after the first 64 bytes
+    __m256i pre[8];    // a..h after rounds 0..2 of the second block
+    __m256i KW[18];    // K[t] + W[t] for the constant words of rounds 4..17
+    __m256i C[34];     // Constant parts of W[18..33]
+};
+
+// Compute the midstate of a block header, the nonce (bytes 76..79) is ignored
+void PrepareHeader(HeaderMidstate* m, const uint8_t header[80]);
+
+// First SHA-256 of the header with nonce[i] (as stored in the header,
+// little-endian) in lane i. state receives the digest words.
+void TransformHeader(__m256i* state, const HeaderMidstate* m, __m256i nonce);
+
+// Word 7 of SHA-256 over the 32-byte digests in state, the last three rounds
+// are skipped. Its bytes are the most significant ones of a Bitcoin hash.
+__m256i Sha256dH7(const __m256i* state);
+
+} // namespace _sha256avx2
+
 void sha256avx2_8B(
     const uint8_t* data0, const uint8_t* data1, const uint8_t* data2, const uint8_t* data3,
     const uint8_t* data4, const uint8_t* data5, const uint8_t* data6, const uint8_t* data7,
@@ -10,5 +80,147 @@ void sha256avx2_8B(
     unsigned char* hash4, unsigned char* hash5, unsigned char* hash6, unsigned char* hash7
 );
 
-#endif // SHA256_AVX2_H
+// Length-specialized variant for messages of exactly Len bytes (no caller padding,
+// only Len bytes are read per message). Available for Len = 32 and Len = 33.
+template <size_t Len>
+void sha256avx2_8B(
+    const uint8_t* data0, const uint8_t* data1, const uint8_t* data2, const uint8_t* data3,
+    const uint8_t* data4, const uint8_t* data5, const uint8_t* data6, const uint8_t* data7,
+    unsigned char* hash0, unsigned char* hash1, unsigned char* hash2, unsigned char* hash3,
+    unsigned char* hash4, unsigned char* hash5, unsigned char* hash6, unsigned char* hash7
+);
+
+// Hash 8 blocks sharing a midstate, w8[i] is message word 8 (big-endian value) of lane i
+void sha256avx2_8B_midstate(
+    const _sha256avx2::Midstate* midstate, const uint32_t w8[8],
+    unsigned char* hash0, unsigned char* hash1, unsigned char* hash2, unsigned char* hash3,
+    unsigned char* hash4, unsigned char* hash5, unsigned char* hash6, unsigned char* hash7
+);
 
+// Masked search over 8 blocks sharing a midstate: returns the mask of lanes
+// whose digest matches, only their digests are written to hash[i]
+int sha256avx2_8B_midstate_match(
+    const _sha256avx2::Midstate* midstate, const uint32_t w8[8],
+    const _sha256avx2::DigestMatch* match, unsigned char* hash[8]
+);
+
+// Hash n pre-padded 64-byte blocks stored stride bytes apart (stride >= 64) and
+// write n digests of 32 bytes contiguously to out. Any n is accepted.
+void sha256avx2_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+
+// Strided batch of messages of exactly Len bytes (stride >= Len, no padding).
+// Available for Len = 32 and Len = 33.
+template <size_t Len>
+void sha256avx2_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+
+// Same as sha256avx2_batch with the two-stream kernels, 16 messages per transform
+void sha256avx2x2_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+template <size_t Len>
+void sha256avx2x2_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+
+// Hash the n consecutive 33-byte keys key, key + 1, ... (big-endian counter,
+// last byte lowest) and write n digests of 32 bytes to out. The keys are
+// generated in registers, 8 (16 for x2) per transform.
+void sha256avx2_counter33(const uint8_t* key, size_t n, uint8_t* out);
+void sha256avx2x2_counter33(const uint8_t* key, size_t n, uint8_t* out);
+
+// Hash the first n random 33-byte keys of a block (see sha256_random33)
+void sha256avx2_random33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t* out);
+void sha256avx2x2_random33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t* out);
+
+// Same through the midstate: keys sharing bytes 0..31 reuse rounds 0..7
+void sha256avx2_counter33_midstate(const uint8_t* key, size_t n, uint8_t* out);
+
+// Masked search over n counter keys through the midstate. Writes the digests
+// that match and their key offsets (from key) to out and index, which need
+// room for n, and returns how many matched.
+size_t sha256avx2_counter33_match(const uint8_t* key, size_t n, const _sha256avx2::DigestMatch* match,
+                                  uint32_t* index, uint8_t* out);
+
+// Scan count nonces from nonceStart (wrapping at 2^32) for a sha256d of the
+// 80-byte header that is <= target. Hashes and target are 32-byte little-endian
+// numbers as in Bitcoin (the hash in SHA-256 output order). Lanes whose top
+// hash word is above the target top word are rejected without finishing the
+// second SHA-256. Returns true with the first matching nonce and its hash.
+bool sha256davx2_scan(const uint8_t header[80], const uint8_t target[32],
+                      uint32_t nonceStart, uint64_t count,
+                      uint32_t* nonce, unsigned char hash[32]);
+
+// Hash one Merkle tree level of n 32-byte nodes: out[i] = SHA256(SHA256(
+// in[2i] || in[2i+1])), 8 pairs per transform. When n is odd the last node
+// is paired with itself as in Bitcoin. Writes (n + 1) / 2 nodes to out, which
+// must not overlap in. Wide levels are split across OpenMP threads.
+void sha256davx2_merkle_level(const uint8_t* in, size_t n, uint8_t* out);
+
+// Merkle root of n 32-byte leaves (e.g. txids in internal byte order).
+// A single leaf is its own root. Returns false, leaving root untouched, when
+// n is 0 (an empty tree has no root) or the level buffers cannot be allocated.
+bool sha256davx2_merkle_root(const uint8_t* leaves, size_t n, uint8_t root[32]);
+
+// Streaming SHA-256 over 8 independent messages of arbitrary length.
+// Lanes may advance at different rates: whenever a lane has a full block it
+// is compressed together with the other ready lanes, idle lanes are masked.
+class Sha256x8 {
+public:
+    Sha256x8();
+
+    // Start 8 new messages
+    void reset();
+
+    // Append len[i] bytes of data[i] to message i (len[i] = 0 leaves lane i untouched)
+    void update(const uint8_t* const data[8], const size_t len[8]);
+
+    // Pad, process the final block(s) and write 8 digests of 32 bytes, then reset
+    void finalize(unsigned char* const hash[8]);
+
+private:
+    // Compress one block for the lanes set in mask, other lanes keep their state
+    void process(const uint8_t* blocks[8], int mask);
+
+    __m256i state[8];
+    uint8_t buffer[8][64];   // Partial block per lane
+    size_t bufferLen[8];
+    uint64_t total[8];       // Message length in bytes per lane
+};
+
+// Hash request for Sha256JobManager
+struct Sha256Job {
+    const uint8_t* data;     // Message (null allowed when len is 0), valid until the job is returned
+    size_t len;              // Message length in bytes
+    unsigned char* digest;   // 32-byte output
+    void* user;              // Caller context, not touched by the manager
+};
+
+// Multi-buffer job manager: jobs of any length share the 8 lanes, each lane
+// completes on its own when its blocks run out and is refilled by the next
+// submit, so callers never have to batch or pad to 8 themselves.
+class Sha256JobManager {
+public:
+    Sha256JobManager();
+
+    // Place a job in a free lane. When all lanes are busy, compress until at
+    // least one job finishes. Returns a completed job or nullptr.
+    Sha256Job* submit(Sha256Job* job);
+
+    // Return the next completed job, compressing partially filled batches as
+    // needed. Returns nullptr once every submitted job has been returned.
+    Sha256Job* flush();
+
+private:
+    // Compress until at least one busy lane has consumed all its blocks
+    void run();
+
+    __m256i state[8];
+    Sha256Job* lanes[8];         // Job per lane, nullptr when free
+    const uint8_t* ptr[8];       // Next full block of the job data
+    uint64_t dataBlocks[8];      // Full data blocks left
+    int tailBlocks[8];           // Padded final blocks left (1 or 2)
+    int tailIndex[8];            // Next padded block to process
+    uint8_t tail[8][128];        // Final padded block(s) per lane
+    int busy;                    // Number of busy lanes
+    Sha256Job* completed[8];     // Completed jobs not yet returned (ring)
+    int completedHead;
+    int completedCount;
+};
+
+#endif // SHA256_AVX2_H
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cstdio>
 #include <string>
 #include <cstring>
 #include <chrono>
@@ -8,7 +9,24 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <filesystem>
 #include "sha256_avx2.h"
+#include "sha256_dispatch.h"
+#include "../common/target_set.h"
+#include "../common/digest_mask.h"
+#include "../common/vec_random.h"
+#include "../common/work_scheduler.h"
+#include "../common/thread_affinity.h"
+#include "../common/thread_arena.h"
+#include "../common/mapped_file.h"
+#include "../common/stream_pipeline.h"
+#include "../common/result_writer.h"
+#include "../common/hex_codec.h"
+#include "../common/perf_counters.h"
 
 // Function to increment a byte array by a given value
 inline void incrementByteArray(uint8_t* bytes, size_t length, uint64_t increment) {
@@ -21,95 +39,1340 @@ inline void incrementByteArray(uint8_t* bytes, size_t length, uint64_t increment
 
 // Function to convert a byte array to a hexadecimal string
 std::string bytesToHexString(const uint8_t* bytes, size_t length) {
-    std::ostringstream oss;
-    oss << std::hex << std::setfill('0');
-    for (size_t i = 0; i < length; ++i) {
-        oss << std::setw(2) << static_cast<int>(bytes[i]);
+    return HexString(bytes, length);
+}
+
+// Hits or matches of all threads in key order, whichever thread found them
+std::vector<std::string> mergeByKey(const std::vector<std::vector<std::pair<uint64_t, std::string>>>& perThread) {
+    std::vector<std::pair<uint64_t, std::string>> all;
+    for (const auto& found : perThread) {
+        all.insert(all.end(), found.begin(), found.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    std::vector<std::string> lines;
+    for (const auto& found : all) {
+        lines.push_back(found.second);
+    }
+    return lines;
+}
+
+// Hash n records of recordLen (33 or 32) bytes stored back to back
+void hashRecords(const uint8_t* in, size_t recordLen, size_t n, uint8_t* out) {
+    if (recordLen == 33) {
+        sha256_batch<33>(in, 33, n, out);
+    } else {
+        sha256_batch<32>(in, 32, n, out);
+    }
+}
+
+// Text records of --stream --hex: 2 * recordLen hex digits and a newline in,
+// 64 digits and a newline out. Decoded and hashed 256 records at a time.
+bool hashHexRecords(const uint8_t* in, size_t recordLen, size_t n, uint8_t* out) {
+    const size_t group = 256;
+    const size_t textLen = 2 * recordLen + 1;
+    uint8_t keys[group * 33];
+    uint8_t digests[group * 32];
+
+    for (size_t first = 0; first < n; first += group) {
+        size_t count = std::min(group, n - first);
+        for (size_t r = 0; r < count; ++r) {
+            const char* text = (const char*)in + (first + r) * textLen;
+            if (text[textLen - 1] != '\n' || !HexDecode(text, recordLen, keys + r * recordLen)) {
+                return false;
+            }
+        }
+        hashRecords(keys, recordLen, count, digests);
+        for (size_t r = 0; r < count; ++r) {
+            char* text = (char*)out + (first + r) * 65;
+            HexEncode(digests + r * 32, 32, text);
+            text[64] = '\n';
+        }
+    }
+    return true;
+}
+
+// Hash the recordLen-byte records of inPath into outPath, digest i for record
+// i. The threads take record ranges from the work scheduler and the kernels
+// read them straight from the input mapping and write the digests straight
+// into the output mapping.
+bool hashFile(const std::string& inPath, const std::string& outPath, size_t recordLen, int numThreads,
+              const ThreadAffinity& affinity, uint64_t* records, std::string* error) {
+    MappedFile in;
+    if (!in.openRead(inPath, error)) {
+        return false;
+    }
+    if (in.size() % recordLen != 0) {
+        *error = inPath + " is not a whole number of " + std::to_string(recordLen) + "-byte records";
+        return false;
+    }
+    *records = in.size() / recordLen;
+
+    MappedFile out;
+    if (!out.create(outPath, *records * 32, error)) {
+        return false;
+    }
+
+    omp_set_num_threads(numThreads);
+    WorkScheduler scheduler(*records, numThreads);
+
+    #pragma omp parallel
+    {
+        int threadId = omp_get_thread_num();
+        affinity.pin(threadId);
+
+        uint64_t begin, end;
+        while (scheduler.next(threadId, &begin, &end)) {
+            const uint8_t* src = in.data() + begin * recordLen;
+            uint8_t* dst = out.data() + begin * 32;
+            hashRecords(src, recordLen, end - begin, dst);
+        }
+    }
+    return true;
+}
+
+// Function to display help message
+void displayHelp() {
+    std::cout << "Usage: program [options]\n"
+              << "Options:\n"
+              << "  -h                Display help information\n"
+              << "  -c <count>        Number of hashes to compute (default 128)\n"
+              << "  -t <threads>      Number of threads to use (default is maximum available)\n"
+              << "  -s                Save last keys and hashes from each thread to last_hashes.txt\n"
+              << "  -i <initial_key>  Specify initial key (66 HEX characters)\n"
+              << "  -r                Random keys: byte 0 from -i, bytes 1..32 random (key n is\n"
+              << "                    reproducible from the seed and n)\n"
+              << "  --seed <n>        Seed for -r (default: random, printed)\n"
+              << "  --no-midstate     Disable midstate reuse for keys sharing a 32-byte prefix\n"
+              << "  --save <file>     Write every key and SHA-256 hash to a binary result file\n"
+              << "  --save-hits <file> Write only the --targets hits and --prefix matches to it\n"
+              << "  --profile         Count cycles, instructions, cache and branch misses of the\n"
+              << "                    hashing loop per thread (Linux perf events) and report IPC,\n"
+              << "                    cycles per hash and misses per batch\n"
+              << "  --affinity <cpus> Pin threads: compact (fill a NUMA node first), scatter\n"
+              << "                    (spread over the nodes) or a CPU list such as 0-7,16-23\n"
+              << "  --kernel <name>   Kernel to use: avx512, avx2x2, avx2, sse41 or scalar (default: widest supported, avx2x2 only when given)\n"
+              << "  --scan <header>   Scan -c nonces from the nonce of an 80-byte block header\n"
+              << "                    (160 HEX characters) for a sha256d hash below its target\n"
+              << "                    (-c at most 2^32, every nonce once)\n"
+              << "  --merkle          Build the Merkle root of -c leaves (leaf i = i as a 32-byte\n"
+              << "                    little-endian number)\n"
+              << "  --file <records>  Hash a binary file of 33-byte keys (or --record 32 for\n"
+              << "                    32-byte messages) into --out, 32 bytes per record\n"
+              << "  --out <digests>   Output file of --file\n"
+              << "  --stream          Hash records from stdin (as for --file) into digests on\n"
+              << "                    stdout, the report goes to stderr\n"
+              << "  --hex             Records of --stream are hex lines (66 or 64 digits in, 64\n"
+              << "                    digits out)\n"
+              << "  --record <bytes>  Record size of --file: 33 (default) or 32\n"
+              << "  --targets <file>  Report generated hashes found in a file of hex digests\n"
+              << "                    (one per line)\n"
+              << "  --prefix <hex>    Report hashes starting with these hex digits\n"
+              << "  --mask <hex>      Bit mask over the hash for --prefix (hex from the first\n"
+              << "                    byte, default: every digit given in --prefix)\n"
+              << "  --test            Run test cases with known examples\n";
+}
+
+// Expand the compact difficulty ("bits") of a block header into a 32-byte
+// little-endian target
+void compactToTarget(uint32_t bits, uint8_t target[32]) {
+    int exponent = bits >> 24;
+    uint32_t mantissa = bits & 0x007FFFFF;
+
+    memset(target, 0, 32);
+    for (int k = 0; k < 3; ++k) {
+        int pos = exponent - 3 + k;
+        if (pos >= 0 && pos < 32) {
+            target[pos] = static_cast<uint8_t>(mantissa >> (8 * k));
+        }
+    }
+}
+
+// Known test cases for --test option
+struct TestCase {
+    std::string input;
+    std::string expectedHash;
+};
+
+// Function to run test cases
+bool runTests() {
+    std::vector<TestCase> testCases = {
+        {"000000000000000000000000000000000000000000000000000000000000000001", "1fd4247443c9440cb3c48c28851937196bc156032d70a96c98e127ecb347e45f"},
+        {"000000000000000000000000000000000000000000000000000000000000000010", "65074aa3a766c6973ac3de47f82f3acabb999b36202ce6edcd6b348ea227c00f"},
+        {"000000000000000000000000000000000000000000000000000000000000000100", "e65b66499024a7a2f732fc71a035ef70b6eb493445a6cfb708f69bff18fd7eb5"},
+        {"000000000000000000000000000000000000000000000000000000000000001000", "58ba123afbfa01d0ab579910e3c71707804db829410c38d132d9f9ceaccc455f"},
+        {"100000000000000000000000000000000000000000000000000000000000000000", "a9deba97c5a6ecfff3bd534250e4d43e44732733254e794ca53727344f5522eb"},
+        {"010000000000000000000000000000000000000000000000000000000000000000", "1a7dfdeaffeedac489287e85be5e9c049a2ff6470f55cf30260f55395ac1b159"},
+        {"001000000000000000000000000000000000000000000000000000000000000000", "cd6a3ca0edecc51cce376f20c24705f61767c0724ab5dc6ba9f97476cf913231"},
+        {"000100000000000000000000000000000000000000000000000000000000000000", "1b7c643b049c11a4fb6b65822e4a5e2a3da54223366c5f453cf376536f9bf42a"}
+    };
+
+    bool allPassed = true;
+    bool hasAvx2 = sha256_kernel_supported("avx2");
+
+    for (const auto& testCase : testCases) {
+        uint8_t keyBytes[66] = {0};
+        // Convert hex string to byte array
+        std::string initialKeyHex = testCase.input;
+        if (initialKeyHex.size() < 66) {
+            initialKeyHex = std::string(66 - initialKeyHex.size(), '0') + initialKeyHex;
+        }
+
+        HexDecode(initialKeyHex, 33, keyBytes);
+
+        // Prepare input buffers
+        alignas(32) uint8_t inputBuffers[8][64] = {0};
+        for (int i = 0; i < 8; ++i) {
+            memcpy(inputBuffers[i], keyBytes, 33);
+            inputBuffers[i][33] = 0x80;
+            uint64_t bitLength = 33 * 8;
+            bitLength = __builtin_bswap64(bitLength);
+            memcpy(inputBuffers[i] + 56, &bitLength, 8);
+        }
+
+        alignas(32) unsigned char outputs[8][32];
+
+        sha256_batch(inputBuffers[0], 64, 8, outputs[0]);
+
+        // Length-specialized kernel on the unpadded 33-byte key
+        alignas(32) unsigned char outputs33[8][32];
+
+        sha256_batch<33>(keyBytes, 0, 8, outputs33[0]);
+
+        bool kernelsMatch = memcmp(outputs[0], outputs33[7], 32) == 0;
+
+        // The 8-pointer AVX2 entry points
+        if (hasAvx2) {
+            const uint8_t* inputs[8];
+            for (int i = 0; i < 8; ++i) {
+                inputs[i] = inputBuffers[i];
+            }
+
+            alignas(32) unsigned char outputsAvx2[8][32];
+
+            sha256avx2_8B(
+                inputs[0], inputs[1], inputs[2], inputs[3],
+                inputs[4], inputs[5], inputs[6], inputs[7],
+                outputsAvx2[0], outputsAvx2[1], outputsAvx2[2], outputsAvx2[3],
+                outputsAvx2[4], outputsAvx2[5], outputsAvx2[6], outputsAvx2[7]
+            );
+            kernelsMatch = kernelsMatch && memcmp(outputs, outputsAvx2, sizeof(outputs)) == 0;
+
+            sha256avx2_8B<33>(
+                keyBytes, keyBytes, keyBytes, keyBytes,
+                keyBytes, keyBytes, keyBytes, keyBytes,
+                outputsAvx2[0], outputsAvx2[1], outputsAvx2[2], outputsAvx2[3],
+                outputsAvx2[4], outputsAvx2[5], outputsAvx2[6], outputsAvx2[7]
+            );
+            kernelsMatch = kernelsMatch && memcmp(outputs, outputsAvx2, sizeof(outputs)) == 0;
+        }
+
+        std::string hashHex = bytesToHexString(outputs[0], 32);
+        if (hashHex != testCase.expectedHash || !kernelsMatch) {
+            std::cout << "Test failed for input: " << testCase.input << "\n"
+                      << "Expected: " << testCase.expectedHash << "\n"
+                      << "Got:      " << hashHex << "\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for input: " << testCase.input << "\n";
+        }
+    }
+
+    // Every supported kernel on a count that leaves a partial group, which the
+    // narrower kernels pick up
+    {
+        const char* initialKernel = sha256_kernel();
+        const char* kernelNames[] = { "avx512", "avx2x2", "avx2", "sse41", "scalar" };
+        const size_t count = 37;
+
+        std::vector<uint8_t> blocks(count * 64, 0);
+        std::vector<uint8_t> keys(count * 33);
+        for (size_t i = 0; i < count; ++i) {
+            HexDecode(testCases[i % testCases.size()].input, 33, keys.data() + i * 33);
+            memcpy(blocks.data() + i * 64, keys.data() + i * 33, 33);
+            blocks[i * 64 + 33] = 0x80;
+            uint64_t bitLength = __builtin_bswap64(33 * 8);
+            memcpy(blocks.data() + i * 64 + 56, &bitLength, 8);
+        }
+        const uint8_t zeros[32] = {0};
+
+        // Counter keys from a key whose carry runs up to byte 0 within the count
+        uint8_t counterKey[33];
+        memset(counterKey, 0xFF, 33);
+        counterKey[0] = 0x03;
+        counterKey[32] = 0xE9;
+        std::vector<uint8_t> counterKeys(count * 33);
+        for (size_t i = 0; i < count; ++i) {
+            memcpy(counterKeys.data() + i * 33, counterKey, 33);
+            incrementByteArray(counterKeys.data() + i * 33, 33, i);
+        }
+        std::vector<unsigned char> counterExpected(count * 32);
+        sha256scalar_batch<33>(counterKeys.data(), 33, count, counterExpected.data());
+
+        // Random keys from the middle of a stream, across a block boundary
+        const uint64_t randomFirst = 3 * kRandomBlock;
+        const size_t randomCount = kRandomBlock + count;
+        std::vector<uint8_t> randomKeys(randomCount * 33);
+        for (size_t i = 0; i < randomCount; ++i) {
+            sha256_random_key(0x02, 42, 7, randomFirst + i, randomKeys.data() + i * 33);
+        }
+        std::vector<unsigned char> randomExpected(randomCount * 32);
+        sha256scalar_batch<33>(randomKeys.data(), 33, randomCount, randomExpected.data());
+
+        for (const char* name : kernelNames) {
+            if (!sha256_select_kernel(name)) {
+                std::cout << "Skipping kernel " << name << " (not supported)\n";
+                continue;
+            }
+
+            std::vector<unsigned char> outputs(count * 32);
+            std::vector<unsigned char> outputs33(count * 32);
+            std::vector<unsigned char> outputs32(count * 32);
+            sha256_batch(blocks.data(), 64, count, outputs.data());
+            sha256_batch<33>(keys.data(), 33, count, outputs33.data());
+            sha256_batch<32>(zeros, 0, count, outputs32.data());
+
+            std::vector<unsigned char> outputsCounter(count * 32);
+            sha256_counter33(counterKey, count, outputsCounter.data());
+
+            std::vector<unsigned char> outputsRandom(randomCount * 32);
+            sha256_random33(0x02, 42, 7, randomFirst, randomCount, outputsRandom.data());
+
+            bool kernelPassed = outputsCounter == counterExpected && outputsRandom == randomExpected;
+            for (size_t i = 0; i < count; ++i) {
+                const std::string& expected = testCases[i % testCases.size()].expectedHash;
+                if (bytesToHexString(outputs.data() + i * 32, 32) != expected ||
+                    bytesToHexString(outputs33.data() + i * 32, 32) != expected ||
+                    bytesToHexString(outputs32.data() + i * 32, 32) != "66687aadf862bd776c8fc18b8e9f8e20089714856ee233b3902a591d0d5f2925") {
+                    kernelPassed = false;
+                }
+            }
+
+            if (!kernelPassed) {
+                std::cout << "Test failed for kernel " << name << "\n";
+                allPassed = false;
+            } else {
+                std::cout << "Test passed for kernel " << name << " (" << count << " messages)\n";
+            }
+        }
+
+        sha256_select_kernel(initialKernel);
     }
-    return oss.str();
+
+    // Random keys: reference outputs of xoshiro128** from the state {1, 2, 3, 4},
+    // and distinct keys from neighbouring lanes, blocks and streams
+    {
+        uint32_t state[4] = { 1, 2, 3, 4 };
+        bool randomPassed = RandomNext(state) == 11520 && RandomNext(state) == 0 && RandomNext(state) == 5927040;
+
+        uint8_t keys[4][33];
+        sha256_random_key(0x02, 1, 0, 0, keys[0]);
+        sha256_random_key(0x02, 1, 0, 1, keys[1]);
+        sha256_random_key(0x02, 1, 0, kRandomBlock, keys[2]);
+        sha256_random_key(0x02, 1, 1, 0, keys[3]);
+        for (int a = 0; a < 4; ++a) {
+            for (int b = a + 1; b < 4; ++b) {
+                if (memcmp(keys[a], keys[b], 33) == 0) {
+                    randomPassed = false;
+                }
+            }
+        }
+
+
+        // Batch of keys across a block boundary against single keys
+        std::vector<uint8_t> batch(300 * 33);
+        sha256_random_keys(0x02, 1, 0, kRandomBlock, 300, batch.data());
+        for (size_t r = 0; r < 300; ++r) {
+            uint8_t key[33];
+            sha256_random_key(0x02, 1, 0, kRandomBlock + r, key);
+            if (memcmp(key, batch.data() + r * 33, 33) != 0) {
+                randomPassed = false;
+            }
+        }
+
+        if (!randomPassed) {
+            std::cout << "Test failed for random keys\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for random keys\n";
+        }
+    }
+
+    // Target set: every inserted digest is found among random ones, with the
+    // AVX2 and the scalar filter probe
+    {
+        const size_t digestLen = 32;
+        const size_t count = 4099;
+        std::vector<uint8_t> digests(count * digestLen);
+        uint64_t x = 0x9E3779B97F4A7C15ull;
+        for (size_t i = 0; i < digests.size(); ++i) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            digests[i] = static_cast<uint8_t>(x >> 56);
+        }
+
+        // Every 97th digest is a known-answer hash from the test cases
+        TargetSet targets(digestLen);
+        std::vector<uint32_t> expected;
+        for (size_t i = 0; i < count; i += 97) {
+            HexDecode(testCases[(i / 97) % testCases.size()].expectedHash, digestLen, digests.data() + i * digestLen);
+            targets.add(digests.data() + i * digestLen);
+            expected.push_back(static_cast<uint32_t>(i));
+        }
+        targets.build();
+
+        bool targetsPassed = true;
+        for (int pass = 0; pass < 2; ++pass) {
+            if (pass == 1) {
+                targets.selectScalarProbe();
+            }
+
+            std::vector<uint32_t> hits(count);
+            size_t hitCount = targets.probe(digests.data(), digestLen, count, hits.data());
+            hits.resize(hitCount);
+            if (hits != expected) {
+                targetsPassed = false;
+            }
+        }
+
+        // A copy with its filter in a thread arena finds the same hits
+        ThreadArena arena(targets.filterBytes());
+        TargetSet local(targets, arena.alloc(targets.filterBytes()));
+        std::vector<uint32_t> localHits(count);
+        localHits.resize(local.probe(digests.data(), digestLen, count, localHits.data()));
+        if (localHits != expected) {
+            targetsPassed = false;
+        }
+
+        if (!targetsPassed) {
+            std::cout << "Test failed for target set\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for target set (" << expected.size() << " hits in " << count << " digests)\n";
+        }
+    }
+
+    {
+        // File mode: records written through a mapping and hashed by 3 threads
+        // into a mapped output file, against the batch API
+        const size_t count = 3000 + 7;
+        std::filesystem::path dir = std::filesystem::temp_directory_path();
+        std::string inPath = (dir / "sha256_file_test.in").string();
+        std::string outPath = (dir / "sha256_file_test.out").string();
+
+        std::vector<uint8_t> records(count * 33);
+        for (size_t i = 0; i < records.size(); ++i) {
+            records[i] = static_cast<uint8_t>(i * 131 + (i >> 8));
+        }
+        std::vector<uint8_t> expected(count * 32);
+        sha256_batch<33>(records.data(), 33, count, expected.data());
+
+        std::string error;
+        uint64_t hashed = 0;
+        ThreadAffinity affinity;
+        bool filePassed = false;
+        {
+            MappedFile in;
+            if (in.create(inPath, records.size(), &error)) {
+                memcpy(in.data(), records.data(), records.size());
+                in.close();
+                MappedFile out;
+                filePassed = hashFile(inPath, outPath, 33, 3, affinity, &hashed, &error) && hashed == count &&
+                             out.openRead(outPath, &error) && out.size() == expected.size() &&
+                             memcmp(out.data(), expected.data(), expected.size()) == 0;
+            }
+
+            // A partial record is refused
+            if (filePassed && in.create(inPath, 33 + 1, &error)) {
+                in.close();
+                filePassed = !hashFile(inPath, outPath, 33, 3, affinity, &hashed, &error);
+            }
+        }
+        std::remove(inPath.c_str());
+        std::remove(outPath.c_str());
+
+        if (!filePassed) {
+            std::cout << "Test failed for file mode" << (error.empty() ? "" : ": " + error) << "\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for file mode (" << count << " records)\n";
+        }
+    }
+
+    {
+        // Stream mode: 3007 records through 31 slabs of 100 on 3 workers, the
+        // digests must come out in input order
+        const size_t count = 3000 + 7;
+        std::vector<uint8_t> records(count * 33);
+        for (size_t i = 0; i < records.size(); ++i) {
+            records[i] = static_cast<uint8_t>(i * 167 + (i >> 9));
+        }
+        auto hash33 = [](const uint8_t* in, size_t n, uint8_t* out) {
+            hashRecords(in, 33, n, out);
+            return true;
+        };
+        std::vector<uint8_t> expected(count * 32);
+        hash33(records.data(), count, expected.data());
+
+        std::string error;
+        uint64_t hashed = 0;
+        ThreadAffinity affinity;
+        StreamPipeline pipeline(33, 32, 100);
+        bool streamPassed = false;
+
+        FILE* in = std::tmpfile();
+        FILE* out = std::tmpfile();
+        if (in != nullptr && out != nullptr) {
+            fwrite(records.data(), 1, records.size(), in);
+            fflush(in);
+            fseek(in, 0, SEEK_SET);
+            std::vector<uint8_t> digests(expected.size() + 1);
+            streamPassed = pipeline.run(fileno(in), fileno(out), 3, affinity, hash33, &hashed, &error) &&
+                           hashed == count && fseek(out, 0, SEEK_SET) == 0 &&
+                           fread(digests.data(), 1, digests.size(), out) == expected.size() &&
+                           memcmp(digests.data(), expected.data(), expected.size()) == 0;
+
+            // A partial record is refused
+            fseek(in, 33 + 1, SEEK_SET);
+            streamPassed = streamPassed && !pipeline.run(fileno(in), fileno(out), 3, affinity, hash33, &hashed, &error);
+        }
+        if (in != nullptr) {
+            fclose(in);
+        }
+        if (out != nullptr) {
+            fclose(out);
+        }
+
+        if (!streamPassed) {
+            std::cout << "Test failed for stream mode" << (error.empty() ? "" : ": " + error) << "\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for stream mode (" << count << " records)\n";
+        }
+    }
+
+    {
+        // Hex codec: the AVX2 and scalar code against a printf reference on
+        // every length up to 100 bytes (whole 16-byte steps and tails), upper
+        // case accepted, every non-hex character refused at every position
+        bool hexPassed = true;
+        std::vector<uint8_t> bytes(100), decoded(100);
+        for (size_t i = 0; i < bytes.size(); ++i) {
+            bytes[i] = static_cast<uint8_t>(i * 73 + 29);
+        }
+        for (int scalar = 0; scalar < 2; ++scalar) {
+            HexSelectScalar(scalar != 0);
+            for (size_t n = 0; n <= bytes.size(); ++n) {
+                std::string reference;
+                char digits[3];
+                for (size_t i = 0; i < n; ++i) {
+                    snprintf(digits, sizeof(digits), "%02x", bytes[i]);
+                    reference += digits;
+                }
+                std::string upper = reference;
+                std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+                hexPassed = hexPassed && HexString(bytes.data(), n) == reference &&
+                            HexDecode(upper, n, decoded.data()) && std::equal(decoded.begin(), decoded.begin() + n, bytes.begin());
+            }
+            std::string text = HexString(bytes.data(), 40);
+            for (size_t at = 0; at < text.size(); ++at) {
+                for (char bad : { 'g', 'G', '/', ':', '@', '`', ' ', '\0', '\x80', '\xb0', '\xe1' }) {
+                    std::string broken = text;
+                    broken[at] = bad;
+                    hexPassed = hexPassed && !HexDecode(broken, 40, decoded.data());
+                }
+            }
+        }
+        HexSelectScalar(false);
+
+        // Hex lines of --stream --hex, a bad digit or a missing newline is refused
+        const size_t count = 300;
+        std::vector<uint8_t> keys(count * 33), expected(count * 32);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            keys[i] = static_cast<uint8_t>(i * 151 + 3);
+        }
+        hashRecords(keys.data(), 33, count, expected.data());
+        std::string lines, expectedLines;
+        for (size_t i = 0; i < count; ++i) {
+            lines += bytesToHexString(keys.data() + i * 33, 33) + "\n";
+            expectedLines += bytesToHexString(expected.data() + i * 32, 32) + "\n";
+        }
+        std::string out(count * 65, ' ');
+        hexPassed = hexPassed && hashHexRecords((const uint8_t*)lines.data(), 33, count, (uint8_t*)&out[0]) && out == expectedLines;
+        lines[280 * 67 + 5] = 'x';
+        hexPassed = hexPassed && !hashHexRecords((const uint8_t*)lines.data(), 33, count, (uint8_t*)&out[0]);
+        lines[280 * 67 + 5] = '0';
+        lines[280 * 67 + 66] = ' ';
+        hexPassed = hexPassed && !hashHexRecords((const uint8_t*)lines.data(), 33, count, (uint8_t*)&out[0]);
+
+        if (!hexPassed) {
+            std::cout << "Test failed for hex codec\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for hex codec (" << (hasAvx2 ? "avx2 and scalar" : "scalar") << ")\n";
+        }
+    }
+
+    {
+        // Result file: 2 threads append through blocks of 13 records, each
+        // record must be saved once after the header
+        const size_t count = 5000;
+        std::string path = (std::filesystem::temp_directory_path() / "sha256_result_test.bin").string();
+        ResultHeader header = {};
+        memcpy(header.magic, "HASHRES1", 8);
+        header.algorithm = ResultHeader::kSha256;
+        header.keyLen = 33;
+        header.digestLen = 32;
+        header.threads = 2;
+        header.count = count;
+
+        std::string error;
+        ResultWriter writer(2, 33, 32, 13 * 73, 3);
+        bool resultPassed = writer.open(path, header, &error);
+        if (resultPassed) {
+            #pragma omp parallel num_threads(2)
+            {
+                int t = omp_get_thread_num();
+                for (size_t r = t; r < count; r += 2) {
+                    uint8_t key[33];
+                    uint8_t digest[32];
+                    memset(key, static_cast<int>(r & 0xFF), sizeof(key));
+                    memset(digest, static_cast<int>((r * 7) & 0xFF), sizeof(digest));
+                    writer.append(t, r, key, digest);
+                }
+                writer.flush(t);
+            }
+            resultPassed = writer.close(&error) && writer.records() == count;
+        }
+
+        std::ifstream in(path, std::ios::binary);
+        std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        std::remove(path.c_str());
+
+        resultPassed = resultPassed && data.size() == sizeof(header) + count * 73 &&
+                       memcmp(data.data(), &header, sizeof(header)) == 0;
+        std::vector<int> seen(count, 0);
+        for (size_t offset = sizeof(header); resultPassed && offset < data.size(); offset += 73) {
+            const uint8_t* record = reinterpret_cast<const uint8_t*>(data.data()) + offset;
+            uint64_t index = 0;
+            for (int b = 0; b < 8; ++b) {
+                index |= static_cast<uint64_t>(record[b]) << (8 * b);
+            }
+            resultPassed = index < count && seen[index]++ == 0 && record[8] == static_cast<uint8_t>(index) &&
+                           record[8 + 33] == static_cast<uint8_t>(index * 7);
+        }
+
+        if (!resultPassed) {
+            std::cout << "Test failed for result file" << (error.empty() ? "" : ": " + error) << "\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for result file (" << count << " records)\n";
+        }
+    }
+
+    if (!hasAvx2) {
+        std::cout << "Skipping the AVX2 tests (not supported)\n";
+        return allPassed;
+    }
+
+    // Length-specialized kernel for 32-byte messages (SHA-256 of 32 zero bytes)
+    {
+        const uint8_t zeros[32] = {0};
+        alignas(32) unsigned char outputs[8][32];
+
+        sha256avx2_8B<32>(
+            zeros, zeros, zeros, zeros, zeros, zeros, zeros, zeros,
+            outputs[0], outputs[1], outputs[2], outputs[3],
+            outputs[4], outputs[5], outputs[6], outputs[7]
+        );
+
+        std::string hashHex = bytesToHexString(outputs[3], 32);
+        if (hashHex != "66687aadf862bd776c8fc18b8e9f8e20089714856ee233b3902a591d0d5f2925") {
+            std::cout << "Test failed for 32-byte kernel\n"
+                      << "Got:      " << hashHex << "\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for 32-byte kernel\n";
+        }
+    }
+
+    // Streaming context: 8 messages of different lengths fed in uneven chunks
+    {
+        std::vector<std::string> messages = {
+            "",
+            "abc",
+            "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+            "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+            std::string(1000000, 'a'),
+            std::string(55, 'a'),
+            std::string(56, 'a'),
+            std::string(64, 'a')
+        };
+        const char* expectedHashes[8] = {
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+            "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+            "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1",
+            "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+            "9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318",
+            "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a",
+            "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb"
+        };
+
+        Sha256x8 ctx;
+        size_t offset[8] = {0};
+        for (size_t chunk = 1; ; chunk = chunk * 3 + 1) {
+            const uint8_t* data[8];
+            size_t len[8];
+            bool done = true;
+            for (int i = 0; i < 8; ++i) {
+                size_t n = std::min(chunk + i, messages[i].size() - offset[i]);
+                data[i] = reinterpret_cast<const uint8_t*>(messages[i].data()) + offset[i];
+                len[i] = n;
+                offset[i] += n;
+                done = done && offset[i] == messages[i].size();
+            }
+            ctx.update(data, len);
+            if (done) {
+                break;
+            }
+        }
+
+        alignas(32) unsigned char outputs[8][32];
+        unsigned char* hashes[8];
+        for (int i = 0; i < 8; ++i) {
+            hashes[i] = outputs[i];
+        }
+        ctx.finalize(hashes);
+
+        for (int i = 0; i < 8; ++i) {
+            std::string hashHex = bytesToHexString(outputs[i], 32);
+            if (hashHex != expectedHashes[i]) {
+                std::cout << "Test failed for streaming lane " << i << "\n"
+                          << "Expected: " << expectedHashes[i] << "\n"
+                          << "Got:      " << hashHex << "\n";
+                allPassed = false;
+            } else {
+                std::cout << "Test passed for streaming lane " << i << " (" << messages[i].size() << " bytes)\n";
+            }
+        }
+    }
+
+    // Job manager: jobs of mixed lengths must match the streaming context
+    {
+        const size_t lengths[] = { 0, 1, 33, 55, 56, 63, 64, 65, 119, 120, 128, 200, 1000, 4096, 100000, 3, 777, 64, 31, 512 };
+        const int jobCount = sizeof(lengths) / sizeof(lengths[0]);
+
+        std::vector<std::vector<uint8_t>> messages(jobCount);
+        std::vector<std::vector<unsigned char>> digests(jobCount, std::vector<unsigned char>(32));
+        std::vector<Sha256Job> jobs(jobCount);
+        for (int i = 0; i < jobCount; ++i) {
+            messages[i].resize(lengths[i]);
+            for (size_t j = 0; j < lengths[i]; ++j) {
+                messages[i][j] = static_cast<uint8_t>(j * 31 + i);
+            }
+            // Empty messages are submitted without data
+            jobs[i] = { lengths[i] > 0 ? messages[i].data() : nullptr, lengths[i], digests[i].data(), &messages[i] };
+        }
+
+        Sha256JobManager manager;
+        std::vector<int> returned(jobCount, 0);
+        for (int i = 0; i < jobCount; ++i) {
+            Sha256Job* done = manager.submit(&jobs[i]);
+            if (done != nullptr) {
+                returned[done - jobs.data()]++;
+            }
+        }
+        while (Sha256Job* done = manager.flush()) {
+            returned[done - jobs.data()]++;
+        }
+
+        bool jobsPassed = true;
+        for (int i = 0; i < jobCount; i += 8) {
+            Sha256x8 ctx;
+            const uint8_t* data[8];
+            size_t len[8];
+            alignas(32) unsigned char outputs[8][32];
+            unsigned char* hashes[8];
+            for (int j = 0; j < 8; ++j) {
+                int k = std::min(i + j, jobCount - 1);
+                data[j] = messages[k].data();
+                len[j] = lengths[k];
+                hashes[j] = outputs[j];
+            }
+            ctx.update(data, len);
+            ctx.finalize(hashes);
+            for (int j = 0; j < 8 && i + j < jobCount; ++j) {
+                if (returned[i + j] != 1 || memcmp(outputs[j], digests[i + j].data(), 32) != 0) {
+                    jobsPassed = false;
+                }
+            }
+        }
+
+        if (!jobsPassed) {
+            std::cout << "Test failed for job manager\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for job manager (" << jobCount << " jobs)\n";
+        }
+    }
+
+    // Two-stream transform must match two single-stream transforms
+    {
+        uint8_t blocks[16][64];
+        const uint8_t* data[16];
+        for (int i = 0; i < 16; ++i) {
+            for (int j = 0; j < 64; ++j) {
+                blocks[i][j] = static_cast<uint8_t>(i * 31 + j * 7);
+            }
+            data[i] = blocks[i];
+        }
+
+        __m256i state2[16];
+        _sha256avx2::Initialize(state2);
+        _sha256avx2::Initialize(state2 + 8);
+        _sha256avx2::Transform2(state2, data);
+
+        __m256i state[16];
+        _sha256avx2::Initialize(state);
+        _sha256avx2::Initialize(state + 8);
+        _sha256avx2::Transform(state, data);
+        _sha256avx2::Transform(state + 8, data + 8);
+
+        if (memcmp(state, state2, sizeof(state)) != 0) {
+            std::cout << "Test failed for two-stream transform\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for two-stream transform\n";
+        }
+    }
+
+    // sha256d nonce scan on the Bitcoin genesis block header
+    {
+        const std::string headerHex =
+            "0100000000000000000000000000000000000000000000000000000000000000"
+            "000000003ba3edfd7a7b12b27ac72c3e67768f617fc81bc3888a51323a9fb8aa"
+            "4b1e5e4a29ab5f49ffff001d1dac2b7c";
+        uint8_t header[80];
+        HexDecode(headerHex, 80, header);
+        const uint32_t genesisNonce = 2083236893;
+
+        uint32_t bits;
+        memcpy(&bits, header + 72, 4);
+        uint8_t target[32];
+        compactToTarget(bits, target);
+
+        uint32_t nonce = 0;
+        unsigned char hash[32];
+        bool found = sha256davx2_scan(header, target, genesisNonce - 1000, 2000, &nonce, hash);
+
+        std::reverse(hash, hash + 32);
+        bool scanPassed = found && nonce == genesisNonce &&
+            bytesToHexString(hash, 32) == "000000000019d6689c085ae165831e934ff763ae46a2a6c172b3f1b60a8ce26f";
+
+        // A range ending just before the nonce, the last group is partial
+        scanPassed = scanPassed && !sha256davx2_scan(header, target, genesisNonce - 5, 5, &nonce, hash);
+
+        // With the largest target every nonce matches: compare the full hash
+        // with the streaming context followed by the 32-byte kernel
+        uint8_t anyTarget[32];
+        memset(anyTarget, 0xFF, 32);
+        uint8_t headers[8][80];
+        const uint8_t* data[8];
+        size_t len[8];
+        unsigned char first[8][32];
+        unsigned char* firstPtr[8];
+        for (int i = 0; i < 8; ++i) {
+            memcpy(headers[i], header, 80);
+            uint32_t n = genesisNonce + i * 77;
+            memcpy(headers[i] + 76, &n, 4);
+            data[i] = headers[i];
+            len[i] = 80;
+            firstPtr[i] = first[i];
+        }
+        Sha256x8 ctx;
+        ctx.update(data, len);
+        ctx.finalize(firstPtr);
+
+        unsigned char second[8][32];
+        sha256avx2_8B<32>(
+            first[0], first[1], first[2], first[3], first[4], first[5], first[6], first[7],
+            second[0], second[1], second[2], second[3], second[4], second[5], second[6], second[7]
+        );
+        for (int i = 0; i < 8; ++i) {
+            uint32_t n = genesisNonce + i * 77;
+            found = sha256davx2_scan(header, anyTarget, n, 3, &nonce, hash);
+            if (!found || nonce != n || memcmp(hash, second[i], 32) != 0) {
+                scanPassed = false;
+            }
+        }
+
+        if (!scanPassed) {
+            std::cout << "Test failed for sha256d nonce scan\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for sha256d nonce scan\n";
+        }
+    }
+
+    // Merkle roots: Bitcoin block 100000 and counter leaves with odd levels
+    {
+        const char* txids[] = {
+            "8c14f0db3df150123e6f3dbbf30f8b955a8249b62ac1d1ff16284aefa3d06d87",
+            "fff2525b8931402dd09222c50775608f75787bd2b87e56995a7bdd30f79702c4",
+            "6359f0868171b1d194cbee1af2f16ea598ae8fad666d9b012c8ed2b79a236ec4",
+            "e9a66845e05d5abc0ad04ec80f774a7e585c6e8db975962d069a522137b80c1d"
+        };
+        uint8_t leaves[4][32];
+        for (int i = 0; i < 4; ++i) {
+            // Displayed txids are byte-reversed
+            HexDecode(txids[i], 32, leaves[i]);
+            std::reverse(leaves[i], leaves[i] + 32);
+        }
+
+        unsigned char root[32];
+        bool merklePassed = sha256davx2_merkle_root(leaves[0], 4, root);
+        std::reverse(root, root + 32);
+        merklePassed = merklePassed && bytesToHexString(root, 32) == "f3e94742aca4b5ef85488dc37c06c3282295ffec960994b2c0d5ac2a25a95766";
+
+        // An empty tree has no root
+        if (sha256davx2_merkle_root(leaves[0], 0, root)) {
+            merklePassed = false;
+        }
+
+        struct { size_t n; const char* root; } counterCases[] = {
+            { 1, "0000000000000000000000000000000000000000000000000000000000000000" },
+            { 3, "a78528538716fdd11bf7955854db978f3126cc30154b1cce710b50a993a9cfbf" },
+            { 37, "a31a724e98c678c90cf45e6e8323baf3c231dd4597ca86f0bdcb958b1c71d9e5" },
+            { 1001, "4270263de47db583e731c7b38f3555b5d75fc74ac3559d6f27ae86c806edb1b9" }
+        };
+        for (const auto& counterCase : counterCases) {
+            std::vector<uint8_t> counterLeaves(counterCase.n * 32, 0);
+            for (size_t i = 0; i < counterCase.n; ++i) {
+                uint64_t value = i;
+                memcpy(counterLeaves.data() + i * 32, &value, 8);
+            }
+            bool built = sha256davx2_merkle_root(counterLeaves.data(), counterCase.n, root);
+            std::reverse(root, root + 32);
+            if (!built || bytesToHexString(root, 32) != counterCase.root) {
+                merklePassed = false;
+            }
+        }
+
+        if (!merklePassed) {
+            std::cout << "Test failed for Merkle root\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for Merkle root\n";
+        }
+    }
+
+    // Midstate path must match the full transform for 8 consecutive keys
+    {
+        alignas(32) uint8_t inputBuffers[8][64] = {0};
+        const uint8_t* inputs[8];
+        uint32_t w8[8];
+        for (int i = 0; i < 8; ++i) {
+            for (int j = 0; j < 32; ++j) {
+                inputBuffers[i][j] = static_cast<uint8_t>(j * 7 + 3);
+            }
+            inputBuffers[i][32] = static_cast<uint8_t>(0xF0 + i);
+            inputBuffers[i][33] = 0x80;
+            uint64_t bitLength = __builtin_bswap64(33 * 8);
+            memcpy(inputBuffers[i] + 56, &bitLength, 8);
+            inputs[i] = inputBuffers[i];
+            w8[i] = ((uint32_t)(0xF0 + i) << 24) | 0x800000;
+        }
+
+        alignas(32) unsigned char expected[8][32];
+        alignas(32) unsigned char outputs[8][32];
+
+        sha256avx2_8B(
+            inputs[0], inputs[1], inputs[2], inputs[3],
+            inputs[4], inputs[5], inputs[6], inputs[7],
+            expected[0], expected[1], expected[2], expected[3],
+            expected[4], expected[5], expected[6], expected[7]
+        );
+
+        _sha256avx2::Midstate midstate;
+        _sha256avx2::PrepareMidstate(&midstate, inputBuffers[0]);
+        sha256avx2_8B_midstate(
+            &midstate, w8,
+            outputs[0], outputs[1], outputs[2], outputs[3],
+            outputs[4], outputs[5], outputs[6], outputs[7]
+        );
+
+        if (memcmp(expected, outputs, sizeof(outputs)) != 0) {
+            std::cout << "Test failed for midstate reuse\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for midstate reuse\n";
+        }
+
+        // Masked search: 24-bit prefix of lane 5, 24 bits of words 3 (lane 2)
+        // and 7 (lane 6) which end the rounds early, and a prefix no lane has
+        struct MaskCase { std::string prefix, mask; };
+        std::string flipped = bytesToHexString(expected[0], 4);
+        flipped[0] = flipped[0] == 'f' ? '0' : 'f';
+        const MaskCase maskCases[4] = {
+            { bytesToHexString(expected[5], 3), "" },
+            { std::string(24, '0') + bytesToHexString(expected[2] + 12, 3), std::string(24, '0') + "ffffff" },
+            { std::string(56, '0') + bytesToHexString(expected[6] + 28, 3), std::string(56, '0') + "ffffff" },
+            { flipped, "" },
+        };
+        const int maskLanes[4] = { 5, 2, 6, -1 };
+
+        bool matchPassed = true;
+        for (int c = 0; c < 4; ++c) {
+            DigestMask digestMask;
+            if (!ParseDigestMask(&digestMask, 32, maskCases[c].prefix, maskCases[c].mask)) {
+                matchPassed = false;
+                continue;
+            }
+            _sha256avx2::DigestMatch match;
+            _sha256avx2::PrepareMatch(&match, digestMask.mask, digestMask.value);
+
+            alignas(32) unsigned char found[8][32] = {};
+            unsigned char* foundPtr[8] = { found[0], found[1], found[2], found[3], found[4], found[5], found[6], found[7] };
+            int lanes = sha256avx2_8B_midstate_match(&midstate, w8, &match, foundPtr);
+
+            int expectedLanes = 0;
+            for (int j = 0; j < 8; ++j) {
+                if (DigestMatches(&digestMask, expected[j])) {
+                    expectedLanes |= 1 << j;
+                    if (memcmp(found[j], expected[j], 32) != 0) {
+                        matchPassed = false;
+                    }
+                }
+            }
+            if (lanes != expectedLanes || (maskLanes[c] >= 0 && !(lanes & (1 << maskLanes[c])))) {
+                matchPassed = false;
+            }
+        }
+
+        if (!matchPassed) {
+            std::cout << "Test failed for masked search\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for masked search\n";
+        }
+    }
+
+    // Counter keys through the midstate, starting off a multiple of 8 so that
+    // groups straddle changes of byte 31, plus a masked search over them
+    {
+        const size_t count = 601;
+        uint8_t counterKey[33] = {0x02};
+        counterKey[31] = 0xFE;
+        counterKey[32] = 0xF3;
+
+        std::vector<uint8_t> keys(count * 33);
+        for (size_t i = 0; i < count; ++i) {
+            memcpy(keys.data() + i * 33, counterKey, 33);
+            incrementByteArray(keys.data() + i * 33, 33, i);
+        }
+        std::vector<unsigned char> expected(count * 32);
+        sha256scalar_batch<33>(keys.data(), 33, count, expected.data());
+
+        std::vector<unsigned char> outputs(count * 32);
+        sha256avx2_counter33_midstate(counterKey, count, outputs.data());
+        bool counterPassed = outputs == expected;
+
+        DigestMask digestMask;
+        ParseDigestMask(&digestMask, 32, "a", "");
+        _sha256avx2::DigestMatch match;
+        _sha256avx2::PrepareMatch(&match, digestMask.mask, digestMask.value);
+
+        std::vector<uint32_t> index(count);
+        std::vector<unsigned char> found(count * 32);
+        size_t foundCount = sha256avx2_counter33_match(counterKey, count, &match, index.data(), found.data());
+
+        size_t expectedCount = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (DigestMatches(&digestMask, expected.data() + i * 32)) {
+                if (expectedCount >= foundCount || index[expectedCount] != i ||
+                    memcmp(found.data() + expectedCount * 32, expected.data() + i * 32, 32) != 0) {
+                    counterPassed = false;
+                }
+                ++expectedCount;
+            }
+        }
+        if (expectedCount != foundCount || expectedCount == 0) {
+            counterPassed = false;
+        }
+
+        if (!counterPassed) {
+            std::cout << "Test failed for midstate counter\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for midstate counter (" << count << " keys, " << foundCount << " matches)\n";
+        }
+    }
+
+    // Strided batch API: any count, padded blocks and packed 33-byte keys
+    {
+        const size_t count = 21;
+        const size_t stride = 72;
+        std::vector<uint8_t> blocks(count * stride, 0);
+        std::vector<uint8_t> packed(count * 33);
+        for (size_t i = 0; i < count; ++i) {
+            uint8_t* block = blocks.data() + i * stride;
+            for (size_t j = 0; j < 33; ++j) {
+                block[j] = static_cast<uint8_t>(j * 13 + i);
+            }
+            block[33] = 0x80;
+            uint64_t bitLength = __builtin_bswap64(33 * 8);
+            memcpy(block + 56, &bitLength, 8);
+            memcpy(packed.data() + i * 33, block, 33);
+        }
+
+        std::vector<unsigned char> outputs(count * 32);
+        std::vector<unsigned char> outputs33(count * 32);
+        sha256avx2_batch(blocks.data(), stride, count, outputs.data());
+        sha256avx2_batch<33>(packed.data(), 33, count, outputs33.data());
+
+        bool batchPassed = true;
+        for (size_t i = 0; i < count; i += 8) {
+            const uint8_t* inputs[8];
+            alignas(32) unsigned char expected[8][32];
+            for (size_t j = 0; j < 8; ++j) {
+                inputs[j] = blocks.data() + std::min(i + j, count - 1) * stride;
+            }
+            sha256avx2_8B(
+                inputs[0], inputs[1], inputs[2], inputs[3],
+                inputs[4], inputs[5], inputs[6], inputs[7],
+                expected[0], expected[1], expected[2], expected[3],
+                expected[4], expected[5], expected[6], expected[7]
+            );
+            for (size_t j = 0; j < 8 && i + j < count; ++j) {
+                if (memcmp(expected[j], outputs.data() + (i + j) * 32, 32) != 0 ||
+                    memcmp(expected[j], outputs33.data() + (i + j) * 32, 32) != 0) {
+                    batchPassed = false;
+                }
+            }
+        }
+
+        if (!batchPassed) {
+            std::cout << "Test failed for strided batch\n";
+            allPassed = false;
+        } else {
+            std::cout << "Test passed for strided batch (" << count << " messages)\n";
+        }
+    }
+
+    return allPassed;
+}
+
+// Scan hashCount nonces of a block header in chunks shared out by the work
+// scheduler, for the lowest matching nonce
+int runScan(const std::string& headerHex, uint64_t hashCount, int numThreads, const ThreadAffinity& affinity) {
+    uint8_t header[80];
+    HexDecode(headerHex, 80, header);
+
+    uint32_t bits;
+    memcpy(&bits, header + 72, 4);
+    uint8_t target[32];
+    compactToTarget(bits, target);
+
+    uint32_t nonceStart;
+    memcpy(&nonceStart, header + 76, 4);
+
+    omp_set_num_threads(numThreads);
+
+    std::cout << "Number of threads                  : " << numThreads << "\n";
+
+    // Best match per thread as an offset from nonceStart (hashCount: none)
+    std::vector<uint64_t> offsets(numThreads, hashCount);
+    std::vector<uint32_t> nonces(numThreads);
+    std::vector<std::vector<unsigned char>> hashes(numThreads, std::vector<unsigned char>(32));
+    std::vector<uint64_t> scanned(numThreads, 0);  // A chunk stops at its first match
+
+    // Lowest match so far, chunks above it are skipped
+    std::atomic<uint64_t> lowest(hashCount);
+    WorkScheduler scheduler(hashCount, numThreads);
+
+    auto totalStart = std::chrono::high_resolution_clock::now();
+
+    #pragma omp parallel
+    {
+        int threadId = omp_get_thread_num();
+        affinity.pin(threadId);
+        uint64_t begin, end;
+
+        while (scheduler.next(threadId, &begin, &end)) {
+            if (begin >= lowest.load(std::memory_order_relaxed)) {
+                continue;
+            }
+
+            uint32_t chunkStart = nonceStart + static_cast<uint32_t>(begin);
+            uint32_t nonce;
+            unsigned char hash[32];
+            if (!sha256davx2_scan(header, target, chunkStart, end - begin, &nonce, hash)) {
+                scanned[threadId] += end - begin;
+                continue;
+            }
+
+            uint64_t offset = begin + static_cast<uint32_t>(nonce - chunkStart);
+            scanned[threadId] += offset - begin + 1;
+            if (offset < offsets[threadId]) {
+                offsets[threadId] = offset;
+                nonces[threadId] = nonce;
+                hashes[threadId].assign(hash, hash + 32);
+            }
+
+            uint64_t seen = lowest.load(std::memory_order_relaxed);
+            while (offset < seen && !lowest.compare_exchange_weak(seen, offset, std::memory_order_relaxed)) {
+            }
+        }
+    }
+
+    auto totalEnd = std::chrono::high_resolution_clock::now();
+
+    // The thread holding the lowest offset found the first nonce of the range
+    int winner = -1;
+    for (int i = 0; i < numThreads; ++i) {
+        if (offsets[i] < hashCount && (winner < 0 || offsets[i] < offsets[winner])) {
+            winner = i;
+        }
+    }
+
+    if (winner >= 0) {
+        std::vector<unsigned char> display(hashes[winner].rbegin(), hashes[winner].rend());
+        std::cout << "Nonce found                        : " << nonces[winner] << "\n";
+        std::cout << "Block hash                         : " << bytesToHexString(display.data(), 32) << "\n";
+    } else {
+        std::cout << "Nonce found                        : none\n";
+    }
+
+    auto totalDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(totalEnd - totalStart).count();
+    double totalSeconds = totalDuration / 1e9;
+    uint64_t totalScanned = 0;
+    for (int i = 0; i < numThreads; ++i) {
+        totalScanned += scanned[i];
+    }
+    double avgHashTime = (totalDuration / static_cast<double>(totalScanned));
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Nonces scanned                     : " << totalScanned << "\n";
+    std::cout << "Total execution time      (seconds): " << totalSeconds << "\n";
+    std::cout << "Average time per hash (nanoseconds): " << avgHashTime << "\n";
+
+    return 0;
 }
 
-// Function to display help message
-void displayHelp() {
-    std::cout << "Usage: program [options]\n"
-              << "Options:\n"
-              << "  -h                Display help information\n"
-              << "  -c <count>        Number of hashes to compute (multiple of 8, default 128)\n"
-              << "  -t <threads>      Number of threads to use (default is maximum available)\n"
-              << "  -s                Save last keys and hashes from each thread to last_hashes.txt\n"
-              << "  -i <initial_key>  Specify initial key (66 HEX characters)\n"
-              << "  --test            Run test cases with known examples\n";
+// Hash a file of records into a file of digests
+int runFile(const std::string& inPath, const std::string& outPath, size_t recordLen, int numThreads,
+            const ThreadAffinity& affinity) {
+    std::cout << "Number of threads                  : " << numThreads << "\n";
+    if (affinity.enabled()) {
+        std::cout << "Thread affinity                    : " << affinity.describe() << "\n";
+    }
+    std::cout << "Kernel                             : " << sha256_kernel() << " (" << sha256_kernel_lanes() << " lanes)\n";
+
+    auto totalStart = std::chrono::high_resolution_clock::now();
+
+    uint64_t records = 0;
+    std::string error;
+    if (!hashFile(inPath, outPath, recordLen, numThreads, affinity, &records, &error)) {
+        std::cerr << "Error: " << error << ".\n";
+        return 1;
+    }
+
+    auto totalEnd = std::chrono::high_resolution_clock::now();
+
+    // Mapping, hashing and unmapping, the written pages are flushed later
+    auto totalDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(totalEnd - totalStart).count();
+    double totalSeconds = totalDuration / 1e9;
+    double avgHashTime = records > 0 ? totalDuration / static_cast<double>(records) : 0;
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Records hashed                     : " << records << "\n";
+    std::cout << "Total execution time      (seconds): " << totalSeconds << "\n";
+    std::cout << "Average time per hash (nanoseconds): " << avgHashTime << "\n";
+    std::cout << "Input read              (MB/second): " << records * recordLen / 1e6 / totalSeconds << "\n";
+
+    return 0;
 }
 
-// Known test cases for --test option
-struct TestCase {
-    std::string input;
-    std::string expectedHash;
-};
+// Hash records from stdin into digests on stdout, the report goes to stderr
+int runStream(size_t recordLen, bool hex, int numThreads, const ThreadAffinity& affinity) {
+    std::cerr << "Number of threads                  : " << numThreads << "\n";
+    if (affinity.enabled()) {
+        std::cerr << "Thread affinity                    : " << affinity.describe() << "\n";
+    }
+    std::cerr << "Kernel                             : " << sha256_kernel() << " (" << sha256_kernel_lanes() << " lanes)\n";
 
-// Function to run test cases
-bool runTests() {
-    std::vector<TestCase> testCases = {
-        {"000000000000000000000000000000000000000000000000000000000000000001", "1fd4247443c9440cb3c48c28851937196bc156032d70a96c98e127ecb347e45f"},
-        {"000000000000000000000000000000000000000000000000000000000000000010", "65074aa3a766c6973ac3de47f82f3acabb999b36202ce6edcd6b348ea227c00f"},
-        {"000000000000000000000000000000000000000000000000000000000000000100", "e65b66499024a7a2f732fc71a035ef70b6eb493445a6cfb708f69bff18fd7eb5"},
-        {"000000000000000000000000000000000000000000000000000000000000001000", "58ba123afbfa01d0ab579910e3c71707804db829410c38d132d9f9ceaccc455f"},
-        {"100000000000000000000000000000000000000000000000000000000000000000", "a9deba97c5a6ecfff3bd534250e4d43e44732733254e794ca53727344f5522eb"},
-        {"010000000000000000000000000000000000000000000000000000000000000000", "1a7dfdeaffeedac489287e85be5e9c049a2ff6470f55cf30260f55395ac1b159"},
-        {"001000000000000000000000000000000000000000000000000000000000000000", "cd6a3ca0edecc51cce376f20c24705f61767c0724ab5dc6ba9f97476cf913231"},
-        {"000100000000000000000000000000000000000000000000000000000000000000", "1b7c643b049c11a4fb6b65822e4a5e2a3da54223366c5f453cf376536f9bf42a"}
+    auto totalStart = std::chrono::high_resolution_clock::now();
+
+    // Hex records are lines of text around the same binary kernels
+    size_t inLen = hex ? 2 * recordLen + 1 : recordLen;
+    StreamPipeline pipeline(inLen, hex ? 65 : 32);
+    auto hash = [recordLen, hex](const uint8_t* in, size_t n, uint8_t* out) {
+        if (hex) {
+            return hashHexRecords(in, recordLen, n, out);
+        }
+        hashRecords(in, recordLen, n, out);
+        return true;
     };
+    uint64_t records = 0;
+    std::string error;
+    if (!pipeline.run(fileno(stdin), fileno(stdout), numThreads, affinity, hash, &records, &error)) {
+        std::cerr << "Error: " << error << ".\n";
+        return 1;
+    }
 
-    bool allPassed = true;
+    auto totalEnd = std::chrono::high_resolution_clock::now();
 
-    for (const auto& testCase : testCases) {
-        uint8_t keyBytes[66] = {0};
-        // Convert hex string to byte array
-        std::string initialKeyHex = testCase.input;
-        if (initialKeyHex.size() < 66) {
-            initialKeyHex = std::string(66 - initialKeyHex.size(), '0') + initialKeyHex;
-        }
+    auto totalDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(totalEnd - totalStart).count();
+    double totalSeconds = totalDuration / 1e9;
+    double avgHashTime = records > 0 ? totalDuration / static_cast<double>(records) : 0;
 
-        for (size_t i = 0; i < 33; ++i) {
-            std::string byteString = initialKeyHex.substr(i * 2, 2);
-            keyBytes[i] = static_cast<uint8_t>(std::stoul(byteString, nullptr, 16));
-        }
+    std::cerr << std::fixed << std::setprecision(2);
+    std::cerr << "Records hashed                     : " << records << "\n";
+    std::cerr << "Total execution time      (seconds): " << totalSeconds << "\n";
+    std::cerr << "Average time per hash (nanoseconds): " << avgHashTime << "\n";
+    std::cerr << "Input read              (MB/second): " << records * inLen / 1e6 / totalSeconds << "\n";
 
-        // Prepare input buffers
-        alignas(32) uint8_t inputBuffers[8][64] = {0};
-        for (int i = 0; i < 8; ++i) {
-            memcpy(inputBuffers[i], keyBytes, 33);
-            inputBuffers[i][33] = 0x80;
-            uint64_t bitLength = 33 * 8;
-            bitLength = __builtin_bswap64(bitLength);
-            memcpy(inputBuffers[i] + 56, &bitLength, 8);
-        }
-        const uint8_t* inputs[8];
-        for (int i = 0; i < 8; ++i) {
-            inputs[i] = inputBuffers[i];
-        }
+    return 0;
+}
 
-        alignas(32) unsigned char outputs[8][32];
+// Merkle root of hashCount counter leaves
+int runMerkle(uint64_t hashCount, int numThreads) {
+    std::vector<uint8_t> leaves(hashCount * 32, 0);
+    for (uint64_t i = 0; i < hashCount; ++i) {
+        memcpy(leaves.data() + i * 32, &i, 8);
+    }
 
-        sha256avx2_8B(
-            inputs[0], inputs[1], inputs[2], inputs[3],
-            inputs[4], inputs[5], inputs[6], inputs[7],
-            outputs[0], outputs[1], outputs[2], outputs[3],
-            outputs[4], outputs[5], outputs[6], outputs[7]
-        );
+    omp_set_num_threads(numThreads);
 
-        std::string hashHex = bytesToHexString(outputs[0], 32);
-        if (hashHex != testCase.expectedHash) {
-            std::cout << "Test failed for input: " << testCase.input << "\n"
-                      << "Expected: " << testCase.expectedHash << "\n"
-                      << "Got:      " << hashHex << "\n";
-            allPassed = false;
-        } else {
-            std::cout << "Test passed for input: " << testCase.input << "\n";
-        }
+    std::cout << "Number of threads                  : " << numThreads << "\n";
+
+    auto totalStart = std::chrono::high_resolution_clock::now();
+
+    unsigned char root[32];
+    if (!sha256davx2_merkle_root(leaves.data(), hashCount, root)) {
+        std::cerr << "Error: Not enough memory for the Merkle tree levels.\n";
+        return 1;
     }
 
-    return allPassed;
+    auto totalEnd = std::chrono::high_resolution_clock::now();
+
+    std::reverse(root, root + 32);
+    std::cout << "Merkle root                        : " << bytesToHexString(root, 32) << "\n";
+
+    // About one internal node per leaf
+    auto totalDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(totalEnd - totalStart).count();
+    double totalSeconds = totalDuration / 1e9;
+    double avgHashTime = (totalDuration / static_cast<double>(hashCount));
+
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "Total execution time      (seconds): " << totalSeconds << "\n";
+    std::cout << std::setprecision(2);
+    std::cout << "Average time per leaf (nanoseconds): " << avgHashTime << "\n";
+
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
@@ -117,6 +1380,25 @@ int main(int argc, char* argv[]) {
     int numThreads = omp_get_max_threads();  // Default number of threads
     bool saveLastHashes = false;
     bool testMode = false;
+    bool useMidstate = true;
+    std::string kernelName;
+    std::string targetsPath;
+    std::string prefixHex;
+    std::string maskHex;
+    std::string scanHeaderHex;
+    std::string affinitySpec;
+    std::string savePath;
+    bool saveHitsOnly = false;
+    std::string filePath;
+    std::string outPath;
+    bool streamMode = false;
+    bool profile = false;
+    bool hexRecords = false;
+    size_t recordLen = 33;
+    bool merkleMode = false;
+    bool randomMode = false;
+    bool seedGiven = false;
+    uint64_t seed = 0;
     std::string initialKeyHex = "000000000000000000000000000000000000000000000000000000000000011111";  // Default initial key
 
     // Parse command-line arguments
@@ -129,8 +1411,8 @@ int main(int argc, char* argv[]) {
             if (i + 1 < argc) {
                 try {
                     hashCount = std::stoull(argv[++i]);
-                    if (hashCount == 0 || hashCount % 8 != 0) {
-                        std::cerr << "Error: -c value must be a positive multiple of 8.\n";
+                    if (hashCount == 0) {
+                        std::cerr << "Error: -c value must be a positive integer.\n";
                         return 1;
                     }
                 } catch (const std::invalid_argument&) {
@@ -175,10 +1457,124 @@ int main(int argc, char* argv[]) {
                     std::cerr << "Error: Initial key must be at most 66 hex digits.\n";
                     return 1;
                 }
+                if (initialKeyHex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+                    std::cerr << "Error: Initial key must be hex digits.\n";
+                    return 1;
+                }
             } else {
                 std::cerr << "Error: -i requires a value.\n";
                 return 1;
             }
+        } else if (arg == "-r") {
+            randomMode = true;
+        } else if (arg == "--seed") {
+            if (i + 1 < argc) {
+                try {
+                    seed = std::stoull(argv[++i], nullptr, 0);
+                    seedGiven = true;
+                } catch (const std::exception&) {
+                    std::cerr << "Error: Invalid value for --seed.\n";
+                    return 1;
+                }
+            } else {
+                std::cerr << "Error: --seed requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--no-midstate") {
+            useMidstate = false;
+        } else if (arg == "--file") {
+            if (i + 1 < argc) {
+                filePath = argv[++i];
+            } else {
+                std::cerr << "Error: --file requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--stream") {
+            streamMode = true;
+        } else if (arg == "--hex") {
+            hexRecords = true;
+        } else if (arg == "--out") {
+            if (i + 1 < argc) {
+                outPath = argv[++i];
+            } else {
+                std::cerr << "Error: --out requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--record") {
+            if (i + 1 < argc) {
+                std::string size = argv[++i];
+                if (size != "32" && size != "33") {
+                    std::cerr << "Error: --record must be 32 or 33.\n";
+                    return 1;
+                }
+                recordLen = std::stoul(size);
+            } else {
+                std::cerr << "Error: --record requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--save" || arg == "--save-hits") {
+            if (!savePath.empty()) {
+                std::cerr << "Error: Only one of --save and --save-hits can be given.\n";
+                return 1;
+            }
+            if (i + 1 < argc) {
+                saveHitsOnly = arg == "--save-hits";
+                savePath = argv[++i];
+            } else {
+                std::cerr << "Error: " << arg << " requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--affinity") {
+            if (i + 1 < argc) {
+                affinitySpec = argv[++i];
+            } else {
+                std::cerr << "Error: --affinity requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--kernel") {
+            if (i + 1 < argc) {
+                kernelName = argv[++i];
+            } else {
+                std::cerr << "Error: --kernel requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--scan") {
+            if (i + 1 < argc) {
+                scanHeaderHex = argv[++i];
+                if (scanHeaderHex.size() != 160 ||
+                    scanHeaderHex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+                    std::cerr << "Error: Block header must be 160 hex digits.\n";
+                    return 1;
+                }
+            } else {
+                std::cerr << "Error: --scan requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--merkle") {
+            merkleMode = true;
+        } else if (arg == "--targets") {
+            if (i + 1 < argc) {
+                targetsPath = argv[++i];
+            } else {
+                std::cerr << "Error: --targets requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--prefix") {
+            if (i + 1 < argc) {
+                prefixHex = argv[++i];
+            } else {
+                std::cerr << "Error: --prefix requires a value.\n";
+                return 1;
+            }
+        } else if (arg == "--mask") {
+            if (i + 1 < argc) {
+                maskHex = argv[++i];
+            } else {
+                std::cerr << "Error: --mask requires a value.\n";
+                return 1;
+            }
         } else if (arg == "--test") {
             testMode = true;
             if (argc > 2) {
@@ -198,15 +1594,108 @@ int main(int argc, char* argv[]) {
         return testsPassed ? 0 : 1;
     }
 
-    // Check if hashCount is divisible by numThreads
-    if (hashCount % numThreads != 0) {
-        std::cerr << "Error: Number of hashes must be divisible by the number of threads.\n";
+    if (hexRecords && !streamMode) {
+        std::cerr << "Error: --hex is only for --stream.\n";
+        return 1;
+    }
+
+    ThreadAffinity affinity;
+    std::string affinityError;
+    if (!affinitySpec.empty() && !affinity.parse(affinitySpec, &affinityError)) {
+        std::cerr << "Error: " << affinityError << ".\n";
+        return 1;
+    }
+
+    if (merkleMode) {
+        if (!sha256_kernel_supported("avx2")) {
+            std::cerr << "Error: --merkle needs AVX2.\n";
+            return 1;
+        }
+        return runMerkle(hashCount, numThreads);
+    }
+
+    if (!scanHeaderHex.empty()) {
+        if (!sha256_kernel_supported("avx2")) {
+            std::cerr << "Error: --scan needs AVX2.\n";
+            return 1;
+        }
+        // The nonce is 32 bits, more would hash the same nonces again
+        if (hashCount > (1ull << 32)) {
+            std::cerr << "Error: --scan covers at most 4294967296 nonces (-c).\n";
+            return 1;
+        }
+        return runScan(scanHeaderHex, hashCount, numThreads, affinity);
+    }
+
+    if (!kernelName.empty() && !sha256_select_kernel(kernelName.c_str())) {
+        std::cerr << "Error: Kernel " << kernelName << " is not available on this CPU.\n";
+        return 1;
+    }
+
+    if (streamMode) {
+        return runStream(recordLen, hexRecords, numThreads, affinity);
+    }
+
+    if (!filePath.empty()) {
+        if (outPath.empty()) {
+            std::cerr << "Error: --file requires --out.\n";
+            return 1;
+        }
+        return runFile(filePath, outPath, recordLen, numThreads, affinity);
+    }
+
+    // Digests to look for while generating
+    TargetSet targets(32);
+    if (!targetsPath.empty()) {
+        size_t badLine = 0;
+        if (!targets.loadHexFile(targetsPath.c_str(), &badLine)) {
+            if (badLine == 0) {
+                std::cerr << "Error: Cannot read " << targetsPath << ".\n";
+            } else {
+                std::cerr << "Error: Line " << badLine << " of " << targetsPath << " is not a 64-digit hex hash.\n";
+            }
+            return 1;
+        }
+        targets.build();
+    }
+    bool useTargets = targets.size() > 0;
+
+    // Masked search
+    bool searchMode = !prefixHex.empty() || !maskHex.empty();
+    DigestMask digestMask;
+    if (searchMode && !ParseDigestMask(&digestMask, 32, prefixHex, maskHex)) {
+        std::cerr << "Error: --prefix and --mask must be at most 64 hex digits and the prefix must lie within the mask.\n";
         return 1;
     }
 
+    if (randomMode && !seedGiven) {
+        std::random_device device;
+        seed = ((uint64_t)device() << 32) | device();
+    }
+
     omp_set_num_threads(numThreads);
 
     std::cout << "Number of threads                  : " << numThreads << "\n";
+    if (affinity.enabled()) {
+        std::cout << "Thread affinity                    : " << affinity.describe() << "\n";
+    }
+    if (randomMode) {
+        std::cout << "Random seed                        : " << seed << "\n";
+    }
+    if (!targetsPath.empty()) {
+        std::cout << "Targets loaded                     : " << targets.size() << "\n";
+    }
+    if (searchMode) {
+        std::cout << "Search mask                        : " << bytesToHexString(digestMask.mask, 32) << "\n";
+        std::cout << "Search value                       : " << bytesToHexString(digestMask.value, 32) << "\n";
+    }
+    // Midstate reuse is a single-stream AVX2 kernel, so it only stands in for
+    // the avx2 kernel: avx2x2 and the 16-lane AVX-512 kernel keep the plain
+    // counter path they were selected for. Random keys share no prefix.
+    bool midstateEnabled = useMidstate && !randomMode && strcmp(sha256_kernel(), "avx2") == 0;
+
+    std::cout << "Kernel                             : " << sha256_kernel() << " (" << sha256_kernel_lanes() << " lanes)\n";
+    std::cout << "Hash path                          : " << (midstateEnabled ? "avx2 midstate" : "full transform") << "\n";
 
     auto totalStart = std::chrono::high_resolution_clock::now();
 
@@ -214,87 +1703,265 @@ int main(int argc, char* argv[]) {
     std::vector<std::string> lastKeys(numThreads);
     std::vector<std::vector<unsigned char>> lastHashes(numThreads, std::vector<unsigned char>(32));
 
+    // Target hits and matches per thread with their key index, no locking in
+    // the loop
+    std::vector<std::vector<std::pair<uint64_t, std::string>>> hits(numThreads);
+    std::vector<std::vector<std::pair<uint64_t, std::string>>> matches(numThreads);
+
     size_t keyLength = 33;  // 33 bytes
 
     // Convert initial key from hex string to byte array
     uint8_t initialKeyBytes[66] = {0};
-    for (size_t i = 0; i < 33; ++i) {
-        std::string byteString = initialKeyHex.substr(i * 2, 2);
-        initialKeyBytes[i] = static_cast<uint8_t>(std::stoul(byteString, nullptr, 16));
+    HexDecode(initialKeyHex, 33, initialKeyBytes);
+
+    // The threads take chunks of the key range and steal from each other at
+    // the end, chunks are whole blocks of random keys
+    WorkScheduler scheduler(hashCount, numThreads, kRandomBlock);
+
+    // Binary results, written out by a background thread
+    std::unique_ptr<ResultWriter> results;
+    bool saveAll = !savePath.empty() && !saveHitsOnly;
+    bool saveHits = !savePath.empty() && saveHitsOnly;
+    if (!savePath.empty()) {
+        ResultHeader header = {};
+        memcpy(header.magic, "HASHRES1", 8);
+        header.algorithm = ResultHeader::kSha256;
+        header.keyLen = 33;
+        header.digestLen = 32;
+        header.flags = (saveHitsOnly ? ResultHeader::kHitsOnly : 0) | (randomMode ? ResultHeader::kRandomKeys : 0);
+        header.threads = numThreads;
+        header.chunkAlign = kRandomBlock;
+        header.count = hashCount;
+        header.seed = randomMode ? seed : 0;
+        memcpy(header.startKey, initialKeyBytes, keyLength);
+
+        std::string error;
+        results.reset(new ResultWriter(numThreads, 33, 32));
+        if (!results->open(savePath, header, &error)) {
+            std::cerr << "Error: " << error << ".\n";
+            return 1;
+        }
     }
 
+    // Arenas per page kind, and threads the OS would not pin
+    std::atomic<int> arenaPages[3] = {{0}, {0}, {0}};
+    std::atomic<int> unpinned(0);
+
+    // Hardware counts of each thread's hashing loop for --profile
+    std::vector<PerfSample> profiles(profile ? numThreads : 0);
+
     #pragma omp parallel
     {
         int threadId = omp_get_thread_num();
-        uint64_t hashesPerThread = hashCount / numThreads;
+        if (affinity.enabled() && !affinity.pin(threadId)) {
+            unpinned++;
+        }
 
-        // Each thread gets a copy of the starting key
-        uint8_t startingKeyBytes[66] = {0};
-        memcpy(startingKeyBytes, initialKeyBytes, keyLength);
+        // Keys per kernel call: the kernels generate them in registers from
+        // the first one, the digests of a batch stay in L1
+        const uint64_t batchSize = 256;
 
-        // Increment starting key for each thread
-        incrementByteArray(startingKeyBytes, keyLength, threadId * hashesPerThread);
+        // Buffers and a copy of the target filter in huge pages, allocated
+        // after pinning so they sit on the thread's node
+        ThreadArena arena(batchSize * 32 + batchSize * 4 + (saveAll ? batchSize * 33 : 0) +
+                          (useTargets ? targets.filterBytes() : 0) + 4 * 64);
+        arenaPages[arena.pages()]++;
+        unsigned char (*hash)[32] = arena.allocArray<unsigned char[32]>(batchSize);  // Buffers for hashes
+        uint32_t* hitIndex = arena.allocArray<uint32_t>(batchSize);
+        uint8_t (*batchKeys)[33] = saveAll ? arena.allocArray<uint8_t[33]>(batchSize) : nullptr;
+        std::unique_ptr<TargetSet> localTargets;
+        if (useTargets) {
+            localTargets.reset(new TargetSet(targets, arena.alloc(targets.filterBytes())));
+        }
 
-        alignas(32) unsigned char hash[8][32];  // Buffers for hashes
-        alignas(32) uint8_t keys[8][64];        // Buffers for keys and padding
+        // First key of the current batch and its index in the range
+        uint8_t keyBytes[66] = {0};
+        uint64_t i = 0;
 
-        const int batchSize = 8;
+        // Key of hash j of the current batch
+        auto keyAt = [&](uint64_t j, uint8_t* key) {
+            if (randomMode) {
+                sha256_random_key(initialKeyBytes[0], seed, 0, i + j, key);
+            } else {
+                memcpy(key, keyBytes, keyLength);
+                incrementByteArray(key, keyLength, j);
+            }
+        };
 
-        for (uint64_t i = 0; i < hashesPerThread; i += batchSize) {  // Process hashes in batches of 8
-            // Initialize input data
-            const uint8_t* keysBatch[8];
-            unsigned char* hashesBatch[8];
+        auto keyHex = [&](uint64_t j) {
+            uint8_t key[33];
+            keyAt(j, key);
+            return bytesToHexString(key, keyLength);
+        };
 
-            for (int j = 0; j < batchSize; ++j) {
-                memset(keys[j], 0, 64);
-                memcpy(keys[j], startingKeyBytes, keyLength);
-                keys[j][keyLength] = 0x80;
+        // Hit or match j of the batch for --save-hits
+        auto saveHit = [&](uint64_t j, const uint8_t* digest) {
+            if (saveHits) {
+                uint8_t key[33];
+                keyAt(j, key);
+                results->append(threadId, i + j, key, digest);
+            }
+        };
 
-                uint64_t bitLength = keyLength * 8;
-                bitLength = __builtin_bswap64(bitLength);
-                memcpy(keys[j] + 56, &bitLength, 8);
+        // Masked search on the midstate path, only matching lanes are depacked
+        _sha256avx2::DigestMatch match;
+        if (midstateEnabled && searchMode) {
+            _sha256avx2::PrepareMatch(&match, digestMask.mask, digestMask.value);
+        }
 
-                keysBatch[j] = keys[j];
-                hashesBatch[j] = hash[j];
+        // The counters only run around the loop, setup and output are left out
+        PerfCounters counters;
+        bool counting = profile && counters.open(&profiles[threadId].error);
+        uint64_t hashed = 0;
+        if (counting) {
+            counters.start();
+        }
 
-                // Increment key for next value
-                incrementByteArray(startingKeyBytes, keyLength, 1);
-            }
+        bool saved = false;
+        uint64_t lastIndex = 0;
+        uint64_t begin, end;
+        while (scheduler.next(threadId, &begin, &end)) {
+            hashed += end - begin;
+            memcpy(keyBytes, initialKeyBytes, keyLength);
+            incrementByteArray(keyBytes, keyLength, begin);
 
-            // Compute hashes using the optimized SHA-256 AVX2 function
-            sha256avx2_8B(
-                keysBatch[0], keysBatch[1], keysBatch[2], keysBatch[3],
-                keysBatch[4], keysBatch[5], keysBatch[6], keysBatch[7],
-                hashesBatch[0], hashesBatch[1], hashesBatch[2], hashesBatch[3],
-                hashesBatch[4], hashesBatch[5], hashesBatch[6], hashesBatch[7]
-            );
+            for (i = begin; i < end;) {
+                uint64_t count = std::min(batchSize, end - i);
+                bool lastBatch = saveLastHashes && i + count == end;
 
-            // Save the last key and hash from this thread
-            if (i + batchSize >= hashesPerThread) {
-                lastKeys[threadId] = bytesToHexString(keys[batchSize - 1], keyLength);
-                lastHashes[threadId].assign(hash[batchSize - 1], hash[batchSize - 1] + 32);
+                if (searchMode && !useTargets && midstateEnabled && !lastBatch && !saveAll) {
+                    // A search alone needs no digests but the matching ones
+                    // (the last batch of a chunk is stored in full for -s)
+                    size_t found = sha256avx2_counter33_match(keyBytes, count, &match, hitIndex, hash[0]);
+                    for (size_t j = 0; j < found; ++j) {
+                        matches[threadId].emplace_back(i + hitIndex[j], keyHex(hitIndex[j]) + " " + bytesToHexString(hash[j], 32));
+                        saveHit(hitIndex[j], hash[j]);
+                    }
+                } else {
+                    if (randomMode) {
+                        sha256_random33(initialKeyBytes[0], seed, 0, i, count, hash[0]);
+                    } else if (midstateEnabled) {
+                        sha256avx2_counter33_midstate(keyBytes, count, hash[0]);
+                    } else {
+                        // Full groups on the selected kernel, the rest on narrower ones
+                        sha256_counter33(keyBytes, count, hash[0]);
+                    }
+
+                    if (useTargets) {
+                        size_t hitCount = localTargets->probe(hash[0], 32, count, hitIndex);
+                        for (size_t h = 0; h < hitCount; ++h) {
+                            hits[threadId].emplace_back(i + hitIndex[h], keyHex(hitIndex[h]) + " " + bytesToHexString(hash[hitIndex[h]], 32));
+                            saveHit(hitIndex[h], hash[hitIndex[h]]);
+                        }
+                    }
+
+                    for (uint64_t j = 0; searchMode && j < count; ++j) {
+                        if (DigestMatches(&digestMask, hash[j])) {
+                            matches[threadId].emplace_back(i + j, keyHex(j) + " " + bytesToHexString(hash[j], 32));
+                            saveHit(j, hash[j]);
+                        }
+                    }
+                }
+
+                // Every key and hash for --save
+                if (saveAll) {
+                    if (randomMode) {
+                        sha256_random_keys(initialKeyBytes[0], seed, 0, i, count, batchKeys[0]);
+                    } else {
+                        memcpy(batchKeys[0], keyBytes, keyLength);
+                        for (uint64_t j = 1; j < count; ++j) {
+                            memcpy(batchKeys[j], batchKeys[j - 1], keyLength);
+                            incrementByteArray(batchKeys[j], keyLength, 1);
+                        }
+                    }
+                    for (uint64_t j = 0; j < count; ++j) {
+                        results->append(threadId, i + j, batchKeys[j], hash[j]);
+                    }
+                }
+
+                // Save the last key (highest index) and hash from this thread
+                if (lastBatch && (!saved || end - 1 > lastIndex)) {
+                    saved = true;
+                    lastIndex = end - 1;
+                    lastKeys[threadId] = keyHex(count - 1);
+                    lastHashes[threadId].assign(hash[count - 1], hash[count - 1] + 32);
+                }
+
+                i += count;
+                incrementByteArray(keyBytes, keyLength, count);
             }
         }
+
+        if (counting) {
+            counters.stop();
+            profiles[threadId].take(counters, hashed);
+        }
+
+        if (results) {
+            results->flush(threadId);
+        }
     }
 
+    // The last blocks of the result file are written before the clock stops
+    std::string saveError;
+    bool resultsSaved = !results || results->close(&saveError);
+
     auto totalEnd = std::chrono::high_resolution_clock::now();
 
-    // Output last keys and hashes
+    if (!resultsSaved) {
+        std::cerr << "Error: " << saveError << ".\n";
+        return 1;
+    }
+
+    // Output last keys and hashes (threads that got no work are left out)
     if (saveLastHashes) {
         std::ofstream outFile("last_hashes.txt");
         for (int i = 0; i < numThreads; ++i) {
+            if (lastKeys[i].empty()) {
+                continue;
+            }
             outFile << "Thread " << i << " last key: " << lastKeys[i] << "\n";
             outFile << "Thread " << i << " last hash: " << bytesToHexString(lastHashes[i].data(), 32) << "\n";
         }
         outFile.close();
     }
 
+    // Output target hits (key and hash)
+    if (!targetsPath.empty()) {
+        std::vector<std::string> hitLines = mergeByKey(hits);
+        std::cout << "Target hits                        : " << hitLines.size() << "\n";
+        for (const auto& hit : hitLines) {
+            std::cout << "Hit: " << hit << "\n";
+        }
+    }
+
+    // Output search matches (key and hash)
+    if (searchMode) {
+        std::vector<std::string> matchLines = mergeByKey(matches);
+        std::cout << "Matches found                      : " << matchLines.size() << "\n";
+        for (const auto& match : matchLines) {
+            std::cout << "Match: " << match << "\n";
+        }
+    }
+
     // Output statistics
     auto totalDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(totalEnd - totalStart).count();
     double totalSeconds = totalDuration / 1e9;
     double avgHashTime = (totalDuration / static_cast<double>(hashCount));
 
     std::cout << std::fixed << std::setprecision(2);
+    if (results) {
+        std::cout << "Records saved                      : " << results->records() << "\n";
+    }
+    std::cout << "Chunks stolen                      : " << scheduler.steals() << "\n";
+    std::cout << "Thread arenas (2 MB pages)         : " << arenaPages[ThreadArena::kReserved] << " reserved, "
+              << arenaPages[ThreadArena::kTransparent] << " transparent, " << arenaPages[ThreadArena::kSmall] << " small\n";
+    if (unpinned > 0) {
+        std::cout << "Threads left unpinned              : " << unpinned << "\n";
+    }
+    if (profile) {
+        PrintProfile(std::cout, profiles, 256);  // Batches of the hashing loop
+    }
     std::cout << "Total execution time      (seconds): " << totalSeconds << "\n";
     std::cout << "Average time per hash (nanoseconds): " << avgHashTime << "\n";
 
@@ -0,0 +1,45 @@
+#include "sha256_dispatch.h"
+#include <immintrin.h>
+
+// AVX-512 kernels, 16 messages per transform. Only called after the
+// dispatcher has checked the CPU. Left out when built with -DNO_AVX512.
+#ifndef NO_AVX512
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC target("avx512f")
+// GCC 12 reports the intentionally undefined operands inside avx512fintrin.h
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+#endif
+
+#include "sha256_rounds.h"
+
+typedef _sha256avx2::Rounds<VecAvx512> RoundsAvx512;
+
+void sha256avx512_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    RoundsAvx512::HashStrided<0>(in, stride, n, out);
+}
+
+template <size_t Len>
+void sha256avx512_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    RoundsAvx512::HashStrided<Len>(in, stride, n, out);
+}
+
+template void sha256avx512_batch<32>(const uint8_t*, size_t, size_t, uint8_t*);
+template void sha256avx512_batch<33>(const uint8_t*, size_t, size_t, uint8_t*);
+
+void sha256avx512_counter33(const uint8_t* key, size_t n, uint8_t* out) {
+    RoundsAvx512::HashCounter33(key, n, out);
+}
+
+void sha256avx512_random33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t* out) {
+    RoundsAvx512::HashRandom33(prefix, seed, stream, block, n, out);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif // NO_AVX512
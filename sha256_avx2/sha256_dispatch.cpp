@@ -0,0 +1,218 @@
+#include "sha256_dispatch.h"
+#include "sha256_avx2.h"
+#include "sha256_rounds.h"
+#include "../common/cpu_features.h"
+#include <string.h>
+
+// Built for the baseline target: this file only decides which kernel runs,
+// plus the scalar kernel that handles the last few messages.
+
+typedef _sha256avx2::Rounds<VecScalar> RoundsScalar;
+
+void sha256scalar_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    RoundsScalar::HashStrided<0>(in, stride, n, out);
+}
+
+template <size_t Len>
+void sha256scalar_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    RoundsScalar::HashStrided<Len>(in, stride, n, out);
+}
+
+template void sha256scalar_batch<32>(const uint8_t*, size_t, size_t, uint8_t*);
+template void sha256scalar_batch<33>(const uint8_t*, size_t, size_t, uint8_t*);
+
+void sha256scalar_counter33(const uint8_t* key, size_t n, uint8_t* out) {
+    RoundsScalar::HashCounter33(key, n, out);
+}
+
+void sha256scalar_random33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t* out) {
+    RoundsScalar::HashRandom33(prefix, seed, stream, block, n, out);
+}
+
+namespace {
+
+typedef void (*BatchFunc)(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+typedef void (*CounterFunc)(const uint8_t* key, size_t n, uint8_t* out);
+typedef void (*RandomFunc)(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t* out);
+
+struct Kernel {
+    const char* name;
+    int lanes;
+    bool (*supported)();
+    BatchFunc batch;      // Pre-padded blocks
+    BatchFunc batch32;    // 32-byte messages
+    BatchFunc batch33;    // 33-byte messages
+    CounterFunc counter33;
+    RandomFunc random33;
+    bool automatic;       // Candidate for the startup choice, otherwise only
+                          // used when picked with sha256_select_kernel
+};
+
+bool Always() {
+    return true;
+}
+
+// Widest first, the scalar kernel must stay last
+const Kernel kernels[] = {
+#ifndef NO_AVX512
+    { "avx512", 16, CpuHasAvx512f, sha256avx512_batch, sha256avx512_batch<32>, sha256avx512_batch<33>, sha256avx512_counter33, sha256avx512_random33, true },
+#endif
+    // Two interleaved AVX2 streams, opt-in until it is measured on the target cores
+    { "avx2x2", 16, CpuHasAvx2, sha256avx2x2_batch, sha256avx2x2_batch<32>, sha256avx2x2_batch<33>, sha256avx2x2_counter33, sha256avx2x2_random33, false },
+    { "avx2", 8, CpuHasAvx2, sha256avx2_batch, sha256avx2_batch<32>, sha256avx2_batch<33>, sha256avx2_counter33, sha256avx2_random33, true },
+    { "sse41", 4, CpuHasSse41, sha256sse41_batch, sha256sse41_batch<32>, sha256sse41_batch<33>, sha256sse41_counter33, sha256sse41_random33, true },
+    { "scalar", 1, Always, sha256scalar_batch, sha256scalar_batch<32>, sha256scalar_batch<33>, sha256scalar_counter33, sha256scalar_random33, true },
+};
+
+const int kernelCount = sizeof(kernels) / sizeof(kernels[0]);
+
+int FindKernel(const char* name) {
+    for (int k = 0; k < kernelCount; ++k) {
+        if (strcmp(kernels[k].name, name) == 0) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+bool available[kernelCount];
+
+int DetectKernel() {
+    for (int k = 0; k < kernelCount; ++k) {
+        available[k] = kernels[k].supported();
+    }
+
+    int k = 0;
+    while (!available[k] || !kernels[k].automatic) {
+        ++k;
+    }
+    return k;
+}
+
+// Picked once at startup
+int selected = DetectKernel();
+
+template <size_t Len>
+void Dispatch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    // Every full group goes to the widest kernel, the rest to narrower ones
+    for (int k = selected; n > 0; ++k) {
+        const Kernel& kernel = kernels[k];
+        size_t count = n - n % kernel.lanes;
+        if (count == 0 || !available[k]) {
+            continue;
+        }
+
+        BatchFunc batch = (Len == 0) ? kernel.batch : (Len == 32) ? kernel.batch32 : kernel.batch33;
+        batch(in, stride, count, out);
+
+        in += count * stride;
+        out += count * 32;
+        n -= count;
+    }
+}
+
+// key += count, big-endian
+void AdvanceKey33(uint8_t* key, uint64_t count) {
+    for (int i = 32; i >= 0 && count != 0; --i) {
+        uint64_t sum = key[i] + (count & 0xFF);
+        key[i] = (uint8_t)sum;
+        count = (count >> 8) + (sum >> 8);
+    }
+}
+
+// Key bytes of the random words: prefix, then the words big-endian
+void RandomKeyBytes(uint8_t prefix, const uint32_t* words, uint8_t* key) {
+    key[0] = prefix;
+    for (int k = 0; k < kRandomWords; ++k) {
+        key[1 + 4 * k] = (uint8_t)(words[k] >> 24);
+        key[2 + 4 * k] = (uint8_t)(words[k] >> 16);
+        key[3 + 4 * k] = (uint8_t)(words[k] >> 8);
+        key[4 + 4 * k] = (uint8_t)words[k];
+    }
+}
+
+} // namespace
+
+void sha256_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    Dispatch<0>(in, stride, n, out);
+}
+
+template <size_t Len>
+void sha256_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    static_assert(Len == 32 || Len == 33, "message lengths 32 and 33 only");
+    Dispatch<Len>(in, stride, n, out);
+}
+
+template void sha256_batch<32>(const uint8_t*, size_t, size_t, uint8_t*);
+template void sha256_batch<33>(const uint8_t*, size_t, size_t, uint8_t*);
+
+void sha256_counter33(const uint8_t* key, size_t n, uint8_t* out) {
+    uint8_t next[33];
+    memcpy(next, key, 33);
+
+    for (int k = selected; n > 0; ++k) {
+        const Kernel& kernel = kernels[k];
+        size_t count = n - n % kernel.lanes;
+        if (count == 0 || !available[k]) {
+            continue;
+        }
+
+        kernel.counter33(next, count, out);
+
+        AdvanceKey33(next, count);
+        out += count * 32;
+        n -= count;
+    }
+}
+
+void sha256_random33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t first, size_t n, uint8_t* out) {
+    // The keys of a block depend on all 16 generator lanes, so the selected
+    // kernel takes a whole block and leaves the lanes past n idle
+    uint64_t block = first / kRandomBlock;
+    for (; n > 0; ++block) {
+        size_t count = n < kRandomBlock ? n : (size_t)kRandomBlock;
+        kernels[selected].random33(prefix, seed, stream, block, count, out);
+        out += count * 32;
+        n -= count;
+    }
+}
+
+void sha256_random_key(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t counter, uint8_t* key) {
+    uint32_t words[kRandomWords];
+    RandomKeyWords(seed, stream, counter, words);
+    RandomKeyBytes(prefix, words, key);
+}
+
+void sha256_random_keys(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t first, size_t n, uint8_t* keys) {
+    uint32_t words[kRandomBlock][kRandomWords];
+    for (uint64_t block = first / kRandomBlock; n > 0; ++block) {
+        size_t count = n < kRandomBlock ? n : (size_t)kRandomBlock;
+        RandomBlockWords(seed, stream, block, count, words);
+        for (size_t r = 0; r < count; ++r) {
+            RandomKeyBytes(prefix, words[r], keys + r * 33);
+        }
+        keys += count * 33;
+        n -= count;
+    }
+}
+
+const char* sha256_kernel() {
+    return kernels[selected].name;
+}
+
+int sha256_kernel_lanes() {
+    return kernels[selected].lanes;
+}
+
+bool sha256_kernel_supported(const char* name) {
+    int k = FindKernel(name);
+    return k >= 0 && available[k];
+}
+
+bool sha256_select_kernel(const char* name) {
+    if (!sha256_kernel_supported(name)) {
+        return false;
+    }
+    selected = FindKernel(name);
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef SHA256_DISPATCH_H
+#define SHA256_DISPATCH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Portable SHA-256 entry points. At startup the widest kernel the CPU supports
+// is selected: "avx512" (16 lanes), "avx2" (8), "sse41" (4) or "scalar" (1).
+// "avx2x2" (16 lanes, two interleaved AVX2 streams) is only used when selected.
+// The selected kernel hashes every full group of its width, the leftover
+// messages go to the narrower kernels, so any n is hashed at full speed.
+
+// Hash n pre-padded 64-byte blocks stored stride bytes apart and write n
+// digests of 32 bytes contiguously to out
+void sha256_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+
+// Same for messages of exactly Len bytes (Len = 32 or 33, no padding)
+template <size_t Len>
+void sha256_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+
+// Hash the n consecutive 33-byte keys key, key + 1, ... (big-endian counter,
+// last byte lowest) and write n digests. The kernels generate the keys in
+// registers, nothing but the digests touches memory.
+void sha256_counter33(const uint8_t* key, size_t n, uint8_t* out);
+
+// Hash the n random 33-byte keys first, first + 1, ... of a stream (first a
+// multiple of 256) and write n digests. Key byte 0 is prefix, bytes 1..32
+// are drawn by lane-parallel xoshiro128** generators seeded from (seed,
+// stream) per block of 256 keys (see common/vec_random.h), straight into the
+// message words. The keys are the same on every kernel; sha256_random_key
+// regenerates one.
+void sha256_random33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t first, size_t n, uint8_t* out);
+void sha256_random_key(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t counter, uint8_t* key);
+
+// The n keys sha256_random33 hashes for the same arguments, 33 bytes each
+void sha256_random_keys(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t first, size_t n, uint8_t* keys);
+
+// Name and width of the kernel sha256_batch starts with
+const char* sha256_kernel();
+int sha256_kernel_lanes();
+
+// True if the kernel is compiled in and the CPU can run it
+bool sha256_kernel_supported(const char* name);
+
+// Start with another kernel (e.g. to compare widths); returns false and keeps
+// the current one when the kernel is not supported. Call before hashing starts.
+bool sha256_select_kernel(const char* name);
+
+// Kernels for one instruction set, called by the dispatcher. Any n works, but
+// only full groups of the kernel width run without idle lanes.
+void sha256scalar_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+template <size_t Len>
+void sha256scalar_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+void sha256scalar_counter33(const uint8_t* key, size_t n, uint8_t* out);
+void sha256scalar_random33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t* out);
+
+void sha256sse41_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+template <size_t Len>
+void sha256sse41_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+void sha256sse41_counter33(const uint8_t* key, size_t n, uint8_t* out);
+void sha256sse41_random33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t* out);
+
+void sha256avx512_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+template <size_t Len>
+void sha256avx512_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out);
+void sha256avx512_counter33(const uint8_t* key, size_t n, uint8_t* out);
+void sha256avx512_random33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t* out);
+
+#endif // SHA256_DISPATCH_H
@@ -0,0 +1,347 @@
+#ifndef SHA256_ROUNDS_H
+#define SHA256_ROUNDS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "../common/vec_traits.h"
+#include "../common/vec_counter.h"
+#include "../common/vec_random.h"
+
+// Width-generic SHA-256 round logic. V is one of the vector traits of
+// common/vec_traits.h; include this header after the target pragma of the
+// translation unit that instantiates it.
+
+namespace _sha256avx2 {
+
+// SHA-256 constants
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Initial hash values
+static const uint32_t H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// Scalar versions of s0/s1 for message words known at compile time
+static inline uint32_t ror32(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+static inline uint32_t sig0(uint32_t x) { return ror32(x, 7) ^ ror32(x, 18) ^ (x >> 3); }
+static inline uint32_t sig1(uint32_t x) { return ror32(x, 17) ^ ror32(x, 19) ^ (x >> 10); }
+
+// A 33-byte key is a big-endian counter (the generators increment its last
+// byte). As little-endian 32-bit digits: c[j] holds key bytes 29 - 4j ..
+// 32 - 4j, c[8] only byte 0.
+static inline void KeyDigits33(const uint8_t* key, uint32_t* c) {
+    for (int j = 0; j < 8; ++j) {
+        const uint8_t* p = key + 29 - 4 * j;
+        c[j] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+    c[8] = key[0];
+}
+
+template <class V>
+struct Rounds {
+    typedef typename V::vec vec;
+
+    static VEC_INLINE vec Maj(vec x, vec y, vec z) { return V::Or(V::And(x, y), V::And(z, V::Or(x, y))); }
+    static VEC_INLINE vec Ch(vec x, vec y, vec z) { return V::Xor(V::And(x, y), V::AndNot(x, z)); }
+
+    static VEC_INLINE vec S0(vec x) { return V::Xor(V::template Rotr<2>(x), V::Xor(V::template Rotr<13>(x), V::template Rotr<22>(x))); }
+    static VEC_INLINE vec S1(vec x) { return V::Xor(V::template Rotr<6>(x), V::Xor(V::template Rotr<11>(x), V::template Rotr<25>(x))); }
+    static VEC_INLINE vec s0(vec x) { return V::Xor(V::template Rotr<7>(x), V::Xor(V::template Rotr<18>(x), V::template Shr<3>(x))); }
+    static VEC_INLINE vec s1(vec x) { return V::Xor(V::template Rotr<17>(x), V::Xor(V::template Rotr<19>(x), V::template Shr<10>(x))); }
+
+    // One round, the working variables move down by one (h = g, ..., b = a)
+    static VEC_INLINE void Round(vec& a, vec& b, vec& c, vec& d, vec& e, vec& f, vec& g, vec& h, vec Kt, vec Wt) {
+        vec T1 = V::Add(V::Add(V::Add(V::Add(h, S1(e)), Ch(e, f, g)), Kt), Wt);
+        vec T2 = V::Add(S0(a), Maj(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = V::Add(d, T1);
+        d = c;
+        c = b;
+        b = a;
+        a = V::Add(T1, T2);
+    }
+
+    static VEC_INLINE void Initialize(vec* s) {
+        for (int i = 0; i < 8; ++i) {
+            s[i] = V::Set1(H0[i]);
+        }
+    }
+
+    // Load 32 bytes at offset from each lane's data as big-endian words 0..7
+    static VEC_INLINE void LoadBE(vec* W, const uint8_t* const* data, int offset) {
+        V::LoadWords(W, data, offset);
+        for (int i = 0; i < 8; ++i) {
+            W[i] = V::Bswap(W[i]);
+        }
+    }
+
+    // One 64-byte block per lane
+    static VEC_INLINE void Transform(vec* state, const uint8_t* const* data) {
+        vec a, b, c, d, e, f, g, h;
+        vec W[64];
+
+        // Load state into local variables
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+
+        // Prepare message schedule W[0..15], two transposed halves per block
+        LoadBE(W, data, 0);
+        LoadBE(W + 8, data, 32);
+
+        // Message schedule (message expansion) W[16..63]
+        for (int t = 16; t < 64; ++t) {
+            W[t] = V::Add(V::Add(s1(W[t - 2]), W[t - 7]), V::Add(s0(W[t - 15]), W[t - 16]));
+        }
+
+        // Main loop of SHA-256
+        for (int t = 0; t < 64; ++t) {
+            Round(a, b, c, d, e, f, g, h, V::Set1(K[t]), W[t]);
+        }
+
+        // Add the compressed chunk to the current hash value
+        state[0] = V::Add(state[0], a);
+        state[1] = V::Add(state[1], b);
+        state[2] = V::Add(state[2], c);
+        state[3] = V::Add(state[3], d);
+        state[4] = V::Add(state[4], e);
+        state[5] = V::Add(state[5], f);
+        state[6] = V::Add(state[6], g);
+        state[7] = V::Add(state[7], h);
+    }
+
+    // Message schedule of a single-block message of Len bytes (Len = 32 or 33):
+    // W[0..8] are set by the caller, W[9..14] are zero and W[15] is the bit
+    // length, so the zero terms drop out. W[16..last-1] are computed.
+    template <size_t Len>
+    static VEC_INLINE void ScheduleLen(vec* W, int last = 64) {
+        const uint32_t L = Len * 8;
+        vec Lv = V::Set1(L);
+
+        W[16] = V::Add(s0(W[1]), W[0]);
+        W[17] = V::Add(V::Add(s0(W[2]), W[1]), V::Set1(sig1(L)));
+        for (int t = 18; t < 22; ++t) {
+            W[t] = V::Add(s1(W[t - 2]), V::Add(s0(W[t - 15]), W[t - 16]));
+        }
+        W[22] = V::Add(V::Add(s1(W[20]), Lv), V::Add(s0(W[7]), W[6]));
+        W[23] = V::Add(V::Add(s1(W[21]), W[16]), V::Add(s0(W[8]), W[7]));
+        W[24] = V::Add(V::Add(s1(W[22]), W[17]), W[8]);
+        for (int t = 25; t < 30; ++t) {
+            W[t] = V::Add(s1(W[t - 2]), W[t - 7]);
+        }
+        W[30] = V::Add(V::Add(s1(W[28]), W[23]), V::Set1(sig0(L)));
+        W[31] = V::Add(V::Add(s1(W[29]), W[24]), V::Add(s0(W[16]), Lv));
+        for (int t = 32; t < last; ++t) {
+            W[t] = V::Add(V::Add(s1(W[t - 2]), W[t - 7]), V::Add(s0(W[t - 15]), W[t - 16]));
+        }
+    }
+
+    // Rounds 0..15 of a single-block message of Len bytes on the working
+    // variables v[0..7] = a..h. K[t] + W[t] is a constant for rounds 9..15.
+    template <size_t Len>
+    static VEC_INLINE void FirstRoundsLen(vec* v, const vec* W) {
+        const uint32_t L = Len * 8;
+
+        for (int t = 0; t < 9; ++t) {
+            Round(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], V::Set1(K[t]), W[t]);
+        }
+        for (int t = 9; t < 16; ++t) {
+            Round(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], V::Set1(K[t] + (t == 15 ? L : 0)), V::Zero());
+        }
+    }
+
+    // Transform from the initial state of a single-block message of Len bytes
+    // whose words W[0..8] are already in registers (W needs room for 64 words)
+    template <size_t Len>
+    static VEC_INLINE void TransformLenWords(vec* state, vec* W) {
+        vec v[8];
+
+        Initialize(state);
+        for (int i = 0; i < 8; ++i) {
+            v[i] = state[i];
+        }
+
+        ScheduleLen<Len>(W);
+        FirstRoundsLen<Len>(v, W);
+        for (int t = 16; t < 64; ++t) {
+            Round(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], V::Set1(K[t]), W[t]);
+        }
+
+        for (int i = 0; i < 8; ++i) {
+            state[i] = V::Add(state[i], v[i]);
+        }
+    }
+
+    // Transform of a single-block message of Len bytes (Len = 32 or 33) from the
+    // initial state. W[9..14] are zero and W[15] is the bit length, so K[t] + W[t]
+    // is a constant for rounds 9..15 and the zero terms drop out of the expansion.
+    template <size_t Len>
+    static VEC_INLINE void TransformLen(vec* state, const uint8_t* const* data) {
+        static_assert(Len == 32 || Len == 33, "single-block lengths 32 and 33 only");
+
+        vec W[64];
+
+        // Message words 0..7 (and the last key byte in word 8)
+        LoadBE(W, data, 0);
+        if (Len == 33) {
+            uint32_t w8[V::lanes];
+            for (int i = 0; i < V::lanes; ++i) {
+                w8[i] = ((uint32_t)data[i][32] << 24) | 0x800000;
+            }
+            W[8] = V::LoadU(w8);
+        } else {
+            W[8] = V::Set1(0x80000000);
+        }
+
+        TransformLenWords<Len>(state, W);
+    }
+
+    // Message words 0..8 of the 33-byte keys held by a counter: the key is
+    // shifted one byte against the word boundaries, so W[k] takes the low byte
+    // of digit 8 - k and the top three bytes of digit 7 - k
+    static VEC_INLINE void CounterWords33(vec* W, const vec* c) {
+        for (int k = 0; k < 8; ++k) {
+            W[k] = V::Or(V::template Shl<24>(c[8 - k]), V::template Shr<8>(c[7 - k]));
+        }
+        W[8] = V::Or(V::template Shl<24>(c[0]), V::Set1(0x800000));
+    }
+
+    // Byte swap the state and write one 32-byte digest per lane
+    static VEC_INLINE void StoreDigests(const vec* state, unsigned char* const* hashArray) {
+        vec rows[8];
+        for (int i = 0; i < 8; ++i) {
+            rows[i] = V::Bswap(state[i]);
+        }
+        V::StoreWords(rows, 8, hashArray);
+    }
+
+    // Hash the n consecutive 33-byte keys key, key + 1, ... (big-endian
+    // counter) and write n digests. The keys only exist in registers: each
+    // transform takes its message words from the counter, which then moves
+    // on by V::lanes.
+    static void HashCounter33(const uint8_t* key, size_t n, uint8_t* out) {
+        unsigned char scratch[V::lanes][32];
+        uint32_t digits[9];
+        KeyDigits33(key, digits);
+
+        VecCounter<V, 9> counter;
+        counter.Init(digits);
+
+        for (size_t base = 0; base < n; base += V::lanes) {
+            unsigned char* hashArray[V::lanes];
+            for (size_t i = 0; i < (size_t)V::lanes; ++i) {
+                hashArray[i] = (base + i < n) ? out + (base + i) * 32 : scratch[i];
+            }
+
+            vec W[64];
+            vec state[8];
+            CounterWords33(W, counter.c);
+            TransformLenWords<33>(state, W);
+            StoreDigests(state, hashArray);
+
+            counter.Next();
+        }
+    }
+
+    // Hash the first n (at most kRandomBlock) random keys of a block of a
+    // stream (see common/vec_random.h). Key byte 0 is prefix, bytes 1..32 the
+    // big-endian random words, which go into the counter digits in place of
+    // a key read from memory.
+    static void HashRandom33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t* out) {
+        unsigned char scratch[V::lanes][32];
+        VecRandom<V> random;
+        random.Seed(seed, stream, block);
+
+        vec c[9];
+        c[8] = V::Set1(prefix);
+
+        for (size_t base = 0; base < n; base += V::lanes) {
+            unsigned char* hashArray[V::lanes];
+            for (size_t i = 0; i < (size_t)V::lanes; ++i) {
+                hashArray[i] = (base + i < n) ? out + (base + i) * 32 : scratch[i];
+            }
+
+            int set = (int)(base / V::lanes % VecRandom<V>::sets);
+            for (int k = 0; k < kRandomWords; ++k) {
+                c[7 - k] = random.Next(set);
+            }
+
+            vec W[64];
+            vec state[8];
+            CounterWords33(W, c);
+            TransformLenWords<33>(state, W);
+            StoreDigests(state, hashArray);
+        }
+    }
+
+    // Hash n messages stored stride bytes apart, V::lanes per transform.
+    // Len = 0 means pre-padded 64-byte blocks, otherwise messages of exactly
+    // Len bytes. The last group may be partial: its idle lanes rehash the
+    // last message into a scratch buffer.
+    template <size_t Len>
+    static void HashStrided(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+        const size_t msgLen = (Len == 0) ? 64 : Len;
+        unsigned char scratch[V::lanes][32];
+
+        for (size_t base = 0; base < n; base += V::lanes) {
+            const uint8_t* data[V::lanes];
+            unsigned char* hashArray[V::lanes];
+
+            for (size_t i = 0; i < (size_t)V::lanes; ++i) {
+                if (base + i < n) {
+                    data[i] = in + (base + i) * stride;
+                    hashArray[i] = out + (base + i) * 32;
+                } else {
+                    data[i] = in + (n - 1) * stride;
+                    hashArray[i] = scratch[i];
+                }
+            }
+
+            // Prefetch the next group while this one is compressed
+            for (size_t i = base + V::lanes; i < base + 2 * V::lanes && i < n; ++i) {
+                const char* ptr = (const char*)(in + i * stride);
+                _mm_prefetch(ptr, _MM_HINT_T0);
+                _mm_prefetch(ptr + msgLen - 1, _MM_HINT_T0);
+            }
+
+            vec state[8];
+            if constexpr (Len == 0) {
+                Initialize(state);
+                Transform(state, data);
+            } else {
+                TransformLen<Len>(state, data);
+            }
+
+            StoreDigests(state, hashArray);
+        }
+    }
+};
+
+} // namespace _sha256avx2
+
+#endif // SHA256_ROUNDS_H
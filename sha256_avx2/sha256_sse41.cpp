@@ -0,0 +1,38 @@
+#include "sha256_dispatch.h"
+#include <immintrin.h>
+
+// SSE4.1 kernels, 4 messages per transform. Only called after the dispatcher
+// has checked the CPU.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC target("sse4.1")
+#elif defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse4.1"))), apply_to = function)
+#endif
+
+#include "sha256_rounds.h"
+
+typedef _sha256avx2::Rounds<VecSse41> RoundsSse41;
+
+void sha256sse41_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    RoundsSse41::HashStrided<0>(in, stride, n, out);
+}
+
+template <size_t Len>
+void sha256sse41_batch(const uint8_t* in, size_t stride, size_t n, uint8_t* out) {
+    RoundsSse41::HashStrided<Len>(in, stride, n, out);
+}
+
+template void sha256sse41_batch<32>(const uint8_t*, size_t, size_t, uint8_t*);
+template void sha256sse41_batch<33>(const uint8_t*, size_t, size_t, uint8_t*);
+
+void sha256sse41_counter33(const uint8_t* key, size_t n, uint8_t* out) {
+    RoundsSse41::HashCounter33(key, n, out);
+}
+
+void sha256sse41_random33(uint8_t prefix, uint64_t seed, uint64_t stream, uint64_t block, size_t n, uint8_t* out) {
+    RoundsSse41::HashRandom33(prefix, seed, stream, block, n, out);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif